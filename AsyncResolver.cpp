@@ -0,0 +1,367 @@
+# include	<math.h>
+# include	<QMutexLocker>
+# include	"AsyncResolver.h"
+# include	"Resolver.h"
+# include	"GeoCache.h"
+# include	"Stats.h"
+
+/*
+ * NAME: TokenBucket
+ * PURPOSE: Constructor of the TokenBucket class
+ * ARGUMENTS: new_rate: tokens per second, 0 for no limit
+ *	new_capacity: max number of tokens saved up (the burst size)
+ * RETURNS: Nothing
+ */
+TokenBucket::TokenBucket(double new_rate, double new_capacity)
+{
+    rate = new_rate;
+    capacity = new_capacity < 1.0 ? 1.0 : new_capacity;
+    tokens = capacity;
+    clock.start();
+}
+
+/*
+ * NAME: refill
+ * PURPOSE: To add the tokens that accumulated since the last call
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+TokenBucket::refill()
+{
+    double elapsed = clock.nsecsElapsed() / 1e9;
+
+    clock.restart();
+    tokens = qMin(capacity, tokens + elapsed * rate);
+}
+
+/*
+ * NAME: Take
+ * PURPOSE: To take a token
+ * ARGUMENTS: None
+ * RETURNS: true if a token was available
+ */
+bool
+TokenBucket::Take()
+{
+    if (rate <= 0.0)
+	return true;
+
+    refill();
+    if (tokens < 1.0)
+	return false;
+
+    tokens -= 1.0;
+    return true;
+}
+
+/*
+ * NAME: Wait
+ * PURPOSE: To find out how long until the next token is available
+ * ARGUMENTS: None
+ * RETURNS: time in milliseconds
+ */
+int
+TokenBucket::Wait()
+{
+    if (rate <= 0.0)
+	return 0;
+
+    refill();
+    if (tokens >= 1.0)
+	return 0;
+
+    return (int) ceil((1.0 - tokens) / rate * 1000.0);
+}
+
+/*
+ * NAME: AsyncResolver
+ * PURPOSE: Constructor of the AsyncResolver class
+ * ARGUMENTS: new_maxInFlight: max number of requests running at the same time
+ *	rate: max number of requests per second, 0 for no limit
+ *	parent: parent object
+ * RETURNS: Nothing
+ * NOTE: The thread is started right away
+ */
+AsyncResolver::AsyncResolver(int new_maxInFlight, double rate, QObject *parent)
+    : QThread(parent), bucket(rate, 1.0)
+{
+    maxInFlight = new_maxInFlight < 1 ? 1 : new_maxInFlight;
+    inFlight = 0;
+    stopping = false;
+    requests = 0;
+
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) maxInFlight);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long) maxInFlight);
+
+    start();
+}
+
+/*
+ * NAME: ~AsyncResolver
+ * PURPOSE: Destructor of the AsyncResolver class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Requests still queued or in flight are dropped
+ */
+AsyncResolver::~AsyncResolver()
+{
+    mutex.lock();
+    stopping = true;
+    mutex.unlock();
+    wait();
+
+    qDeleteAll(queue);
+    for (QList<CURL *>::iterator easy = idle.begin(); easy != idle.end(); easy++)
+	curl_easy_cleanup(*easy);
+    curl_multi_cleanup(multi);
+}
+
+/*
+ * NAME: Lookup
+ * PURPOSE: To ask for the location of a pair of coordinates
+ * ARGUMENTS: id: passed back with the result
+ *	lon: the location's longitude
+ *	lat: the location's latitude
+ *	online: if false, only the cache is consulted
+ * RETURNS: true if a request was queued, false if not
+ * NOTE: The result is delivered by the resolved() signal. If the
+ *	coordinates are in the cache, or there is an offline database,
+ *	it is emitted before Lookup returns.
+ */
+bool
+AsyncResolver::Lookup(int id, double lon, double lat, bool online)
+{
+    GeoCache *cache = Resolver::Cache();
+    QString location;
+
+    if (Resolver::OfflineDB() != NULL)
+    {
+	emit resolved(id, Resolver::Offline(lon, lat));
+	return false;
+    }
+    if (cache != NULL && cache->Lookup(lon, lat, &location))
+    {
+	emit resolved(id, location);
+	return false;
+    }
+    if (!online)
+	return false;
+
+    Request *request = new Request;
+    request->id = id;
+    request->lon = lon;
+    request->lat = lat;
+
+    QMutexLocker locker(&mutex);
+    queue.enqueue(request);
+    return true;
+}
+
+/*
+ * NAME: Cancel
+ * PURPOSE: To drop all requests that have not been sent yet
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+AsyncResolver::Cancel()
+{
+    QMutexLocker locker(&mutex);
+
+    qDeleteAll(queue);
+    queue.clear();
+}
+
+/*
+ * NAME: Pending
+ * PURPOSE: Access method of the number of unfinished requests
+ * ARGUMENTS: None
+ * RETURNS: number of requests queued or in flight
+ */
+int
+AsyncResolver::Pending()
+{
+    QMutexLocker locker(&mutex);
+
+    return queue.size() + inFlight;
+}
+
+/*
+ * NAME: Requests
+ * PURPOSE: Access method of the number of requests sent so far
+ * ARGUMENTS: None
+ * RETURNS: number of requests sent to the reverse geocoder
+ */
+unsigned long
+AsyncResolver::Requests()
+{
+    QMutexLocker locker(&mutex);
+
+    return requests;
+}
+
+/*
+ * NAME: run
+ * PURPOSE: The main loop of the resolver thread
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Starts queued requests as long as the number of requests in
+ *	flight and the token bucket allow, then lets curl do its work.
+ *	curl_multi_wait() returns at once if there is no transfer, so
+ *	while there is none the thread sleeps instead.
+ */
+void
+AsyncResolver::run()
+{
+    while (1)
+    {
+	int running, left, timeout;
+	CURLMsg *msg;
+
+	mutex.lock();
+	if (stopping)
+	{
+	    mutex.unlock();
+	    break;
+	}
+	while (inFlight < maxInFlight && !queue.isEmpty() && bucket.Take())
+	    send(queue.dequeue());
+	if (queue.isEmpty() || inFlight >= maxInFlight)
+	    timeout = 50;
+	else
+	    timeout = qBound(1, bucket.Wait(), 50);
+	mutex.unlock();
+
+	curl_multi_perform(multi, &running);
+	while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+	    if (msg->msg == CURLMSG_DONE)
+		finish(msg->easy_handle, msg->data.result);
+
+	if (active.isEmpty())
+	    msleep(timeout);
+	else
+	    curl_multi_wait(multi, NULL, 0, timeout, NULL);
+    }
+
+    // Abandon whatever is still in flight
+    for (QList<CURL *>::iterator easy = active.begin(); easy != active.end(); easy++)
+    {
+	char *request;
+
+	curl_easy_getinfo(*easy, CURLINFO_PRIVATE, &request);
+	delete (Request *) request;
+	curl_multi_remove_handle(multi, *easy);
+	curl_easy_cleanup(*easy);
+    }
+    active.clear();
+}
+
+/*
+ * NAME: send
+ * PURPOSE: To start a request
+ * ARGUMENTS: request: the request
+ * RETURNS: Nothing
+ * NOTE: Called with the mutex held. Easy handles are reused,
+ *	the connections are kept by the multi handle.
+ *	A request that cannot be started is answered with an empty
+ *	location right away, so the caller does not wait for it.
+ */
+void
+AsyncResolver::send(Request *request)
+{
+    CURL *easy = idle.isEmpty() ? curl_easy_init() : idle.takeLast();
+
+    if (easy == NULL)
+    {
+	Stats::Count(STAT_HTTP_FAILURES);
+	emit resolved(request->id, QString());
+	delete request;
+	return;
+    }
+
+    curl_easy_setopt(easy, CURLOPT_URL, Resolver::Url(request->lon, request->lat).constData());
+    curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(easy, CURLOPT_USERAGENT, USER_AGENT);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, (long) RESOLVER_CONNECT_TIMEOUT);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT, (long) RESOLVER_TIMEOUT);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, append);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &request->response);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, (char *) request);
+    if (curl_multi_add_handle(multi, easy) != CURLM_OK)
+    {
+	idle.append(easy);
+	Stats::Count(STAT_HTTP_FAILURES);
+	emit resolved(request->id, QString());
+	delete request;
+	return;
+    }
+
+    active.append(easy);
+    inFlight++;
+    requests++;
+    Stats::Count(STAT_HTTP_REQUESTS);
+}
+
+/*
+ * NAME: finish
+ * PURPOSE: To deliver the result of a request
+ * ARGUMENTS: easy: the easy handle of the request
+ *	result: the result of the transfer
+ * RETURNS: Nothing
+ * NOTE: A failed request yields an empty location, so it is
+ *	neither cached nor saved and will be tried again next time.
+ */
+void
+AsyncResolver::finish(CURL *easy, CURLcode result)
+{
+    char *p;
+    long status = 0;
+    curl_off_t total = 0;
+    QString location;
+
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, &p);
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+    if (Stats::Enabled() && curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total) == CURLE_OK)
+    {
+	// The requests overlap, so they are timed by curl
+	Stats::Time(PHASE_HTTP, Stats::Now() - total * 1000, total * 1000);
+	Stats::Latency(total * 1000);
+    }
+    if (result != CURLE_OK || status != 200)
+	Stats::Count(STAT_HTTP_FAILURES);
+    curl_multi_remove_handle(multi, easy);
+    active.removeOne(easy);
+    idle.append(easy);
+
+    Request *request = (Request *) p;
+    if (result == CURLE_OK && status == 200)
+	location = Resolver::Format(QString::fromUtf8(request->response), request->lon, request->lat);
+
+    mutex.lock();
+    inFlight--;
+    mutex.unlock();
+
+    emit resolved(request->id, location);
+    delete request;
+}
+
+/*
+ * NAME: append
+ * PURPOSE: To append received data to the response of a request
+ * ARGUMENTS: contents: data to append
+ *	size: size of portion to append
+ *	nmemb: number of <size> portions
+ *	userp: address of the QByteArray holding the response
+ * RETURNS: size * nmemb
+ * NOTE: This is the WRITEFUNCTION callback of curl
+ */
+size_t
+AsyncResolver::append(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    ((QByteArray *) userp)->append((const char *) contents, size * nmemb);
+
+    return size * nmemb;
+}
@@ -0,0 +1,73 @@
+# ifndef	ASYNCRESOLVER_H
+# define	ASYNCRESOLVER_H
+
+# include	<curl/curl.h>
+# include	<QThread>
+# include	<QMutex>
+# include	<QQueue>
+# include	<QList>
+# include	<QByteArray>
+# include	<QElapsedTimer>
+# include	<QString>
+
+/*
+ * A token bucket: "rate" tokens per second, at most "capacity" saved up.
+ * A rate of 0 means no limit.
+ */
+class TokenBucket {
+public:
+    TokenBucket(double rate, double capacity);
+    bool Take();
+    int Wait();
+private:
+    void refill();
+    double rate;
+    double capacity;
+    double tokens;
+    QElapsedTimer clock;
+};
+
+/*
+ * Reverse geocoding without blocking the caller.
+ * The requests are run by a thread of its own on a curl multi handle,
+ * which keeps the connections to the geocoder alive between requests.
+ */
+class AsyncResolver : public QThread {
+    Q_OBJECT
+public:
+    AsyncResolver(int maxInFlight, double rate, QObject *parent = 0);
+    ~AsyncResolver();
+    bool Lookup(int id, double lon, double lat, bool online = true);
+    void Cancel();
+    int Pending();
+    unsigned long Requests();
+signals:
+    void resolved(int id, QString location);
+protected:
+    void run();
+private:
+    struct Request {
+	int id;
+	double lon;
+	double lat;
+	QByteArray response;
+    };
+    void send(Request *request);
+    void finish(CURL *easy, CURLcode result);
+    static size_t append(void *contents, size_t size, size_t nmemb, void *userp);
+    CURLM *multi;
+    QList<CURL *> idle;		// easy handles ready for reuse
+    QList<CURL *> active;	// easy handles with a request in flight
+    int maxInFlight;
+    int inFlight;
+    TokenBucket bucket;
+    QMutex mutex;		// protects queue, inFlight, stopping and requests
+    QQueue<Request *> queue;
+    bool stopping;
+    unsigned long requests;
+};
+
+// A request that takes longer than this has failed (seconds)
+# define	RESOLVER_CONNECT_TIMEOUT	10
+# define	RESOLVER_TIMEOUT	30
+# endif // ASYNCRESOLVER_H
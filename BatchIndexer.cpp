@@ -0,0 +1,186 @@
+# include	<iostream>
+# include	<QDir>
+# include	<QFileInfo>
+# include	<QEventLoop>
+# include	<QTimer>
+# include	"BatchIndexer.h"
+# include	"Catalog.h"
+
+using namespace std;
+
+extern Catalog *catalog;
+
+volatile sig_atomic_t BatchIndexer::interrupted = 0;
+
+/*
+ * NAME: BatchIndexer
+ * PURPOSE: Constructor of the BatchIndexer class
+ * ARGUMENTS: new_directories: the directories to index
+ *	new_recursive: true to index all directories below them as well
+ *	new_resolverDelay: delay between requests to reverse geocoder
+ *	new_jobs: number of files to scan in parallel
+ *	parent: parent object
+ * RETURNS: Nothing
+ */
+BatchIndexer::BatchIndexer(QStringList new_directories, bool new_recursive, float new_resolverDelay, unsigned int new_jobs, QObject *parent)
+    : QObject(parent)
+{
+    directories = new_directories;
+    recursive = new_recursive;
+    resolverDelay = new_resolverDelay;
+    jobs = new_jobs;
+    indexer = NULL;
+    found = 0;
+    totalFound = 0;
+}
+
+/*
+ * NAME: Run
+ * PURPOSE: To index the directories
+ * ARGUMENTS: None
+ * RETURNS: exit code: 0 if all directories have been indexed,
+ *	1 if one could not be read or the run was interrupted
+ * NOTE: Runs an event loop while a directory is being indexed,
+ *	so the progress of the indexer is delivered.
+ */
+int
+BatchIndexer::Run()
+{
+    QStringList folders;
+    QMap<QString,QStringList> trees;	// the directories of every top directory
+    QElapsedTimer clock;
+    QTimer pollTimer;
+    int status = 0;
+
+    clock.start();
+    for (QStringList::iterator directory = directories.begin(); directory != directories.end(); directory++)
+    {
+	QString top(QDir(*directory).absolutePath());
+
+	if (!QFileInfo(top).isDir())
+	{
+	    cerr << directory->toStdString() << ": not a directory" << endl;
+	    status = 1;
+	    continue;
+	}
+	QStringList tree(recursive ? Indexer::Tree(top) : QStringList(""));
+	for (QStringList::iterator folder = tree.begin(); folder != tree.end(); folder++)
+	    trees[top].append(QDir::cleanPath(top + "/" + *folder));
+	folders += trees[top];
+    }
+    cout << folders.length() << " directories to index" << endl;
+
+    // A signal only sets a flag, the indexer is cancelled from here
+    signal(SIGINT, interrupt);
+    signal(SIGTERM, interrupt);
+    connect(&pollTimer, SIGNAL(timeout()), this, SLOT(poll()));
+    pollTimer.start(100);
+
+    for (int i = 0; i < folders.length() && !interrupted; i++)
+    {
+	QElapsedTimer elapsed;
+	Indexer folderIndexer(folders[i], false, resolverDelay, 0, jobs);
+	QEventLoop loop;
+
+	elapsed.start();
+	current = folders[i];
+	label = QString("[%1/%2] %3").arg(i + 1).arg(folders.length()).arg(current);
+	phase.clear();
+	found = 0;
+
+	connect(&folderIndexer, SIGNAL(progress(QString,int,int)), this, SLOT(progress(QString,int,int)));
+	connect(&folderIndexer, SIGNAL(located(QString,QString)), this, SLOT(located(QString,QString)));
+	connect(&folderIndexer, SIGNAL(finished()), &loop, SLOT(quit()));
+	folderIndexer.Load();
+	indexer = &folderIndexer;
+	folderIndexer.start();
+	loop.exec();
+	indexer = NULL;
+
+	totalFound += found;
+	cout << label.toStdString() << ": " << (interrupted ? "interrupted" : "done") << ", "
+	     << found << " located, " << elapsed.elapsed() / 1000 << " s" << endl;
+    }
+
+    pollTimer.stop();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    // Every directory is indexed on its own, so the catalog is pruned here
+    if (recursive && !interrupted && catalog != NULL)
+	for (QMap<QString,QStringList>::iterator tree = trees.begin(); tree != trees.end(); tree++)
+	    catalog->Prune(tree.key(), tree.value());
+
+    cout << (interrupted ? "interrupted" : "finished") << " after " << clock.elapsed() / 1000 << " s, "
+	 << totalFound << " photos located" << endl;
+    return interrupted ? 1 : status;
+}
+
+/*
+ * NAME: progress
+ * PURPOSE: To show how far the indexer has got
+ * ARGUMENTS: new_phase: what it is doing
+ *	done: how many of
+ *	total: items
+ * RETURNS: Nothing
+ * NOTE: A line is printed when a phase starts or ends, and in
+ *	between at most every BATCH_REPORT_INTERVAL milliseconds,
+ *	which keeps the log of a cron job short.
+ */
+void
+BatchIndexer::progress(QString new_phase, int done, int total)
+{
+    if (new_phase == phase && done != total && lastReport.isValid() && lastReport.elapsed() < BATCH_REPORT_INTERVAL)
+	return;
+
+    phase = new_phase;
+    lastReport.start();
+    cout << label.toStdString() << ": " << phase.toStdString() << " " << done << "/" << total << endl;
+}
+
+/*
+ * NAME: located
+ * PURPOSE: To count the photos whose location has been found
+ * ARGUMENTS: name: pathname of the photo relative to the directory
+ *	location: its location
+ * RETURNS: Nothing
+ */
+void
+BatchIndexer::located(QString name, QString location)
+{
+    Q_UNUSED(name);
+    Q_UNUSED(location);
+
+    found++;
+}
+
+/*
+ * NAME: poll
+ * PURPOSE: To cancel the indexer once a signal has come in
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: The indexer then saves what it has done so far and finishes
+ */
+void
+BatchIndexer::poll()
+{
+    if (interrupted && indexer != NULL && !indexer->IsCancelled())
+    {
+	cout << label.toStdString() << ": interrupted, saving" << endl;
+	indexer->Cancel();
+    }
+}
+
+/*
+ * NAME: interrupt
+ * PURPOSE: The handler of SIGINT and SIGTERM
+ * ARGUMENTS: signal: the signal
+ * RETURNS: Nothing
+ */
+void
+BatchIndexer::interrupt(int signal)
+{
+    Q_UNUSED(signal);
+
+    interrupted = 1;
+}
@@ -0,0 +1,53 @@
+# ifndef	BATCHINDEXER_H
+# define	BATCHINDEXER_H
+
+# include	<signal.h>
+# include	<QObject>
+# include	<QString>
+# include	<QStringList>
+# include	<QElapsedTimer>
+# include	"Indexer.h"
+
+/*
+ * Indexes directory trees without a window, eg from cron, so the
+ * viewer opens them warm. Every directory of the trees is indexed
+ * by an Indexer of its own, one after the other, with as many workers
+ * as asked for, and is saved as soon as it is done. There is no cap
+ * on the number of lookups, only the delay between them, which is
+ * BATCH_DEFAULT_DELAY unless --delay says otherwise.
+ * SIGINT and SIGTERM cancel the directory being indexed, which saves
+ * what it has so far; the next run goes on from there, as the index
+ * tells which images are done.
+ * The progress is printed on stdout.
+ */
+class BatchIndexer : public QObject {
+    Q_OBJECT
+public:
+    BatchIndexer(QStringList directories, bool recursive, float resolverDelay, unsigned int jobs, QObject *parent = 0);
+    int Run();
+private slots:
+    void progress(QString phase, int done, int total);
+    void located(QString name, QString location);
+    void poll();
+private:
+    static void interrupt(int signal);
+    static volatile sig_atomic_t interrupted;
+    QStringList directories;
+    bool recursive;
+    float resolverDelay;
+    unsigned int jobs;
+    Indexer *indexer;		// of the directory being indexed, NULL if none
+    QString current;		// its pathname
+    QString label;		// how it is shown, with its number
+    QString phase;		// what it is doing
+    QElapsedTimer lastReport;	// progress is shown once a second
+    int found;			// locations found in the current directory
+    int totalFound;
+};
+
+// Progress of a phase is shown at most this often (milliseconds)
+# define	BATCH_REPORT_INTERVAL	1000
+// Delay between reverse geocoding requests if none is given (seconds),
+// as the usage policy of the public Nominatim server asks for
+# define	BATCH_DEFAULT_DELAY	1
+# endif // BATCHINDEXER_H
@@ -0,0 +1,482 @@
+# include	<math.h>
+# include	<algorithm>
+# include	<QDir>
+# include	<QFile>
+# include	<QFileInfo>
+# include	<QSet>
+# include	<QMutexLocker>
+# include	"Catalog.h"
+# include	"Cluster.h"
+
+// The layout of the database, see Catalog::Catalog()
+# define	CATALOG_VERSION	1
+
+static const char *schema[] = {
+    "PRAGMA journal_mode = WAL",
+    "PRAGMA synchronous = NORMAL",
+    "CREATE TABLE IF NOT EXISTS photos ("
+	"id INTEGER PRIMARY KEY, "
+	"directory TEXT NOT NULL, "
+	"name TEXT NOT NULL, "
+	"latitude REAL, "
+	"longitude REAL, "
+	"timestamp INTEGER NOT NULL, "
+	"orientation INTEGER NOT NULL, "
+	"location TEXT, "
+	"UNIQUE (directory, name))",
+    "CREATE INDEX IF NOT EXISTS photos_timestamp ON photos (timestamp) WHERE timestamp != 0",
+    "CREATE VIRTUAL TABLE IF NOT EXISTS photos_where USING rtree (id, minLat, maxLat, minLon, maxLon)",
+    "CREATE TABLE IF NOT EXISTS directories (path TEXT PRIMARY KEY, photos INTEGER NOT NULL)",
+    NULL
+};
+
+// The columns CatalogEntry is filled from, in select()
+# define	CATALOG_COLUMNS	"p.directory, p.name, p.latitude, p.longitude, p.timestamp, p.orientation, p.location"
+
+/*
+ * NAME: bind_text
+ * PURPOSE: To bind a string to a parameter of a statement
+ * ARGUMENTS: statement: the statement
+ *	i: number of the parameter, from 1
+ *	s: the string
+ * RETURNS: Nothing
+ */
+static void
+bind_text(sqlite3_stmt *statement, int i, const QString &s)
+{
+    QByteArray utf8(s.toUtf8());
+
+    sqlite3_bind_text(statement, i, utf8.constData(), utf8.length(), SQLITE_TRANSIENT);
+}
+
+/*
+ * NAME: Catalog
+ * PURPOSE: Constructor of the Catalog class
+ * ARGUMENTS: filename: pathname of the database, created if need be
+ * RETURNS: Nothing
+ * NOTE: The photos table holds one row per photo. Photos with
+ *	coordinates have a row of the same id in the photos_where
+ *	R-tree; SQLite keeps its coordinates as floats rounded outwards,
+ *	so the exact ones in photos are checked as well.
+ *	The directories table tells how many photos of a directory
+ *	the catalog has, to find the directories it does not know yet.
+ *	The journal is a write-ahead log, so the viewer can look
+ *	things up while a batch indexer is writing.
+ */
+Catalog::Catalog(QString filename)
+{
+    QByteArray name(QFile::encodeName(filename));
+
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+    if (sqlite3_open_v2(name.constData(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL) != SQLITE_OK)
+    {
+	sqlite3_close(db);
+	db = NULL;
+	return;
+    }
+    sqlite3_busy_timeout(db, 10000);
+
+    sqlite3_stmt *version = prepare("PRAGMA user_version");
+    int found = version != NULL && sqlite3_step(version) == SQLITE_ROW ? sqlite3_column_int(version, 0) : -1;
+    sqlite3_finalize(version);
+    if (found != 0 && found != CATALOG_VERSION)
+    {
+	sqlite3_close(db);
+	db = NULL;
+	return;
+    }
+
+    for (int i = 0; schema[i] != NULL; i++)
+	if (!exec(schema[i]))
+	{
+	    sqlite3_close(db);
+	    db = NULL;
+	    return;
+	}
+    exec("PRAGMA user_version = " QT_STRINGIFY(CATALOG_VERSION));
+}
+
+/*
+ * NAME: ~Catalog
+ * PURPOSE: Destructor of the Catalog class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+Catalog::~Catalog()
+{
+    if (db != NULL)
+	sqlite3_close(db);
+}
+
+/*
+ * NAME: IsValid
+ * PURPOSE: To find out if the catalog can be used
+ * ARGUMENTS: None
+ * RETURNS: true if the database could be opened
+ */
+bool
+Catalog::IsValid() const
+{
+    return db != NULL;
+}
+
+/*
+ * NAME: exec
+ * PURPOSE: To run an SQL statement that returns nothing
+ * ARGUMENTS: sql: the statement
+ * RETURNS: true on success
+ */
+bool
+Catalog::exec(const char *sql)
+{
+    return sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK;
+}
+
+/*
+ * NAME: prepare
+ * PURPOSE: To compile an SQL statement
+ * ARGUMENTS: sql: the statement
+ * RETURNS: the statement, NULL on error
+ */
+sqlite3_stmt *
+Catalog::prepare(const char *sql)
+{
+    sqlite3_stmt *statement;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &statement, NULL) != SQLITE_OK)
+	return NULL;
+    return statement;
+}
+
+/*
+ * NAME: Known
+ * PURPOSE: To find out if the catalog is up to date with a directory
+ * ARGUMENTS: directory: absolute pathname of the directory
+ *	photos: number of photos in its index
+ * RETURNS: true if the catalog has that many photos of the directory
+ * NOTE: This catches the directories indexed before there was a
+ *	catalog, or while it could not be written.
+ */
+bool
+Catalog::Known(QString directory, quint32 photos)
+{
+    QMutexLocker locker(&mutex);
+    sqlite3_stmt *statement;
+    bool known = false;
+
+    if (db == NULL || (statement = prepare("SELECT photos FROM directories WHERE path = ?1")) == NULL)
+	return false;
+    bind_text(statement, 1, directory);
+    if (sqlite3_step(statement) == SQLITE_ROW)
+	known = (quint32) sqlite3_column_int64(statement, 0) == photos;
+    sqlite3_finalize(statement);
+
+    return known;
+}
+
+/*
+ * NAME: Update
+ * PURPOSE: To replace the photos of a directory
+ * ARGUMENTS: directory: absolute pathname of the directory
+ *	index: its index, NULL if it has no photos
+ *	locations: its locations, by file name
+ * RETURNS: true on success
+ * NOTE: This is a single transaction, readers see the directory
+ *	either as it was or as it is now.
+ */
+bool
+Catalog::Update(QString directory, const MetaIndex *index, const QMap<QString,QString> &locations)
+{
+    QMutexLocker locker(&mutex);
+    sqlite3_stmt *dropPlaces, *dropPhotos, *insertPhoto, *insertPlace, *insertDirectory;
+    quint32 count = index != NULL ? index->Count() : 0;
+    bool ok;
+
+    if (db == NULL || !exec("BEGIN IMMEDIATE"))
+	return false;
+
+    dropPlaces = prepare("DELETE FROM photos_where WHERE id IN (SELECT id FROM photos WHERE directory = ?1)");
+    dropPhotos = prepare("DELETE FROM photos WHERE directory = ?1");
+    insertPhoto = prepare("INSERT INTO photos (directory, name, latitude, longitude, timestamp, orientation, location) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)");
+    insertPlace = prepare("INSERT INTO photos_where VALUES (?1, ?2, ?2, ?3, ?3)");
+    insertDirectory = prepare("INSERT OR REPLACE INTO directories (path, photos) VALUES (?1, ?2)");
+    ok = dropPlaces != NULL && dropPhotos != NULL && insertPhoto != NULL && insertPlace != NULL && insertDirectory != NULL;
+
+    if (ok)
+    {
+	bind_text(dropPlaces, 1, directory);
+	bind_text(dropPhotos, 1, directory);
+	ok = sqlite3_step(dropPlaces) == SQLITE_DONE && sqlite3_step(dropPhotos) == SQLITE_DONE;
+	bind_text(insertPhoto, 1, directory);
+    }
+
+    for (quint32 i = 0; ok && i < count; i++)
+    {
+	const MetaRecord *record = index->At(i);
+	QString name(index->Name(record)), location(locations.value(name));
+	bool located = record->latitude != 0.0 || record->longitude != 0.0;
+
+	bind_text(insertPhoto, 2, name);
+	if (located)
+	{
+	    sqlite3_bind_double(insertPhoto, 3, record->latitude);
+	    sqlite3_bind_double(insertPhoto, 4, record->longitude);
+	}
+	else
+	{
+	    sqlite3_bind_null(insertPhoto, 3);
+	    sqlite3_bind_null(insertPhoto, 4);
+	}
+	sqlite3_bind_int64(insertPhoto, 5, record->timestamp);
+	sqlite3_bind_int(insertPhoto, 6, record->orientation);
+	if (location.length() != 0)
+	    bind_text(insertPhoto, 7, location);
+	else
+	    sqlite3_bind_null(insertPhoto, 7);
+	ok = sqlite3_step(insertPhoto) == SQLITE_DONE;
+	sqlite3_reset(insertPhoto);
+
+	if (ok && located)
+	{
+	    sqlite3_bind_int64(insertPlace, 1, sqlite3_last_insert_rowid(db));
+	    sqlite3_bind_double(insertPlace, 2, record->latitude);
+	    sqlite3_bind_double(insertPlace, 3, record->longitude);
+	    ok = sqlite3_step(insertPlace) == SQLITE_DONE;
+	    sqlite3_reset(insertPlace);
+	}
+    }
+
+    if (ok)
+    {
+	bind_text(insertDirectory, 1, directory);
+	sqlite3_bind_int64(insertDirectory, 2, count);
+	ok = sqlite3_step(insertDirectory) == SQLITE_DONE;
+    }
+
+    sqlite3_finalize(dropPlaces);
+    sqlite3_finalize(dropPhotos);
+    sqlite3_finalize(insertPhoto);
+    sqlite3_finalize(insertPlace);
+    sqlite3_finalize(insertDirectory);
+
+    if (ok && exec("COMMIT"))
+	return true;
+    exec("ROLLBACK");
+    return false;
+}
+
+/*
+ * NAME: Prune
+ * PURPOSE: To drop the directories below a directory that are gone
+ * ARGUMENTS: top: absolute pathname of the top directory
+ *	directories: absolute pathnames of the directories there are
+ *		below it, and of itself
+ * RETURNS: true on success
+ */
+bool
+Catalog::Prune(QString top, const QStringList &directories)
+{
+    QMutexLocker locker(&mutex);
+    QSet<QString> keep(directories.toSet());
+    QStringList gone;
+    sqlite3_stmt *statement;
+    bool ok = true;
+
+    // Everything that starts with "top/": '0' comes right after '/'
+    if (db == NULL || (statement = prepare("SELECT path FROM directories WHERE path = ?1 OR (path >= ?1 || '/' AND path < ?1 || '0')")) == NULL)
+	return false;
+    bind_text(statement, 1, top);
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+	QString path(QString::fromUtf8((const char *) sqlite3_column_text(statement, 0)));
+
+	if (!keep.contains(path))
+	    gone.append(path);
+    }
+    sqlite3_finalize(statement);
+    if (gone.isEmpty())
+	return true;
+
+    if (!exec("BEGIN IMMEDIATE"))
+	return false;
+    for (QStringList::iterator path = gone.begin(); ok && path != gone.end(); path++)
+    {
+	static const char *drop[] = {
+	    "DELETE FROM photos_where WHERE id IN (SELECT id FROM photos WHERE directory = ?1)",
+	    "DELETE FROM photos WHERE directory = ?1",
+	    "DELETE FROM directories WHERE path = ?1",
+	    NULL
+	};
+
+	for (int i = 0; ok && drop[i] != NULL; i++)
+	{
+	    if ((statement = prepare(drop[i])) == NULL)
+	    {
+		ok = false;
+		break;
+	    }
+	    bind_text(statement, 1, *path);
+	    ok = sqlite3_step(statement) == SQLITE_DONE;
+	    sqlite3_finalize(statement);
+	}
+    }
+    if (ok && exec("COMMIT"))
+	return true;
+    exec("ROLLBACK");
+    return false;
+}
+
+/*
+ * NAME: select
+ * PURPOSE: To collect the photos a query has found
+ * ARGUMENTS: statement: the query, selecting CATALOG_COLUMNS,
+ *	finalized here
+ * RETURNS: the photos
+ */
+QList<CatalogEntry>
+Catalog::select(sqlite3_stmt *statement)
+{
+    QList<CatalogEntry> entries;
+
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+	CatalogEntry entry;
+
+	entry.path = QString::fromUtf8((const char *) sqlite3_column_text(statement, 0)) + "/"
+	    + QString::fromUtf8((const char *) sqlite3_column_text(statement, 1));
+	entry.hasCoordinates = sqlite3_column_type(statement, 2) != SQLITE_NULL;
+	entry.latitude = sqlite3_column_double(statement, 2);
+	entry.longitude = sqlite3_column_double(statement, 3);
+	entry.timestamp = sqlite3_column_int64(statement, 4);
+	entry.orientation = sqlite3_column_int(statement, 5);
+	entry.location = QString::fromUtf8((const char *) sqlite3_column_text(statement, 6));
+	entries.append(entry);
+    }
+    sqlite3_finalize(statement);
+
+    return entries;
+}
+
+/*
+ * NAME: Box
+ * PURPOSE: To find the photos taken within a bounding box
+ * ARGUMENTS: minLon, minLat, maxLon, maxLat: the box, in degrees
+ *	limit: max number of photos, 0 for no limit
+ * RETURNS: the photos, oldest first
+ * NOTE: A box across the 180th meridian has to be asked for in
+ *	two halves.
+ */
+QList<CatalogEntry>
+Catalog::Box(double minLon, double minLat, double maxLon, double maxLat, int limit)
+{
+    QMutexLocker locker(&mutex);
+    sqlite3_stmt *statement;
+
+    if (db == NULL || (statement = prepare(
+	"SELECT " CATALOG_COLUMNS " FROM photos_where w JOIN photos p ON p.id = w.id "
+	"WHERE w.minLat <= ?4 AND w.maxLat >= ?2 AND w.minLon <= ?3 AND w.maxLon >= ?1 "
+	"AND p.latitude BETWEEN ?2 AND ?4 AND p.longitude BETWEEN ?1 AND ?3 "
+	"ORDER BY p.timestamp LIMIT ?5")) == NULL)
+	return QList<CatalogEntry>();
+
+    sqlite3_bind_double(statement, 1, minLon);
+    sqlite3_bind_double(statement, 2, minLat);
+    sqlite3_bind_double(statement, 3, maxLon);
+    sqlite3_bind_double(statement, 4, maxLat);
+    sqlite3_bind_int(statement, 5, limit > 0 ? limit : -1);
+    return select(statement);
+}
+
+/*
+ * NAME: Radius
+ * PURPOSE: To find the photos taken near a place
+ * ARGUMENTS: lon, lat: the place
+ *	meters: how near
+ *	limit: max number of photos, 0 for no limit
+ * RETURNS: the photos, oldest first
+ * NOTE: The R-tree is asked for the box around the circle,
+ *	the corners are dropped afterwards. A box across the 180th
+ *	meridian is asked for in two halves.
+ */
+QList<CatalogEntry>
+Catalog::Radius(double lon, double lat, double meters, int limit)
+{
+    double dlat = meters / METERS_PER_DEGREE, dlon = 180.0;
+    GeoPoint centre = { lon, lat };
+    QList<CatalogEntry> candidates, entries;
+
+    if (fabs(lat) + dlat < 90.0)
+	dlon = qMin(180.0, dlat / cos(lat * M_PI / 180.0));
+    candidates = Box(qMax(-180.0, lon - dlon), qMax(-90.0, lat - dlat), qMin(180.0, lon + dlon), qMin(90.0, lat + dlat));
+    if (dlon < 180.0 && (lon - dlon < -180.0 || lon + dlon > 180.0))
+    {
+	if (lon - dlon < -180.0)
+	    candidates += Box(lon - dlon + 360.0, qMax(-90.0, lat - dlat), 180.0, qMin(90.0, lat + dlat));
+	else
+	    candidates += Box(-180.0, qMax(-90.0, lat - dlat), lon + dlon - 360.0, qMin(90.0, lat + dlat));
+	std::stable_sort(candidates.begin(), candidates.end(),
+	    [](const CatalogEntry &a, const CatalogEntry &b) { return a.timestamp < b.timestamp; });
+    }
+
+    for (QList<CatalogEntry>::iterator c = candidates.begin(); c != candidates.end(); c++)
+    {
+	GeoPoint p = { c->longitude, c->latitude };
+
+	if (haversine(centre, p) <= meters)
+	{
+	    entries.append(*c);
+	    if (limit > 0 && entries.size() >= limit)
+		break;
+	}
+    }
+
+    return entries;
+}
+
+/*
+ * NAME: Between
+ * PURPOSE: To find the photos taken in a period of time
+ * ARGUMENTS: from, to: the period, from inclusive, to exclusive, in
+ *	seconds since the epoch as MetaRecord::timestamp has them
+ *	limit: max number of photos, 0 for no limit
+ * RETURNS: the photos, oldest first
+ */
+QList<CatalogEntry>
+Catalog::Between(qint64 from, qint64 to, int limit)
+{
+    QMutexLocker locker(&mutex);
+    sqlite3_stmt *statement;
+
+    if (db == NULL || (statement = prepare(
+	"SELECT " CATALOG_COLUMNS " FROM photos p "
+	"WHERE p.timestamp != 0 AND p.timestamp >= ?1 AND p.timestamp < ?2 "
+	"ORDER BY p.timestamp LIMIT ?3")) == NULL)
+	return QList<CatalogEntry>();
+
+    sqlite3_bind_int64(statement, 1, from);
+    sqlite3_bind_int64(statement, 2, to);
+    sqlite3_bind_int(statement, 3, limit > 0 ? limit : -1);
+    return select(statement);
+}
+
+/*
+ * NAME: Count
+ * PURPOSE: To find out how many photos the catalog has
+ * ARGUMENTS: None
+ * RETURNS: number of photos
+ */
+quint64
+Catalog::Count()
+{
+    QMutexLocker locker(&mutex);
+    sqlite3_stmt *statement;
+    quint64 count = 0;
+
+    if (db == NULL || (statement = prepare("SELECT COUNT(*) FROM photos")) == NULL)
+	return 0;
+    if (sqlite3_step(statement) == SQLITE_ROW)
+	count = sqlite3_column_int64(statement, 0);
+    sqlite3_finalize(statement);
+
+    return count;
+}
@@ -0,0 +1,53 @@
+# ifndef	CATALOG_H
+# define	CATALOG_H
+
+# include	<sqlite3.h>
+# include	<QString>
+# include	<QStringList>
+# include	<QList>
+# include	<QMap>
+# include	<QMutex>
+# include	"MetaIndex.h"
+
+// A photo found in the catalog
+struct CatalogEntry {
+    QString path;		// absolute
+    bool hasCoordinates;
+    double latitude;
+    double longitude;
+    qint64 timestamp;		// as in MetaRecord, 0 if unknown
+    int orientation;
+    QString location;		// empty if not resolved yet
+};
+
+/*
+ * All photos of all directories ever indexed, in one SQLite database,
+ * so they can be looked up by where and when they were taken without
+ * opening every directory. The coordinates are in an R-tree, the
+ * timestamps in a B-tree. The per-directory files stay the master
+ * copy: the rows of a directory are replaced from its index and its
+ * location map whenever the indexer has changed them.
+ * A Catalog may be used from any thread.
+ */
+class Catalog {
+public:
+    Catalog(QString filename);
+    ~Catalog();
+    bool IsValid() const;
+    bool Known(QString directory, quint32 photos);
+    bool Update(QString directory, const MetaIndex *index, const QMap<QString,QString> &locations);
+    bool Prune(QString top, const QStringList &directories);
+    QList<CatalogEntry> Box(double minLon, double minLat, double maxLon, double maxLat, int limit = 0);
+    QList<CatalogEntry> Radius(double lon, double lat, double meters, int limit = 0);
+    QList<CatalogEntry> Between(qint64 from, qint64 to, int limit = 0);
+    quint64 Count();
+private:
+    Catalog(const Catalog &);
+    Catalog &operator=(const Catalog &);
+    bool exec(const char *sql);
+    sqlite3_stmt *prepare(const char *sql);
+    QList<CatalogEntry> select(sqlite3_stmt *statement);
+    QMutex mutex;		// protects db
+    sqlite3 *db;		// NULL if the database could not be opened
+};
+# endif // CATALOG_H
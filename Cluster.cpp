@@ -0,0 +1,111 @@
+# include	<math.h>
+# include	<QHash>
+# include	"Cluster.h"
+
+/*
+ * NAME: haversine
+ * PURPOSE: To compute the great circle distance of two points
+ * ARGUMENTS: a, b: the points
+ * RETURNS: distance in meters
+ */
+double
+haversine(GeoPoint a, GeoPoint b)
+{
+    double dlat = (b.lat - a.lat) * M_PI / 180.0;
+    double dlon = (b.lon - a.lon) * M_PI / 180.0;
+    double h = sin(dlat / 2) * sin(dlat / 2)
+	+ cos(a.lat * M_PI / 180.0) * cos(b.lat * M_PI / 180.0) * sin(dlon / 2) * sin(dlon / 2);
+
+    return 2 * EARTH_RADIUS * asin(sqrt(qMin(1.0, h)));
+}
+
+/*
+ * Grid cells are cellDegrees high, and as wide as needed for them
+ * to be roughly square at their latitude.
+ */
+static double
+lon_cell_width(int row, double cellDegrees)
+{
+    double lat = qMin(89.0, (fabs((double) row) + 1) * cellDegrees);
+
+    return cellDegrees / cos(lat * M_PI / 180.0);
+}
+
+static quint64
+cell_key(qint64 row, qint64 col)
+{
+    return ((quint64) (quint32) row << 32) | (quint32) col;
+}
+
+/*
+ * NAME: cluster_points
+ * PURPOSE: To group points that are close to each other
+ * ARGUMENTS: points: the points
+ *	radius: max distance of a point to its cluster's representative in meters
+ * RETURNS: for every point the index of its representative
+ *	(a representative is its own representative)
+ * NOTE: The points are visited in order. A point joins the nearest
+ *	representative within the radius, or becomes one itself.
+ *	Representatives are kept in a grid of cells of about radius x radius,
+ *	so only the 3x3 neighbourhood has to be searched.
+ *	The result only depends on the order of the points.
+ */
+QVector<int>
+cluster_points(const QVector<GeoPoint> &points, double radius)
+{
+    QVector<int> representative(points.size());
+    QHash<quint64,QVector<int> > grid;
+    double cellDegrees;
+
+    if (radius <= 0.0)
+    {
+	for (int i = 0; i < points.size(); i++)
+	    representative[i] = i;
+	return representative;
+    }
+
+    cellDegrees = radius / METERS_PER_DEGREE;
+    for (int i = 0; i < points.size(); i++)
+    {
+	const GeoPoint &p = points[i];
+	qint64 row = (qint64) floor(p.lat / cellDegrees);
+	double best = radius;
+	int found = -1;
+
+	for (qint64 r = row - 1; r <= row + 1; r++)
+	{
+	    // The longitude span of the radius, measured in the cells of that row
+	    double width = lon_cell_width(r, cellDegrees);
+	    double span = radius / (METERS_PER_DEGREE * qMax(0.01, cos(p.lat * M_PI / 180.0)));
+	    qint64 first = (qint64) floor((p.lon - span) / width);
+	    qint64 last = (qint64) floor((p.lon + span) / width);
+
+	    for (qint64 c = first; c <= last; c++)
+	    {
+		QHash<quint64,QVector<int> >::const_iterator cell = grid.constFind(cell_key(r, c));
+
+		if (cell == grid.constEnd())
+		    continue;
+		for (QVector<int>::const_iterator rep = cell->begin(); rep != cell->end(); rep++)
+		{
+		    double d = haversine(p, points[*rep]);
+
+		    if (d <= best)
+		    {
+			best = d;
+			found = *rep;
+		    }
+		}
+	    }
+	}
+
+	if (found == -1)
+	{
+	    found = i;
+	    grid[cell_key(row, (qint64) floor(p.lon / lon_cell_width(row, cellDegrees)))].append(i);
+	}
+	representative[i] = found;
+    }
+
+    return representative;
+}
@@ -0,0 +1,16 @@
+# ifndef	CLUSTER_H
+# define	CLUSTER_H
+
+# include	<QVector>
+
+# define	EARTH_RADIUS	6371008.8	// mean radius in meters
+# define	METERS_PER_DEGREE	(EARTH_RADIUS * M_PI / 180.0)
+
+struct GeoPoint {
+    double lon;
+    double lat;
+};
+
+double haversine(GeoPoint a, GeoPoint b);
+QVector<int> cluster_points(const QVector<GeoPoint> &points, double radius);
+# endif // CLUSTER_H
@@ -1,14 +1,24 @@
 # include	<sys/stat.h>
 # include	<sys/types.h>
 # include	<stdio.h>
+# include	<time.h>
 # include	<unistd.h>
 # include	<QFile>
 # include	<QDebug>
 # include	<QDataStream>
 # include	<QString>
+# include	<libexif/exif-utils.h>
 # include	"Exif.h"
+# include	"Stats.h"
 
-static double exif_convert_latlon(char *s);
+static QString exif_format_date(const char *buffer);
+static qint64 exif_parse_date(const char *buffer);
+
+// Names of the orientations as libexif reports them, indexed by the tag value
+static const char *orientationNames[] = {
+    "", "Top-left", "Top-right", "Bottom-right", "Bottom-left",
+    "Left-top", "Right-top", "Right-bottom", "Left-bottom"
+};
 
 /*
  * NAME: Exif
@@ -24,6 +34,7 @@ Exif::Exif(QString pn)
     latitude = 0.0;
     ed = NULL;
     orientation = -1;
+    parsed = -1;
 }
 
 /*
@@ -32,6 +43,7 @@ Exif::Exif(QString pn)
  * AGUMENTS: None
  * RETURNS: Nothing
  * NOTE: All this destructor does is free the exif data
+ *	(the mapping of the fast parser is released by its own destructor)
  */
 Exif::~Exif()
 {
@@ -56,19 +68,44 @@ Exif::~Exif()
 QString
 Exif::Orientation()
 {
-    char buffer[128];
-
     if (orientation == -1)
     { 
-	if (ed == NULL)
-	    if ((ed = load_exif_data()) == NULL)
-	        return 0;
+	if (fast())
+	    orientation = parser.Fields().orientation;
+	else if (parsed == ExifParser::NoExif)
+	    orientation = 0;
+	else
+	{
+	    ExifEntry *entry;
+
+	    if (ed == NULL)
+		if ((ed = load_exif_data()) == NULL)
+		    return 0;
 
-        if (exif_content_get_value(ed->ifd[EXIF_IFD_0], EXIF_TAG_ORIENTATION, buffer, sizeof(buffer)) != NULL)
-	    return QString(buffer);
+	    orientation = 0;
+	    if ((entry = exif_content_get_entry(ed->ifd[EXIF_IFD_0], EXIF_TAG_ORIENTATION)) != NULL
+	     && entry->format == EXIF_FORMAT_SHORT)
+		orientation = exif_get_short(entry->data, exif_data_get_byte_order(ed));
+	}
+	if (orientation < 0 || orientation > 8)
+	    orientation = 0;
     }
 
-    return QString("");
+    return QString(orientationNames[orientation]);
+}
+
+/*
+ * NAME: OrientationCode
+ * PURPOSE: Access method of the image orientation
+ * ARGUMENTS: None, provided through the object
+ * RETURNS: The Exif orientation 1..8 (see Orientation()), 0 if unknown
+ */
+int
+Exif::OrientationCode()
+{
+    Orientation();
+
+    return orientation < 0 ? 0 : orientation;
 }
 
 /*
@@ -84,13 +121,22 @@ Exif::Longitude()
 
     if (longitude == 0.0)
     {
+	if (fast())
+	{
+	    if (parser.Fields().hasLongitude)
+		longitude = parser.Fields().longitude;
+	    return longitude;
+	}
+	if (parsed == ExifParser::NoExif)
+	    return 0.0;
+
 	if (ed == NULL)
 	    if ((ed = load_exif_data()) == NULL)
 	        return 0.0;
 
 	if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LONGITUDE, buffer, sizeof(buffer)) != NULL)
 	{
-	    longitude = exif_convert_latlon(buffer);
+	    longitude = ConvertLatLon(buffer);
 	    if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LONGITUDE_REF, buffer, sizeof(buffer)) == NULL)
 		longitude = 0.0;
 	    else if (buffer[0] == 'W')
@@ -114,13 +160,22 @@ Exif::Latitude()
 
     if (latitude == 0.0)
     {
+	if (fast())
+	{
+	    if (parser.Fields().hasLatitude)
+		latitude = parser.Fields().latitude;
+	    return latitude;
+	}
+	if (parsed == ExifParser::NoExif)
+	    return 0.0;
+
 	if (ed == NULL)
 	    if ((ed = load_exif_data()) == NULL)
 	        return 0.0;
 
 	if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LATITUDE, buffer, sizeof(buffer)) != NULL)
 	{
-	    latitude = exif_convert_latlon(buffer);
+	    latitude = ConvertLatLon(buffer);
 	    if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LATITUDE_REF, buffer, sizeof(buffer)) == NULL)
 		latitude = 0.0;
 	    else if (buffer[0] == 'S')
@@ -141,31 +196,95 @@ QString
 Exif::Date()
 {
     char buffer[128];
-    QString date("");
+
+    if (fast())
+	return exif_format_date(parser.Fields().date);
+    if (parsed == ExifParser::NoExif)
+	return QString("");
 
     if (ed == NULL)
 	if ((ed = load_exif_data()) == NULL)
-	    return date;
+	    return QString("");
+
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_EXIF], (ExifTag) EXIF_TAG_DATE_TIME_ORIGINAL, buffer, sizeof(buffer)) != NULL)
+	return exif_format_date(buffer);
+
+    return QString("");
+}
+
+/*
+ * NAME: Timestamp
+ * PURPOSE: To get an image's "original" date as a number
+ * ARGUMENTS: None, provided through the object
+ * RETURNS: Seconds since the epoch, taking the local date and time
+ *	of the image as UTC, or 0 if unknown
+ */
+qint64
+Exif::Timestamp()
+{
+    char buffer[128];
+
+    if (fast())
+	return exif_parse_date(parser.Fields().date);
+    if (parsed == ExifParser::NoExif)
+	return 0;
+
+    if (ed == NULL)
+	if ((ed = load_exif_data()) == NULL)
+	    return 0;
 
-    // The format is "YYYY:MM:DD HH:MM:SS"
-    // [https://www.awaresystems.be/imaging/tiff/tifftags/privateifd/exif/datetimeoriginal.html]
     if (exif_content_get_value(ed->ifd[EXIF_IFD_EXIF], (ExifTag) EXIF_TAG_DATE_TIME_ORIGINAL, buffer, sizeof(buffer)) != NULL)
+	return exif_parse_date(buffer);
+
+    return 0;
+}
+
+/*
+ * NAME: ThumbnailPosition
+ * PURPOSE: To find where the embedded thumbnail is in the image file
+ * ARGUMENTS: offset: where to store the offset of the thumbnail
+ *	length: where to store the length of the thumbnail
+ * RETURNS: true if the position is known
+ * NOTE: Only the fast parser knows the position
+ */
+bool
+Exif::ThumbnailPosition(unsigned long *offset, unsigned long *length)
+{
+    if (!fast() || parser.Fields().thumbnailLength == 0)
+	return false;
+
+    *offset = parser.Fields().thumbnailOffset;
+    *length = parser.Fields().thumbnailLength;
+    return true;
+}
+
+/*
+ * NAME: Thumbnail
+ * PURPOSE: To get an image's thumbnail
+ * ARGUMENTS: size: where to store the length of the thumbnail
+ * RETURNS: pointer to the thumbnail or NULL if there is none
+ * NOTE: The pointer is only valid as long as this object lives
+ */
+const unsigned char *
+Exif::Thumbnail(size_t *size)
+{
+    const unsigned char *data;
+
+    *size = 0;
+    if (fast())
+	data = parser.Thumbnail(size);
+    else if (parsed == ExifParser::NoExif)
+	return NULL;
+    else
     {
-	// YYYY:MM:DD HH:MM:SS
-	// 0123456789
-        if (buffer[8] != '0')
-	    date.append(buffer[8]);
-	date.append(buffer[9]);
-	date.append('.');
-	if (buffer[5] != '0')
-	    date.append(buffer[5]);
-	date.append(buffer[6]);
-	date.append('.');
-	for (int i = 0; i < 4; i++)
-	    date.append(buffer[i]);
+	if (ed == NULL)
+	    if ((ed = load_exif_data()) == NULL)
+		return NULL;
+	data = ed->data;
+	*size = ed->size;
     }
 
-    return date;
+    return (data != NULL && *size != 0) ? data : NULL;
 }
 
 /*
@@ -173,42 +292,66 @@ Exif::Date()
  * PURPOSE: To save an image's thumbnail
  * ARGUMENTS: directory: Name of directory (eg ".thumbnails")
  *	filename: filename for thumbnail (eg same as image)
- * RETURNS: Nothing
+ * RETURNS: true if the thumbnail exists (now)
  */
-void
+bool
 Exif::SaveThumbnail(QString directory, QString filename)
 {
     QString pathname(directory + "/" + filename);
+    QFile thumbnailFile(pathname);
+    const unsigned char *data;
+    size_t size = 0;
+
+    // Don't even look at the image if the thumbnail was saved before
+    if (thumbnailFile.exists())
+	return true;
 
-    if (ed == NULL)
-        if ((ed = load_exif_data()) == NULL)
-	    return;
-        
     // Save the thumbnail if there is one
-    if (ed->data != NULL && ed->size != 0)
+    if ((data = Thumbnail(&size)) != NULL)
     {
-	QFile thumbnailFile(pathname);
-	const char *dirname = directory.toStdString().c_str();
+	QByteArray dirname(QFile::encodeName(directory));
+
+	if (access(dirname.constData(), W_OK) == -1)
+	{
+	    if (errno == ENOENT)
+		mkdir(dirname.constData(), 0755);
+	    else
+		return false;
+	}
 
-	if (!thumbnailFile.exists())
+	// qDebug() << "Saving thumbnail";
+	if (thumbnailFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
 	{
-	    if (access(dirname, W_OK) == -1)
-	    {
-		if (errno == ENOENT)
-		    mkdir(dirname, 0755);
-		else
-		    return;
-	    }
-
-	    // qDebug() << "Saving thumbnail";
-	    if (thumbnailFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
-	    {
-		QDataStream stream(&thumbnailFile);
-		stream.writeRawData((char *) ed->data, ed->size);
-	    }
-	    // qDebug() << "Done saving";
+	    QDataStream stream(&thumbnailFile);
+	    stream.writeRawData((const char *) data, size);
+	    return true;
 	}
+	// qDebug() << "Done saving";
+    }
+
+    return false;
+}
+
+/*
+ * NAME: fast
+ * PURPOSE: To extract the Exif data with the fast parser
+ * ARGUMENTS: None, provided through the object
+ * RETURNS: true if the fast parser has the fields,
+ *	false if there is no Exif data (parsed == NoExif)
+ *	or libexif has to be used (parsed == Unsupported)
+ * NOTE: The file is parsed only once
+ */
+bool
+Exif::fast()
+{
+    if (parsed == -1)
+    {
+	StatTimer timer(PHASE_EXIF);
+
+	parsed = parser.Parse(QFile::encodeName(pathname).constData());
     }
+
+    return parsed == ExifParser::Ok;
 }
 
 /*
@@ -221,12 +364,13 @@ ExifData *
 Exif::load_exif_data()
 {
     ExifLoader *el;
+    StatTimer timer(PHASE_EXIF);
 
     // Get a new Exif Loader instance
     if ((el = exif_loader_new()) == NULL)
 	return NULL;
 
-    exif_loader_write_file(el, pathname.toStdString().c_str());
+    exif_loader_write_file(el, QFile::encodeName(pathname).constData());
     ed = exif_loader_get_data(el);
     exif_loader_unref(el);	// The loader is no longer needed--free it
 
@@ -235,14 +379,14 @@ Exif::load_exif_data()
 	    
 # include	<string.h>
 /*
- * NAME: exif_convert_latlon
+ * NAME: ConvertLatLon
  * PURPOSE: To convert a longitude or latitude in the form "degrees, minutes, seconds"
- *	into a double
+ *	(as libexif formats it) into a double
  * ARGUMENTS: s: string containing degrees, minutes, seconds
  * RETURNS: double
  */
-static double
-exif_convert_latlon(char *s)
+double
+Exif::ConvertLatLon(const char *s)
 {
     double latlon;
     char *next;
@@ -253,3 +397,56 @@ exif_convert_latlon(char *s)
 
     return latlon;
 }
+
+/*
+ * NAME: exif_format_date
+ * PURPOSE: To convert an Exif date into the format shown to the user
+ * ARGUMENTS: buffer: date in the form "YYYY:MM:DD HH:MM:SS"
+ * RETURNS: String containing day.month.year
+ */
+static QString
+exif_format_date(const char *buffer)
+{
+    QString date("");
+
+    // The format is "YYYY:MM:DD HH:MM:SS"
+    // [https://www.awaresystems.be/imaging/tiff/tifftags/privateifd/exif/datetimeoriginal.html]
+    if (strlen(buffer) < 10)
+	return date;
+
+    // YYYY:MM:DD HH:MM:SS
+    // 0123456789
+    if (buffer[8] != '0')
+	date.append(buffer[8]);
+    date.append(buffer[9]);
+    date.append('.');
+    if (buffer[5] != '0')
+	date.append(buffer[5]);
+    date.append(buffer[6]);
+    date.append('.');
+    for (int i = 0; i < 4; i++)
+	date.append(buffer[i]);
+
+    return date;
+}
+
+/*
+ * NAME: exif_parse_date
+ * PURPOSE: To convert an Exif date into a number
+ * ARGUMENTS: buffer: date in the form "YYYY:MM:DD HH:MM:SS"
+ * RETURNS: Seconds since the epoch (the date taken as UTC) or 0
+ */
+static qint64
+exif_parse_date(const char *buffer)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(buffer, "%d:%d:%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+	       &tm.tm_hour, &tm.tm_min, &tm.tm_sec) < 3 || tm.tm_year < 1900)
+	return 0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+
+    return timegm(&tm);
+}
@@ -2,6 +2,7 @@
 # define	EXIF_H
 # include	<libexif/exif-loader.h>
 # include	<QString>
+# include	"ExifParser.h"
 
 using namespace std;
 
@@ -11,7 +12,10 @@ class Exif {
     double latitude;
     int orientation;
     ExifData *ed;
+    ExifParser parser;
+    int parsed;
     ExifData *load_exif_data(void);
+    bool fast(void);
 public:
     Exif(QString);
     ~Exif();
@@ -19,6 +23,11 @@ public:
     double Latitude();
     QString Date();
     QString Orientation();
-    void SaveThumbnail(QString directory, QString filename);
+    int OrientationCode();
+    qint64 Timestamp();
+    bool ThumbnailPosition(unsigned long *offset, unsigned long *length);
+    const unsigned char *Thumbnail(size_t *size);
+    bool SaveThumbnail(QString directory, QString filename);
+    static double ConvertLatLon(const char *s);
 };
 # endif // EXIF_H
@@ -0,0 +1,378 @@
+# include	<sys/types.h>
+# include	<sys/stat.h>
+# include	<sys/mman.h>
+# include	<fcntl.h>
+# include	<unistd.h>
+# include	<string.h>
+# include	"ExifParser.h"
+# include	"Stats.h"
+
+/*
+ * The IFDs and tags we want to see.
+ * Anything not listed here is skipped without being decoded.
+ */
+enum Ifd { IFD_0, IFD_1, IFD_EXIF, IFD_GPS };
+enum Field {
+    F_ORIENTATION, F_EXIF_IFD, F_GPS_IFD, F_THUMB_OFFSET, F_THUMB_LENGTH,
+    F_DATE, F_LAT_REF, F_LAT, F_LON_REF, F_LON
+};
+
+struct TagSpec {
+    int ifd;
+    unsigned int tag;
+    int field;
+};
+
+static constexpr TagSpec tagTable[] = {
+    { IFD_0,	0x0112, F_ORIENTATION },
+    { IFD_0,	0x8769, F_EXIF_IFD },
+    { IFD_0,	0x8825, F_GPS_IFD },
+    { IFD_1,	0x0201, F_THUMB_OFFSET },
+    { IFD_1,	0x0202, F_THUMB_LENGTH },
+    { IFD_EXIF,	0x9003, F_DATE },
+    { IFD_GPS,	0x0001, F_LAT_REF },
+    { IFD_GPS,	0x0002, F_LAT },
+    { IFD_GPS,	0x0003, F_LON_REF },
+    { IFD_GPS,	0x0004, F_LON },
+};
+
+static constexpr int
+lookup(int ifd, unsigned int tag, size_t i = 0)
+{
+    return i == sizeof(tagTable) / sizeof(tagTable[0]) ? -1
+	: (tagTable[i].ifd == ifd && tagTable[i].tag == tag) ? tagTable[i].field
+	: lookup(ifd, tag, i + 1);
+}
+
+static_assert(lookup(IFD_GPS, 0x0004) == F_LON, "tag table is broken");
+static_assert(lookup(IFD_1, 0x0112) == -1, "tag table is broken");
+
+// Only the leading APPn segments are searched for the Exif segment
+# define	MAX_SEGMENTS	8
+
+/*
+ * NAME: ExifParser
+ * PURPOSE: Constructor of the ExifParser class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+ExifParser::ExifParser()
+{
+    map = NULL;
+    mapLength = 0;
+    memset(&fields, 0, sizeof(fields));
+}
+
+/*
+ * NAME: ~ExifParser
+ * PURPOSE: Destructor of the ExifParser class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: All this destructor does is unmap the APP1 segment
+ */
+ExifParser::~ExifParser()
+{
+    release();
+}
+
+/*
+ * NAME: release
+ * PURPOSE: To unmap the APP1 segment of the previously parsed file
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+ExifParser::release()
+{
+    if (map != NULL)
+	munmap(map, mapLength);
+    map = NULL;
+    mapLength = 0;
+}
+
+/*
+ * NAME: Fields
+ * PURPOSE: Access method of the extracted fields
+ * ARGUMENTS: None
+ * RETURNS: the fields found by the last successful Parse()
+ */
+const ExifFields &
+ExifParser::Fields() const
+{
+    return fields;
+}
+
+/*
+ * NAME: Thumbnail
+ * PURPOSE: Access method of the embedded thumbnail
+ * ARGUMENTS: length: where to store the length of the thumbnail
+ * RETURNS: pointer to the thumbnail inside the mapped segment or NULL
+ * NOTE: The pointer is only valid as long as this object lives
+ */
+const unsigned char *
+ExifParser::Thumbnail(size_t *length) const
+{
+    if (map == NULL || fields.thumbnailLength == 0)
+	return NULL;
+
+    *length = fields.thumbnailLength;
+    return map + fields.thumbnailOffset;
+}
+
+/*
+ * NAME: Parse
+ * PURPOSE: To extract the interesting fields of an image's Exif data
+ * ARGUMENTS: pathname: pathname of the image file
+ * RETURNS: Ok, NoExif or Unsupported
+ * NOTE: Files without an Exif segment are rejected after reading
+ *	the first few bytes: the Exif APP1 comes before the image
+ *	data, only APPn and COM segments are skipped to find it.
+ *	Only the segments up to and including APP1 are mapped.
+ */
+ExifParser::Status
+ExifParser::Parse(const char *pathname)
+{
+    unsigned char header[10];
+    struct stat st;
+    off_t pos;
+    size_t segmentLength = 0;
+    int fd, segment;
+    void *m;
+
+    release();
+    memset(&fields, 0, sizeof(fields));
+
+    if ((fd = open(pathname, O_RDONLY)) == -1)
+	return NoExif;
+
+    // SOI
+    if (pread(fd, header, 2, 0) != 2 || header[0] != 0xFF || header[1] != 0xD8)
+    {
+	close(fd);
+	return NoExif;
+    }
+
+    // Skip over APP0 (JFIF), COM etc. until we find "Exif\0\0" in an APP1
+    pos = 2;
+    for (segment = 0; segment < MAX_SEGMENTS; segment++)
+    {
+	if (pread(fd, header, sizeof(header), pos) != sizeof(header)
+	 || header[0] != 0xFF || ((header[1] < 0xE0 || header[1] > 0xEF) && header[1] != 0xFE))
+	{
+	    close(fd);
+	    return NoExif;
+	}
+	segmentLength = (header[2] << 8) | header[3];
+	if (header[1] == 0xE1 && memcmp(header + 4, "Exif\0\0", 6) == 0)
+	    break;
+	pos += 2 + segmentLength;
+    }
+    if (segment == MAX_SEGMENTS || segmentLength < 8 + 8)
+    {
+	close(fd);
+	return segment == MAX_SEGMENTS ? NoExif : Unsupported;
+    }
+
+    // Do not map beyond the end of a truncated file
+    mapLength = pos + 2 + segmentLength;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < mapLength)
+    {
+	close(fd);
+	mapLength = 0;
+	return Unsupported;
+    }
+
+    m = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+    {
+	mapLength = 0;
+	return Unsupported;
+    }
+    map = (unsigned char *) m;
+    Stats::Count(STAT_EXIF_BYTES, mapLength);
+
+    // The TIFF header follows the "Exif\0\0"
+    if (!walk(pos + 10, segmentLength - 8))
+    {
+	release();
+	return Unsupported;
+    }
+
+    return Ok;
+}
+
+/*
+ * NAME: walk
+ * PURPOSE: To walk the TIFF structure in the mapped APP1 segment
+ * ARGUMENTS: tiff: offset of the TIFF header in the mapping
+ *	length: length of the TIFF structure
+ * RETURNS: true if the structure could be walked, false if it is corrupt
+ */
+bool
+ExifParser::walk(size_t tiff, size_t length)
+{
+    const unsigned char *t = map + tiff;
+    bool motorola;
+    char latRef = 0, lonRef = 0;
+    double lat = 0.0, lon = 0.0;
+    bool haveLat = false, haveLon = false;
+    unsigned long thumbOffset = 0, thumbLength = 0;
+    // IFDs still to visit: offset and kind
+    unsigned long pending[4];
+    int pendingIfd[4];
+    int npending = 0;
+
+    if (length < 8)
+	return false;
+    if (t[0] == 'M' && t[1] == 'M')
+	motorola = true;
+    else if (t[0] == 'I' && t[1] == 'I')
+	motorola = false;
+    else
+	return false;
+
+    auto get16 = [&](size_t o) -> unsigned int {
+	return motorola ? (t[o] << 8) | t[o+1] : (t[o+1] << 8) | t[o];
+    };
+    auto get32 = [&](size_t o) -> unsigned long {
+	return motorola
+	    ? ((unsigned long) t[o] << 24) | (t[o+1] << 16) | (t[o+2] << 8) | t[o+3]
+	    : ((unsigned long) t[o+3] << 24) | (t[o+2] << 16) | (t[o+1] << 8) | t[o];
+    };
+    // degrees, minutes, seconds as three RATIONALs
+    auto getLatLon = [&](size_t o) -> double {
+	double v = 0.0, scale = 1.0;
+	for (int i = 0; i < 3; i++, o += 8, scale *= 60.0)
+	{
+	    unsigned long num = get32(o), den = get32(o + 4);
+	    if (den != 0)
+		v += (double) num / den / scale;
+	}
+	return v;
+    };
+
+    if (get16(2) != 42)
+	return false;
+
+    pending[npending] = get32(4);
+    pendingIfd[npending++] = IFD_0;
+
+    while (npending > 0)
+    {
+	unsigned long ifd = pending[--npending];
+	int kind = pendingIfd[npending];
+	unsigned int entries;
+
+	if (ifd < 8 || ifd + 2 > length)
+	    continue;
+	entries = get16(ifd);
+	if (ifd + 2 + entries * 12 + 4 > length)
+	    return false;
+
+	for (unsigned int i = 0; i < entries; i++)
+	{
+	    size_t e = ifd + 2 + i * 12;
+	    int field = lookup(kind, get16(e));
+	    unsigned int type = get16(e + 2);
+	    unsigned long count = get32(e + 4);
+	    size_t size, value;
+
+	    if (field == -1)
+		continue;
+
+	    switch (type)
+	    {
+	    case 1: case 2: case 7: size = 1; break;	// BYTE, ASCII, UNDEFINED
+	    case 3: size = 2; break;			// SHORT
+	    case 4: case 9: size = 4; break;		// LONG, SLONG
+	    case 5: case 10: size = 8; break;		// RATIONAL, SRATIONAL
+	    default: continue;
+	    }
+	    if (count > length || count * size > length)
+		continue;
+	    value = (count * size <= 4) ? e + 8 : get32(e + 8);
+	    if (value + count * size > length)
+		continue;
+
+	    switch (field)
+	    {
+	    case F_ORIENTATION:
+		if (type == 3)
+		    fields.orientation = get16(value);
+		break;
+	    case F_EXIF_IFD:
+	    case F_GPS_IFD:
+		if (type == 4 && npending < 4)
+		{
+		    pending[npending] = get32(value);
+		    pendingIfd[npending++] = field == F_EXIF_IFD ? IFD_EXIF : IFD_GPS;
+		}
+		break;
+	    case F_THUMB_OFFSET:
+		if (type == 4)
+		    thumbOffset = get32(value);
+		break;
+	    case F_THUMB_LENGTH:
+		if (type == 4)
+		    thumbLength = get32(value);
+		break;
+	    case F_DATE:
+		if (type == 2 && count >= 19)
+		{
+		    memcpy(fields.date, t + value, 19);
+		    fields.date[19] = '\0';
+		}
+		break;
+	    case F_LAT_REF:
+		if (type == 2)
+		    latRef = t[value];
+		break;
+	    case F_LON_REF:
+		if (type == 2)
+		    lonRef = t[value];
+		break;
+	    case F_LAT:
+		if (type == 5 && count == 3)
+		{
+		    lat = getLatLon(value);
+		    haveLat = true;
+		}
+		break;
+	    case F_LON:
+		if (type == 5 && count == 3)
+		{
+		    lon = getLatLon(value);
+		    haveLon = true;
+		}
+		break;
+	    }
+	}
+
+	// IFD0 is followed by IFD1, which holds the thumbnail
+	if (kind == IFD_0 && npending < 4)
+	{
+	    pending[npending] = get32(ifd + 2 + entries * 12);
+	    pendingIfd[npending++] = IFD_1;
+	}
+    }
+
+    // A coordinate without its reference is of no use
+    if (haveLat && latRef != 0)
+    {
+	fields.hasLatitude = true;
+	fields.latitude = latRef == 'S' ? -lat : lat;
+    }
+    if (haveLon && lonRef != 0)
+    {
+	fields.hasLongitude = true;
+	fields.longitude = lonRef == 'W' ? -lon : lon;
+    }
+    if (thumbLength != 0 && thumbOffset + thumbLength <= length && thumbOffset + thumbLength > thumbOffset)
+    {
+	fields.thumbnailOffset = tiff + thumbOffset;
+	fields.thumbnailLength = thumbLength;
+    }
+
+    return true;
+}
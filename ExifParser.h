@@ -0,0 +1,45 @@
+# ifndef	EXIFPARSER_H
+# define	EXIFPARSER_H
+# include	<stddef.h>
+
+/*
+ * The few Exif fields fpv is interested in.
+ * Everything lives inside the object, nothing is allocated.
+ */
+struct ExifFields {
+    int orientation;			// 1..8, 0 if not present
+    bool hasLatitude;
+    bool hasLongitude;
+    double latitude;			// negative for south
+    double longitude;			// negative for west
+    char date[20];			// DateTimeOriginal "YYYY:MM:DD HH:MM:SS" or ""
+    unsigned long thumbnailOffset;	// offset of the thumbnail in the file
+    unsigned long thumbnailLength;	// 0 if there is no thumbnail
+};
+
+/*
+ * A specialised Exif reader: it memory-maps the leading APP1 segment
+ * of a JPEG file and walks the TIFF IFDs in place.
+ */
+class ExifParser {
+public:
+    enum Status {
+	Ok,		// the fields have been extracted
+	NoExif,		// the file definitely has no Exif data
+	Unsupported	// something we cannot handle, use a full decoder
+    };
+    ExifParser();
+    ~ExifParser();
+    Status Parse(const char *pathname);
+    const ExifFields &Fields() const;
+    const unsigned char *Thumbnail(size_t *length) const;
+private:
+    ExifParser(const ExifParser &);
+    ExifParser &operator=(const ExifParser &);
+    void release();
+    bool walk(size_t tiff, size_t length);
+    unsigned char *map;
+    size_t mapLength;
+    ExifFields fields;
+};
+# endif // EXIFPARSER_H
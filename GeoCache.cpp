@@ -0,0 +1,179 @@
+# include	<QTextStream>
+# include	<QFileInfo>
+# include	<QDir>
+# include	<QMutexLocker>
+# include	"GeoCache.h"
+# include	"Stats.h"
+
+/*
+ * NAME: GeoCache
+ * PURPOSE: Constructor of the GeoCache class
+ * ARGUMENTS: filename: pathname of the cache file
+ *	precision: number of geohash characters that make a cell
+ *		(8 is about 38m x 19m, 7 is about 150m x 150m)
+ * RETURNS: Nothing
+ * NOTE: The file holds one "geohash<TAB>location" line per lookup.
+ *	The full geohash is stored, so the precision can be changed
+ *	without throwing the cache away.
+ */
+GeoCache::GeoCache(QString filename, int new_precision)
+    : file(filename)
+{
+    precision = qBound(1, new_precision, GEOHASH_MAX_PRECISION);
+    hits = 0;
+    misses = 0;
+
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+	QTextStream in(&file);
+	in.setCodec("UTF-8");
+	while (!in.atEnd())
+	{
+	    QString line = in.readLine();
+	    int tab = line.indexOf('\t');
+
+	    if (tab < precision)
+	        continue;
+	    cache.insert(line.left(precision), line.mid(tab + 1));
+	}
+	file.close();
+    }
+
+    QDir().mkpath(QFileInfo(file).absolutePath());
+    file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
+
+/*
+ * NAME: ~GeoCache
+ * PURPOSE: Destructor of the GeoCache class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+GeoCache::~GeoCache()
+{
+}
+
+/*
+ * NAME: Lookup
+ * PURPOSE: To look up a location in the cache
+ * ARGUMENTS: lon, lat: the coordinates
+ *	location: where to store the location
+ * RETURNS: true if the cell of the coordinates is known
+ */
+bool
+GeoCache::Lookup(double lon, double lat, QString *location)
+{
+    QString key(Geohash(lon, lat, precision));
+    QMutexLocker locker(&mutex);
+    QHash<QString,QString>::const_iterator entry = cache.constFind(key);
+
+    if (entry == cache.constEnd())
+    {
+	misses++;
+	Stats::Count(STAT_GEOCACHE_MISSES);
+	return false;
+    }
+
+    hits++;
+    Stats::Count(STAT_GEOCACHE_HITS);
+    *location = entry.value();
+    return true;
+}
+
+/*
+ * NAME: Insert
+ * PURPOSE: To add a resolved location to the cache
+ * ARGUMENTS: lon, lat: the coordinates
+ *	location: what they were resolved to
+ * RETURNS: Nothing
+ * NOTE: The entry is appended to the cache file right away
+ */
+void
+GeoCache::Insert(double lon, double lat, QString location)
+{
+    QString key(Geohash(lon, lat, GEOHASH_MAX_PRECISION));
+    QMutexLocker locker(&mutex);
+
+    // Tabs and newlines would break the file, a location has none anyway
+    location.replace(QRegExp("[\t\r\n]"), " ");
+    cache.insert(key.left(precision), location);
+    if (file.isOpen())
+    {
+	file.write((key + "\t" + location + "\n").toUtf8());
+	file.flush();
+    }
+}
+
+/*
+ * NAME: Hits
+ * PURPOSE: Access method of the number of cache hits
+ * ARGUMENTS: None
+ * RETURNS: number of successful lookups
+ */
+unsigned long
+GeoCache::Hits()
+{
+    QMutexLocker locker(&mutex);
+
+    return hits;
+}
+
+/*
+ * NAME: Misses
+ * PURPOSE: Access method of the number of cache misses
+ * ARGUMENTS: None
+ * RETURNS: number of failed lookups
+ */
+unsigned long
+GeoCache::Misses()
+{
+    QMutexLocker locker(&mutex);
+
+    return misses;
+}
+
+/*
+ * NAME: Geohash
+ * PURPOSE: To compute the geohash of a pair of coordinates
+ * ARGUMENTS: lon, lat: the coordinates
+ *	precision: number of characters wanted
+ * RETURNS: the geohash, eg "u0w7uv1s" for 9.0/48.5
+ * NOTE: See https://en.wikipedia.org/wiki/Geohash
+ */
+QString
+GeoCache::Geohash(double lon, double lat, int precision)
+{
+    static const char base32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+    double lonRange[2] = { -180.0, 180.0 }, latRange[2] = { -90.0, 90.0 };
+    char hash[GEOHASH_MAX_PRECISION + 1];
+    bool even = true;		// bits alternate, starting with the longitude
+    int bit = 0, ch = 0, n = 0;
+
+    precision = qBound(1, precision, GEOHASH_MAX_PRECISION);
+    while (n < precision)
+    {
+	double *range = even ? lonRange : latRange;
+	double value = even ? lon : lat;
+	double mid = (range[0] + range[1]) / 2;
+
+	ch <<= 1;
+	if (value >= mid)
+	{
+	    ch |= 1;
+	    range[0] = mid;
+	}
+	else
+	    range[1] = mid;
+	even = !even;
+
+	if (++bit == 5)
+	{
+	    hash[n++] = base32[ch];
+	    bit = 0;
+	    ch = 0;
+	}
+    }
+    hash[n] = '\0';
+
+    return QString(hash);
+}
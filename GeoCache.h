@@ -0,0 +1,32 @@
+# ifndef	GEOCACHE_H
+# define	GEOCACHE_H
+
+# include	<QString>
+# include	<QHash>
+# include	<QMutex>
+# include	<QFile>
+
+/*
+ * A persistent reverse-geocoding cache, shared by all directories.
+ * Locations are keyed by the geohash cell of their coordinates.
+ */
+class GeoCache {
+public:
+    GeoCache(QString filename, int precision);
+    ~GeoCache();
+    bool Lookup(double lon, double lat, QString *location);
+    void Insert(double lon, double lat, QString location);
+    unsigned long Hits();
+    unsigned long Misses();
+    static QString Geohash(double lon, double lat, int precision);
+private:
+    int precision;
+    QHash<QString,QString> cache;
+    QFile file;
+    QMutex mutex;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+# define	GEOHASH_MAX_PRECISION	12
+# endif // GEOCACHE_H
@@ -0,0 +1,387 @@
+# include	<sys/types.h>
+# include	<sys/stat.h>
+# include	<sys/mman.h>
+# include	<fcntl.h>
+# include	<unistd.h>
+# include	<string.h>
+# include	<math.h>
+# include	<algorithm>
+# include	<QFile>
+# include	<QFileInfo>
+# include	<QSaveFile>
+# include	<QTextStream>
+# include	<QVector>
+# include	"GeoDB.h"
+# include	"Cluster.h"
+
+/*
+ * Layout of the database file:
+ *	GeoHeader
+ *	GeoRecord[placeCount], k-d tree of the places
+ *	GeoRecord[roadCount], k-d tree of the streets
+ *	string table holding names and countries
+ */
+struct GeoHeader {
+    char magic[8];
+    quint32 version;
+    quint32 recordSize;
+    quint32 placeCount;
+    quint32 roadCount;
+    quint32 stringsLength;
+    quint32 pad;
+};
+
+static const char geoMagic[8] = { 'F', 'P', 'V', 'G', 'E', 'O', 'D', 'B' };
+# define	GEO_VERSION	1
+
+static_assert(sizeof(GeoRecord) == 24, "records must not contain padding");
+static_assert(sizeof(GeoHeader) % 8 == 0, "records must stay aligned");
+
+// Names of the kinds, as used in Resolver's pattern[]
+static const char *kindNames[] = { "city", "town", "village", "road" };
+
+/*
+ * NAME: GeoDB
+ * PURPOSE: Constructor of the GeoDB class
+ * ARGUMENTS: filename: pathname of a database built by Build()
+ * RETURNS: Nothing
+ * NOTE: The database is memory-mapped, see IsValid()
+ */
+GeoDB::GeoDB(QString filename)
+{
+    struct stat st;
+    int fd;
+
+    map = NULL;
+    mapLength = 0;
+    places = roads = NULL;
+    placeCount = roadCount = 0;
+    strings = NULL;
+    stringsLength = 0;
+
+    if ((fd = open(QFile::encodeName(filename).constData(), O_RDONLY)) == -1)
+	return;
+
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(GeoHeader))
+    {
+	close(fd);
+	return;
+    }
+
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+	return;
+    map = (unsigned char *) m;
+    mapLength = st.st_size;
+
+    const GeoHeader *header = (const GeoHeader *) map;
+    if (memcmp(header->magic, geoMagic, sizeof(geoMagic)) != 0
+     || header->version != GEO_VERSION
+     || header->recordSize != sizeof(GeoRecord)
+     || sizeof(GeoHeader) + ((quint64) header->placeCount + header->roadCount) * sizeof(GeoRecord)
+	    + header->stringsLength != mapLength)
+    {
+	munmap(map, mapLength);
+	map = NULL;
+	mapLength = 0;
+	return;
+    }
+
+    placeCount = header->placeCount;
+    roadCount = header->roadCount;
+    places = (const GeoRecord *) (map + sizeof(GeoHeader));
+    roads = places + placeCount;
+    strings = (const char *) (roads + roadCount);
+    stringsLength = header->stringsLength;
+}
+
+/*
+ * NAME: ~GeoDB
+ * PURPOSE: Destructor of the GeoDB class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+GeoDB::~GeoDB()
+{
+    if (map != NULL)
+	munmap(map, mapLength);
+}
+
+/*
+ * NAME: IsValid
+ * PURPOSE: To check if the database could be loaded
+ * ARGUMENTS: None
+ * RETURNS: true if the database is usable
+ */
+bool
+GeoDB::IsValid() const
+{
+    return map != NULL && placeCount > 0;
+}
+
+/*
+ * NAME: string
+ * PURPOSE: To fetch a string from the string table
+ * ARGUMENTS: offset, length: where the string is
+ * RETURNS: the string
+ */
+QString
+GeoDB::string(quint32 offset, quint16 length) const
+{
+    if ((quint64) offset + length > stringsLength)
+	return QString("");
+
+    return QString::fromUtf8(strings + offset, length);
+}
+
+/*
+ * State of a nearest neighbour search.
+ * Distances are measured in degrees of latitude, with the longitude
+ * scaled by the cosine of the latitude of the query point.
+ */
+struct GeoSearch {
+    double lon;
+    double lat;
+    double scale;
+    const GeoRecord *best;
+    double bestDistance;
+};
+
+/*
+ * NAME: kd_search
+ * PURPOSE: To search a k-d tree for the nearest neighbour
+ * ARGUMENTS: tree: the records
+ *	low, high: the range of records making up this subtree
+ *	depth: depth of the subtree, even levels split by longitude
+ *	s: search state
+ * RETURNS: Nothing
+ */
+static void
+kd_search(const GeoRecord *tree, quint32 low, quint32 high, int depth, GeoSearch *s)
+{
+    if (low >= high)
+	return;
+
+    quint32 mid = low + (high - low) / 2;
+    const GeoRecord *node = &tree[mid];
+    double dx = (s->lon - node->lon) * s->scale;
+    double dy = s->lat - node->lat;
+    double d = dx * dx + dy * dy;
+    double diff = (depth % 2 == 0) ? dx : dy;
+
+    if (d < s->bestDistance)
+    {
+	s->best = node;
+	s->bestDistance = d;
+    }
+
+    // Descend into the side of the query point first, the other one only if needed
+    if (diff < 0)
+    {
+	kd_search(tree, low, mid, depth + 1, s);
+	if (diff * diff < s->bestDistance)
+	    kd_search(tree, mid + 1, high, depth + 1, s);
+    }
+    else
+    {
+	kd_search(tree, mid + 1, high, depth + 1, s);
+	if (diff * diff < s->bestDistance)
+	    kd_search(tree, low, mid, depth + 1, s);
+    }
+}
+
+/*
+ * NAME: nearest
+ * PURPOSE: To find the record nearest to a point
+ * ARGUMENTS: tree, count: the k-d tree
+ *	lon, lat: the point
+ * RETURNS: the nearest record or NULL if the tree is empty
+ */
+const GeoRecord *
+GeoDB::nearest(const GeoRecord *tree, quint32 count, double lon, double lat) const
+{
+    GeoSearch s;
+
+    s.lon = lon;
+    s.lat = lat;
+    s.scale = qMax(0.01, cos(lat * M_PI / 180.0));
+    s.best = NULL;
+    s.bestDistance = HUGE_VAL;
+    kd_search(tree, 0, count, 0, &s);
+
+    return s.best;
+}
+
+/*
+ * NAME: Lookup
+ * PURPOSE: To reverse geocode a location offline
+ * ARGUMENTS: lon: the location's longitude
+ *	lat: the location's latitude
+ *	fields: where to store the address fields
+ *		(city/town/village, road, country)
+ * RETURNS: true if a place was found
+ */
+bool
+GeoDB::Lookup(double lon, double lat, QHash<QString,QString> *fields) const
+{
+    const GeoRecord *place, *road;
+
+    if ((place = nearest(places, placeCount, lon, lat)) == NULL)
+	return false;
+
+    fields->insert(kindNames[place->kind], string(place->nameOffset, place->nameLength));
+    fields->insert("country", string(place->countryOffset, place->countryLength));
+
+    if ((road = nearest(roads, roadCount, lon, lat)) != NULL)
+    {
+	GeoPoint p = { lon, lat }, r = { road->lon, road->lat };
+
+	if (haversine(p, r) <= GEO_ROAD_DISTANCE)
+	    fields->insert("road", string(road->nameOffset, road->nameLength));
+    }
+
+    return true;
+}
+
+/*
+ * NAME: kd_build
+ * PURPOSE: To arrange records as an implicit k-d tree
+ * ARGUMENTS: begin, end: the range of records
+ *	depth: depth of the subtree, even levels split by longitude
+ * RETURNS: Nothing
+ */
+static void
+kd_build(GeoRecord *begin, GeoRecord *end, int depth)
+{
+    if (end - begin <= 1)
+	return;
+
+    GeoRecord *mid = begin + (end - begin) / 2;
+    if (depth % 2 == 0)
+	std::nth_element(begin, mid, end, [](const GeoRecord &a, const GeoRecord &b) { return a.lon < b.lon; });
+    else
+	std::nth_element(begin, mid, end, [](const GeoRecord &a, const GeoRecord &b) { return a.lat < b.lat; });
+    kd_build(begin, mid, depth + 1);
+    kd_build(mid + 1, end, depth + 1);
+}
+
+/*
+ * NAME: Build
+ * PURPOSE: To compile GeoNames-style TSV files into a database
+ * ARGUMENTS: inputs: the TSV files
+ *	filename: pathname of the database
+ * RETURNS: true on success
+ * NOTE: Feature lines have the GeoNames layout (name in column 2,
+ *	latitude and longitude in 5 and 6, feature class in 7,
+ *	country code in 9, population in 15). Class P are places,
+ *	class R are streets. A file called countryInfo*.txt maps
+ *	the country codes to names.
+ */
+bool
+GeoDB::Build(QStringList inputs, QString filename)
+{
+    QHash<QString,QString> countryNames;
+    QHash<QByteArray,quint32> stringIndex;
+    QByteArray stringTable;
+    QVector<GeoRecord> placeList, roadList;
+
+    // Strings are stored only once
+    auto intern = [&](const QString &s, quint32 *offset, quint16 *length) {
+	QByteArray utf8(s.toUtf8().left(0xFFFF));
+	QHash<QByteArray,quint32>::const_iterator known = stringIndex.constFind(utf8);
+
+	if (known == stringIndex.constEnd())
+	{
+	    known = stringIndex.insert(utf8, stringTable.length());
+	    stringTable += utf8;
+	}
+	*offset = known.value();
+	*length = utf8.length();
+    };
+
+    for (QStringList::iterator input = inputs.begin(); input != inputs.end(); input++)
+    {
+	QFile file(*input);
+
+	if (!QFileInfo(file).fileName().startsWith("countryInfo"))
+	    continue;
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	    return false;
+
+	QTextStream in(&file);
+	in.setCodec("UTF-8");
+	while (!in.atEnd())
+	{
+	    QStringList columns(in.readLine().split('\t'));
+
+	    if (columns.length() > 4 && !columns[0].startsWith('#'))
+		countryNames.insert(columns[0], columns[4]);
+	}
+    }
+
+    for (QStringList::iterator input = inputs.begin(); input != inputs.end(); input++)
+    {
+	QFile file(*input);
+
+	if (QFileInfo(file).fileName().startsWith("countryInfo"))
+	    continue;
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	    return false;
+
+	QTextStream in(&file);
+	in.setCodec("UTF-8");
+	while (!in.atEnd())
+	{
+	    QStringList columns(in.readLine().split('\t'));
+	    GeoRecord r;
+
+	    if (columns.length() < 15)
+		continue;
+
+	    memset(&r, 0, sizeof(r));
+	    if (columns[6] == "P")
+	    {
+		qint64 population = columns[14].toLongLong();
+
+		r.kind = population >= 100000 ? GEO_CITY : population >= 10000 ? GEO_TOWN : GEO_VILLAGE;
+	    }
+	    else if (columns[6] == "R")
+		r.kind = GEO_ROAD;
+	    else
+		continue;
+
+	    r.lat = columns[4].toFloat();
+	    r.lon = columns[5].toFloat();
+	    intern(columns[1], &r.nameOffset, &r.nameLength);
+	    intern(countryNames.value(columns[8], columns[8]), &r.countryOffset, &r.countryLength);
+	    if (r.kind == GEO_ROAD)
+		roadList.append(r);
+	    else
+		placeList.append(r);
+	}
+    }
+
+    kd_build(placeList.begin(), placeList.end(), 0);
+    kd_build(roadList.begin(), roadList.end(), 0);
+
+    QSaveFile file(filename);
+    GeoHeader header;
+
+    if (!file.open(QIODevice::WriteOnly))
+	return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, geoMagic, sizeof(geoMagic));
+    header.version = GEO_VERSION;
+    header.recordSize = sizeof(GeoRecord);
+    header.placeCount = placeList.size();
+    header.roadCount = roadList.size();
+    header.stringsLength = stringTable.length();
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) placeList.constData(), placeList.size() * sizeof(GeoRecord));
+    file.write((const char *) roadList.constData(), roadList.size() * sizeof(GeoRecord));
+    file.write(stringTable);
+
+    return file.commit();
+}
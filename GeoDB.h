@@ -0,0 +1,58 @@
+# ifndef	GEODB_H
+# define	GEODB_H
+
+# include	<QString>
+# include	<QStringList>
+# include	<QHash>
+
+/*
+ * One place or street in the offline geocoding database.
+ * Places and streets are each stored as an implicit k-d tree:
+ * the node of a range of records is the one in its middle.
+ */
+struct GeoRecord {
+    float lat;
+    float lon;
+    quint32 nameOffset;		// into the string table, UTF-8
+    quint32 countryOffset;
+    quint16 nameLength;
+    quint16 countryLength;
+    quint8 kind;		// see below
+    quint8 pad[3];
+};
+
+// Values of GeoRecord::kind, the names are those used in Resolver's pattern[]
+# define	GEO_CITY	0
+# define	GEO_TOWN	1
+# define	GEO_VILLAGE	2
+# define	GEO_ROAD	3
+
+/*
+ * An offline reverse geocoder, answering from a memory-mapped database
+ * compiled from GeoNames-style TSV files.
+ */
+class GeoDB {
+public:
+    GeoDB(QString filename);
+    ~GeoDB();
+    bool IsValid() const;
+    bool Lookup(double lon, double lat, QHash<QString,QString> *fields) const;
+    static bool Build(QStringList inputs, QString filename);
+private:
+    GeoDB(const GeoDB &);
+    GeoDB &operator=(const GeoDB &);
+    const GeoRecord *nearest(const GeoRecord *tree, quint32 count, double lon, double lat) const;
+    QString string(quint32 offset, quint16 length) const;
+    unsigned char *map;
+    size_t mapLength;
+    const GeoRecord *places;
+    quint32 placeCount;
+    const GeoRecord *roads;
+    quint32 roadCount;
+    const char *strings;
+    quint32 stringsLength;
+};
+
+// Streets farther away than this are not reported
+# define	GEO_ROAD_DISTANCE	100.0	// meters
+# endif // GEODB_H
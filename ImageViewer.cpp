@@ -0,0 +1,293 @@
+# include	<QApplication>
+# include	<QDesktopWidget>
+# include	<QImageReader>
+# include	<QImageIOHandler>
+# include	<QKeyEvent>
+# include	<QVBoxLayout>
+# include	"ImageViewer.h"
+
+/*
+ * NAME: ImageViewer
+ * PURPOSE: Constructor of the ImageViewer class
+ * ARGUMENTS: parent: parent widget
+ * RETURNS: Nothing
+ * NOTE: Two threads decode, one for the image to be shown and one
+ *	for the next one.
+ */
+ImageViewer::ImageViewer(QWidget *parent)
+    : QDialog(parent), scheduler(2)
+{
+    QVBoxLayout *layout = new QVBoxLayout;
+
+    current = -1;
+    label = new QLabel;
+    label->setAlignment(Qt::AlignCenter);
+    label->setMinimumSize(1, 1);
+    label->setStyleSheet("background-color: black; color: white");
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(label);
+    setLayout(layout);
+    resize(QApplication::desktop()->availableGeometry(parent).size() * 3 / 4);
+}
+
+/*
+ * NAME: ~ImageViewer
+ * PURPOSE: Destructor of the ImageViewer class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Decodes that have not started yet are dropped,
+ *	the running ones are waited for by the scheduler.
+ */
+ImageViewer::~ImageViewer()
+{
+    scheduler.CancelAll();
+}
+
+/*
+ * NAME: Show
+ * PURPOSE: To show a photo, and flip through the others from there
+ * ARGUMENTS: new_directory: the directory the names are relative to
+ *	new_names: the photos, in the order they are flipped through
+ *	new_current: index of the one to show first
+ * RETURNS: Nothing
+ */
+void
+ImageViewer::Show(QString new_directory, QStringList new_names, int new_current)
+{
+    if (new_directory != directory || new_names != names)
+    {
+	scheduler.CancelAll();
+	images.clear();
+	pending.clear();
+    }
+    directory = new_directory;
+    names = new_names;
+
+    // The whole screen is the most the image can take up
+    size = QApplication::desktop()->screenGeometry(this).size();
+
+    show();
+    raise();
+    activateWindow();
+    go(new_current);
+}
+
+/*
+ * NAME: next
+ * PURPOSE: To show the next photo
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+ImageViewer::next()
+{
+    if (current + 1 < names.length())
+	go(current + 1);
+}
+
+/*
+ * NAME: previous
+ * PURPOSE: To show the previous photo
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+ImageViewer::previous()
+{
+    if (current > 0)
+	go(current - 1);
+}
+
+/*
+ * NAME: go
+ * PURPOSE: To make a photo the current one
+ * ARGUMENTS: i: its index
+ * RETURNS: Nothing
+ * NOTE: The photo is queued first, then its neighbours, nearest
+ *	first. Decoded images further away are dropped, and so are
+ *	decodes that have not started yet.
+ */
+void
+ImageViewer::go(int i)
+{
+    QSet<QString> keep;
+
+    if (i < 0 || i >= names.length())
+	return;
+    current = i;
+
+    for (int distance = 0; distance <= VIEWER_PREFETCH; distance++)
+    {
+	int neighbours[2] = { current + distance, current - distance };
+
+	for (int n = 0; n < (distance == 0 ? 1 : 2); n++)
+	{
+	    if (neighbours[n] < 0 || neighbours[n] >= names.length())
+		continue;
+
+	    QString name(names[neighbours[n]]);
+	    keep.insert(name);
+	    if (images.contains(name) || (pending.contains(name) && !scheduler.Queued(name)))
+		continue;
+
+	    QString filename(directory + "/" + name);
+	    QSize s(size);
+	    pending.insert(name);
+	    scheduler.Submit(name, distance, [this, name, filename, s] {
+		QImage image(Decode(filename, s));
+		QMetaObject::invokeMethod(this, "decoded", Qt::QueuedConnection,
+		    Q_ARG(QString, name), Q_ARG(QImage, image));
+	    });
+	}
+    }
+
+    QStringList dropped(scheduler.CancelExcept(keep));
+    for (QStringList::iterator name = dropped.begin(); name != dropped.end(); name++)
+	pending.remove(*name);
+    for (QHash<QString,QImage>::iterator image = images.begin(); image != images.end(); )
+	if (keep.contains(image.key()))
+	    image++;
+	else
+	    image = images.erase(image);
+
+    display();
+}
+
+/*
+ * NAME: decoded
+ * PURPOSE: To take an image from the decoder
+ * ARGUMENTS: name: name of the photo
+ *	image: the image, a null image if it could not be decoded
+ * RETURNS: Nothing
+ * NOTE: Runs in the GUI thread. Images that are no longer near the
+ *	current one are thrown away.
+ */
+void
+ImageViewer::decoded(QString name, QImage image)
+{
+    pending.remove(name);
+    if (current < 0)
+	return;
+
+    for (int i = qMax(0, current - VIEWER_PREFETCH); i <= qMin(names.length() - 1, current + VIEWER_PREFETCH); i++)
+	if (names[i] == name)
+	{
+	    images.insert(name, image);
+	    if (i == current)
+		display();
+	    return;
+	}
+}
+
+/*
+ * NAME: display
+ * PURPOSE: To show the current photo, if it has been decoded
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+ImageViewer::display()
+{
+    if (current < 0)
+	return;
+
+    QString name(names[current]);
+    setWindowTitle(QString("%1 (%2/%3)").arg(name).arg(current + 1).arg(names.length()));
+
+    QHash<QString,QImage>::const_iterator image = images.constFind(name);
+    if (image == images.constEnd())
+    {
+	label->setPixmap(QPixmap());
+	label->setText(tr("Loading ..."));
+	return;
+    }
+    if (image->isNull())
+    {
+	label->setPixmap(QPixmap());
+	label->setText(tr("Cannot show %1").arg(name));
+	return;
+    }
+
+    // Only scaled down, and only if the window is smaller than the screen
+    QImage shown(*image);
+    if (shown.width() > label->width() || shown.height() > label->height())
+	shown = shown.scaled(label->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    label->setPixmap(QPixmap::fromImage(shown));
+}
+
+/*
+ * NAME: keyPressEvent
+ * PURPOSE: To flip through the photos with the keyboard
+ * ARGUMENTS: event: the key event
+ * RETURNS: Nothing
+ * NOTE: Right, Space and PageDown go to the next photo, Left,
+ *	Backspace and PageUp to the previous one, Home and End to
+ *	the first and the last one. Escape closes the viewer.
+ */
+void
+ImageViewer::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key())
+    {
+    case Qt::Key_Right:
+    case Qt::Key_Space:
+    case Qt::Key_PageDown:
+	next();
+	break;
+    case Qt::Key_Left:
+    case Qt::Key_Backspace:
+    case Qt::Key_PageUp:
+	previous();
+	break;
+    case Qt::Key_Home:
+	go(0);
+	break;
+    case Qt::Key_End:
+	go(names.length() - 1);
+	break;
+    default:
+	QDialog::keyPressEvent(event);
+    }
+}
+
+/*
+ * NAME: resizeEvent
+ * PURPOSE: To fit the photo into the window again
+ * ARGUMENTS: event: the resize event
+ * RETURNS: Nothing
+ */
+void
+ImageViewer::resizeEvent(QResizeEvent *event)
+{
+    QDialog::resizeEvent(event);
+    display();
+}
+
+/*
+ * NAME: Decode
+ * PURPOSE: To load an image for showing it
+ * ARGUMENTS: filename: pathname of the image
+ *	size: the image is scaled down to fit into this
+ * RETURNS: the image, turned upright, or a null image
+ * NOTE: This is safe to run in any thread. Asking the reader for a
+ *	scaled size lets libjpeg decode JPEG images at 1/2, 1/4 or 1/8
+ *	scale, so a big image is never decoded at full resolution.
+ */
+QImage
+ImageViewer::Decode(const QString &filename, const QSize &size)
+{
+    QImageReader reader(filename);
+    QSize target(size), full;
+
+    reader.setAutoTransform(true);
+    if (!(full = reader.size()).isValid())
+	return reader.read();
+
+    // The scaled size is before turning the image upright
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90)
+	target.transpose();
+    if (full.width() > target.width() || full.height() > target.height())
+	reader.setScaledSize(full.scaled(target, Qt::KeepAspectRatio));
+
+    return reader.read();
+}
@@ -0,0 +1,51 @@
+# ifndef	IMAGEVIEWER_H
+# define	IMAGEVIEWER_H
+
+# include	<QDialog>
+# include	<QLabel>
+# include	<QImage>
+# include	<QHash>
+# include	<QSet>
+# include	<QSize>
+# include	<QString>
+# include	<QStringList>
+# include	"Scheduler.h"
+
+// Images this many places before and after the current one are decoded ahead
+# define	VIEWER_PREFETCH	2
+
+/*
+ * Shows the photos one at a time, with next and previous.
+ * The images are decoded at no more than screen resolution, which
+ * libjpeg does at a reduced scale where it can, on background
+ * threads; the neighbours of the current image are decoded ahead,
+ * so flipping through them does not wait for the decoder.
+ */
+class ImageViewer : public QDialog {
+    Q_OBJECT
+public:
+    ImageViewer(QWidget *parent = 0);
+    ~ImageViewer();
+    void Show(QString directory, QStringList names, int current);
+    static QImage Decode(const QString &filename, const QSize &size);
+public slots:
+    void next();
+    void previous();
+private slots:
+    void decoded(QString name, QImage image);
+protected:
+    void keyPressEvent(QKeyEvent *event);
+    void resizeEvent(QResizeEvent *event);
+private:
+    void go(int i);
+    void display();
+    QString directory;		// the names are relative to this
+    QStringList names;
+    int current;
+    QLabel *label;
+    QSize size;			// the images are decoded to fit into this
+    QHash<QString,QImage> images;	// the current one and its neighbours
+    QSet<QString> pending;	// being decoded
+    Scheduler scheduler;
+};
+# endif // IMAGEVIEWER_H
@@ -0,0 +1,969 @@
+# include	<sys/stat.h>
+# include	<sys/types.h>
+# include	<dirent.h>
+# include	<iostream>
+# include	<algorithm>
+# include	<QDir>
+# include	<QDirIterator>
+# include	<QFile>
+# include	<QFileInfo>
+# include	<QThreadPool>
+# include	<QtConcurrent>
+# include	<QEventLoop>
+# include	<QElapsedTimer>
+# include	<QHash>
+# include	<QSet>
+# include	<QMutex>
+# include	<unistd.h>
+# include	<string.h>
+
+# include	"Indexer.h"
+# include	"Exif.h"
+# include	"PhotoView.h"
+# include	"Cluster.h"
+# include	"AsyncResolver.h"
+# include	"Thumbnailer.h"
+# include	"LocationStore.h"
+# include	"Stats.h"
+# include	"Catalog.h"
+
+using namespace std;
+
+extern int debug;
+extern double cluster_radius;
+extern int resolver_inflight;
+extern Catalog *catalog;
+
+// The thumbnail pack is not compacted while it is smaller than this
+# define	PACK_COMPACT_MIN	(4 * 1024 * 1024)
+
+// Held by Indexer::run(), so one indexer waits for the one before to save
+static QMutex running;
+
+/*
+ * Lists the subdirectories of a directory for QtConcurrent.
+ * Hidden ones (eg the old .thumbnails) and symbolic links are left out.
+ */
+struct ListSubfolders {
+    typedef QStringList result_type;
+    ListSubfolders(const QString &new_top) : top(new_top) {}
+    QStringList operator()(const QString &folder) const
+    {
+	QStringList subfolders(QDir(top + "/" + folder).entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDir::Name));
+
+	for (QStringList::iterator s = subfolders.begin(); s != subfolders.end(); s++)
+	    *s = Indexer::Join(folder, *s);
+	return subfolders;
+    }
+    QString top;
+};
+
+/*
+ * NAME: is_image
+ * PURPOSE: To tell the images from the other files
+ * ARGUMENTS: name: file name
+ * RETURNS: true for JPEG files, whatever the case of their extension
+ */
+static bool
+is_image(const QString &name)
+{
+    return name.endsWith(".jpg", Qt::CaseInsensitive) || name.endsWith(".jpeg", Qt::CaseInsensitive);
+}
+
+/*
+ * NAME: list_files
+ * PURPOSE: To find out which files there are in a directory
+ * ARGUMENTS: directory: pathname of the directory
+ *	files: where to store the names of the files
+ * RETURNS: true if the directory could be read
+ * NOTE: This is one readdir() pass instead of a stat() per file,
+ *	which makes a difference on a network filesystem.
+ */
+static bool
+list_files(const QString &directory, QSet<QString> *files)
+{
+    DIR *dir;
+    struct dirent *entry;
+
+    if ((dir = opendir(QFile::encodeName(directory).constData())) == NULL)
+	return false;
+    while ((entry = readdir(dir)) != NULL)
+	if (entry->d_type != DT_DIR)
+	    files->insert(QFile::decodeName(entry->d_name));
+    closedir(dir);
+
+    return true;
+}
+
+/*
+ * NAME: Indexer
+ * PURPOSE: Constructor of the Indexer class
+ * ARGUMENTS: new_directory: the directory to index
+ *	new_recursive: true to index all directories below it as well
+ *	new_resolverDelay: delay between requests to reverse geocoder
+ *	new_maxRequests: max number of requests this time, 0 for no limit
+ *	new_jobs: number of files to scan in parallel
+ *	parent: parent object
+ * RETURNS: Nothing
+ * NOTE: Nothing happens until Load() and start() are called
+ */
+Indexer::Indexer(QString new_directory, bool new_recursive, float new_resolverDelay, unsigned int new_maxRequests, unsigned int new_jobs, QObject *parent)
+    : QThread(parent)
+{
+    qRegisterMetaType<QSharedPointer<ThumbPack> >();
+
+    // Also the name of the directory in the catalog
+    directory = QDir::cleanPath(QDir(new_directory).absolutePath());
+    recursive = new_recursive;
+    resolverDelay = new_resolverDelay;
+    maxRequests = new_maxRequests;
+    jobs = new_jobs;
+    scanTotal = 0;
+}
+
+/*
+ * NAME: ~Indexer
+ * PURPOSE: Destructor of the Indexer class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Cancels the indexing and waits for the thread
+ */
+Indexer::~Indexer()
+{
+    Cancel();
+    wait();
+    for (QVector<Folder>::iterator folder = folders.begin(); folder != folders.end(); folder++)
+    {
+	delete folder->index;
+	delete folder->thumbwriter;
+	delete folder->store;
+    }
+}
+
+/*
+ * NAME: Directory
+ * PURPOSE: Access method of the directory
+ * ARGUMENTS: None
+ * RETURNS: absolute pathname of the top directory being indexed
+ */
+QString
+Indexer::Directory() const
+{
+    return directory;
+}
+
+/*
+ * NAME: Folders
+ * PURPOSE: Access method of the directories found by Load()
+ * ARGUMENTS: None
+ * RETURNS: their pathnames relative to the top directory, "" for the top itself
+ * NOTE: Before start() that is only the top directory, those below
+ *	are found by run()
+ */
+QStringList
+Indexer::Folders() const
+{
+    QStringList names;
+
+    for (QVector<Folder>::const_iterator folder = folders.begin(); folder != folders.end(); folder++)
+	names.append(folder->name);
+    return names;
+}
+
+/*
+ * NAME: Join
+ * PURPOSE: To name a photo relative to the top directory
+ * ARGUMENTS: folder: its directory relative to the top directory
+ *	name: its file name
+ * RETURNS: the relative pathname
+ */
+QString
+Indexer::Join(const QString &folder, const QString &name)
+{
+    return folder.isEmpty() ? name : folder + "/" + name;
+}
+
+/*
+ * NAME: Split
+ * PURPOSE: The reverse of Join()
+ * ARGUMENTS: name: relative pathname of the photo
+ *	folder: where to store its directory
+ * RETURNS: its file name
+ */
+QString
+Indexer::Split(const QString &name, QString *folder)
+{
+    int slash = name.lastIndexOf('/');
+
+    *folder = slash < 0 ? QString("") : name.left(slash);
+    return name.mid(slash + 1);
+}
+
+/*
+ * NAME: path
+ * PURPOSE: To turn a file name into a pathname
+ * ARGUMENTS: folder: the directory of the file
+ *	name: file name relative to the directory
+ * RETURNS: absolute pathname
+ */
+QString
+Indexer::path(const Folder &folder, const QString &name) const
+{
+    return directory + "/" + Join(folder.name, name);
+}
+
+/*
+ * NAME: path
+ * PURPOSE: To get the pathname of a directory
+ * ARGUMENTS: folder: the directory
+ * RETURNS: its absolute pathname
+ */
+QString
+Indexer::path(const Folder &folder) const
+{
+    return folder.name.isEmpty() ? directory : directory + "/" + folder.name;
+}
+
+/*
+ * NAME: Cancel
+ * PURPOSE: To stop indexing as soon as possible
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: What has been scanned so far is still saved, so the next
+ *	run picks up where this one stopped. finished() is emitted
+ *	as usual.
+ */
+void
+Indexer::Cancel()
+{
+    stop.storeRelease(1);
+    emit cancelled();
+}
+
+/*
+ * NAME: IsCancelled
+ * PURPOSE: To find out if Cancel() has been called
+ * ARGUMENTS: None
+ * RETURNS: true if the indexer is stopping
+ */
+bool
+Indexer::IsCancelled() const
+{
+    return stop.loadAcquire() != 0;
+}
+
+/*
+ * NAME: tick
+ * PURPOSE: To count an item done and tell about every percent
+ * ARGUMENTS: phase: what is being done
+ *	total: number of items in this phase
+ * RETURNS: Nothing
+ * NOTE: This may be called from several threads at once
+ */
+void
+Indexer::tick(const QString &phase, int total)
+{
+    int n = done.fetchAndAddOrdered(1) + 1;
+
+    if ((qint64) n * 100 / total != (qint64) (n - 1) * 100 / total)
+	emit progress(phase, n, total);
+}
+
+/*
+ * NAME: addFolder
+ * PURPOSE: To add a directory to those to index
+ * ARGUMENTS: name: its pathname relative to the top directory
+ * RETURNS: Nothing
+ */
+void
+Indexer::addFolder(const QString &name)
+{
+    Folder folder;
+
+    folder.number = folders.size();
+    folder.name = name;
+    folder.store = NULL;
+    folder.index = NULL;
+    folder.modified = false;
+    folder.thumbwriter = NULL;
+    folder.thumbsInline = true;
+    folder.oldThumbnails = false;
+    folders.append(folder);
+}
+
+/*
+ * NAME: traverse
+ * PURPOSE: To find the directories below the top one
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: The top directory itself has been added by Load()
+ */
+void
+Indexer::traverse()
+{
+    QStringList names(Tree(directory));
+
+    // The first one is the top directory
+    for (QStringList::iterator name = names.begin() + 1; name != names.end(); name++)
+	addFolder(*name);
+}
+
+/*
+ * NAME: Tree
+ * PURPOSE: To find a directory and all directories below it
+ * ARGUMENTS: directory: pathname of the top directory
+ * RETURNS: their names relative to the top directory, "" for the top
+ *	itself, level by level
+ * NOTE: The tree is read one level at a time, the directories of
+ *	a level in parallel.
+ */
+QStringList
+Indexer::Tree(QString directory)
+{
+    QStringList names, level;
+
+    level << "";
+    while (!level.isEmpty())
+    {
+	names += level;
+
+	QList<QStringList> subfolders(QtConcurrent::blockingMapped<QList<QStringList> >(level, ListSubfolders(directory)));
+	level.clear();
+	for (QList<QStringList>::iterator s = subfolders.begin(); s != subfolders.end(); s++)
+	    level += *s;
+    }
+
+    return names;
+}
+
+/*
+ * NAME: Load
+ * PURPOSE: To read the location map of the top directory
+ * ARGUMENTS: None
+ * RETURNS: the locations, keyed by the file name
+ * NOTE: Call this before start(). The caller can show the photos
+ *	right away, the indexer then reports what it finds on top.
+ *	The directories below, if recursive, are read by the thread
+ *	and reported as they are read, so this does not take long.
+ */
+QMap<QString,QString>
+Indexer::Load()
+{
+    folders.clear();
+    addFolder("");
+    loadFolder(&folders[0]);
+
+    return folders[0].locations;
+}
+
+/*
+ * NAME: loadFolder
+ * PURPOSE: To read the location map of a directory
+ * ARGUMENTS: folder: the directory
+ * RETURNS: Nothing
+ * NOTE: Rows of files that no longer exist are dropped, and
+ *	removed from the store by the next save.
+ */
+void
+Indexer::loadFolder(Folder *folder)
+{
+    QMap<QString,QString> locations;
+
+    folder->store = new LocationStore(path(*folder));
+    if (!folder->store->Load(&locations))
+	return;
+
+    // Check if the files still exist, with a single pass over the directory
+    QSet<QString> files;
+    bool listed = list_files(path(*folder), &files);
+    for (QMap<QString,QString>::iterator l = locations.begin(); l != locations.end(); l++)
+    {
+	if (listed && !files.contains(l.key()))
+	{
+	    folder->removed.append(l.key());
+	    continue;
+	}
+	folder->locations.insert(l.key(), l.value());
+    }
+}
+
+/*
+ * NAME: loadSubfolder
+ * PURPOSE: To read the location map of a directory below the top one
+ * ARGUMENTS: folder: the directory
+ * RETURNS: Nothing
+ * NOTE: Called by run(). Its thumbnails are reported by indexed(),
+ *	its locations by located(), as if they had just been found.
+ */
+void
+Indexer::loadSubfolder(Folder *folder)
+{
+    tick(tr("Loading directories"), folders.size() - 1);
+    if (IsCancelled())
+	return;
+
+    loadFolder(folder);
+    if (folder->locations.isEmpty())
+	return;
+
+    MetaIndex index(path(*folder, ".fpv-index"));
+    emit indexed(folder->name, Thumbnails(path(*folder), index));
+    for (QMap<QString,QString>::iterator l = folder->locations.begin(); l != folder->locations.end(); l++)
+	emit located(Join(folder->name, l.key()), l.value());
+}
+
+/*
+ * NAME: Thumbnails
+ * PURPOSE: To open the thumbnails of a directory for reading
+ * ARGUMENTS: directory: the directory
+ *	index: its index, which tells where the thumbnails are
+ * RETURNS: the pack, which may be empty
+ */
+QSharedPointer<ThumbPack>
+Indexer::Thumbnails(QString directory, const MetaIndex &index)
+{
+    QSharedPointer<ThumbPack> pack(new ThumbPack(directory + "/.fpv-thumbs"));
+
+    for (quint32 i = 0; i < index.Count(); i++)
+    {
+	const MetaRecord *record = index.At(i);
+
+	pack->Insert(index.Name(record), *record);
+    }
+
+    return pack;
+}
+
+/*
+ * NAME: listFolder
+ * PURPOSE: To find the images of a directory that need to be scanned
+ * ARGUMENTS: folder: the directory
+ * RETURNS: Nothing, folder->jobs is filled in
+ * NOTE: Files whose stat fingerprint matches their record in .fpv-index
+ *	are not opened at all. Directories without images are left alone.
+ */
+void
+Indexer::listFolder(Folder *folder)
+{
+    QDirIterator it(path(*folder), QDir::Files);
+    QStringList names;
+    StatTimer timer(PHASE_LIST);
+
+    tick(tr("Reading directories"), folders.size());
+    while (it.hasNext() && !IsCancelled())
+    {
+	it.next();
+	if (is_image(it.fileName()))
+	    names.append(it.fileName());
+    }
+    Stats::Count(STAT_DIRECTORIES);
+    Stats::Count(STAT_FILES_LISTED, names.length());
+    if (names.isEmpty())
+	return;
+
+    folder->index = new MetaIndex(path(*folder, ".fpv-index"));
+    // The thumbnails go into the pack, the old .thumbnails/ are moved there
+    folder->thumbwriter = new ThumbPack(path(*folder, ".fpv-thumbs"), true);
+    folder->thumbsInline = ThumbPack::CanReference(path(*folder));
+    // Looked for once, not for every image
+    folder->oldThumbnails = QFileInfo(path(*folder, ".thumbnails")).isDir();
+    if (debug && !folder->thumbsInline)
+	cerr << path(*folder).toStdString() << ": network filesystem, embedded thumbnails are copied into the pack" << endl;
+
+    for (QStringList::iterator filename = names.begin(); filename != names.end(); filename++)
+    {
+	ScanResult job;
+	struct stat st;
+	const MetaRecord *record;
+
+	job.folder = folder->number;
+	job.filename = *filename;
+	// No need to look at the coordinates if we already have a location
+	job.needLocation = folder->locations.value(*filename, QString()).length() == 0;
+	job.fresh = false;
+	job.cancelled = false;
+	job.unsaved = false;
+	job.generated = -1;
+	job.denominator = 1;
+	memset(&job.record, 0, sizeof(job.record));
+	if (stat(QFile::encodeName(path(*folder, *filename)).constData(), &st) == -1)
+	    continue;
+	if ((record = folder->index->Lookup(*filename)) != NULL && MetaIndex::Fresh(record, st)
+	 && thumbnailPresent(*folder, record, *filename))
+	{
+	    job.record = *record;
+	    job.fresh = true;
+	}
+	else
+	    MetaIndex::Fingerprint(&job.record, st);
+	folder->jobs.append(job);
+    }
+    // The directory order is arbitrary, make the merge deterministic
+    std::sort(folder->jobs.begin(), folder->jobs.end(),
+	[](const ScanResult &a, const ScanResult &b) { return a.filename < b.filename; });
+}
+
+/*
+ * NAME: run
+ * PURPOSE: To update the location databases of the directories
+ *	and create thumbnails
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: The directories are read and the files are scanned by a pool
+ *	of worker threads. The results are merged into the location maps
+ *	in filename order, so the outcome does not depend on the
+ *	order in which the workers finish.
+ *	Photos within cluster_radius of each other are resolved with a
+ *	single request, even if they are in different directories. The
+ *	requests run concurrently (resolver_inflight) and are paced by
+ *	a token bucket instead of sleeping.
+ *	If recursive, the directories below the top one are found and
+ *	their location maps read first, each reported by indexed() and
+ *	located() as soon as it is read.
+ *	indexed() is emitted for every directory once its thumbnails
+ *	are written, located() for every location as soon as it is known.
+ *	Finally the catalog, if there is one, is told what has changed.
+ *	Only one indexer runs at a time: a new one waits here, in its
+ *	own thread, until a cancelled one has saved what it has done.
+ */
+void
+Indexer::run()
+{
+    QMutexLocker serial(&running);
+    unsigned int count;
+
+    if (jobs > 1)
+	QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+
+    // The directories below are found and read here, not by Load()
+    if (recursive)
+    {
+	int first = folders.size();
+
+	emit progress(tr("Loading directories"), 0, 0);
+	traverse();
+	done.storeRelease(0);
+	if (jobs <= 1)
+	{
+	    for (QVector<Folder>::iterator folder = folders.begin() + first; folder != folders.end(); folder++)
+		loadSubfolder(folder);
+	}
+	else
+	    QtConcurrent::blockingMap(folders.begin() + first, folders.end(), LoadSubfolder(this));
+    }
+
+    // Find the images, one directory per worker
+    done.storeRelease(0);
+    emit progress(tr("Reading directories"), 0, folders.size());
+    if (jobs <= 1)
+    {
+	for (QVector<Folder>::iterator folder = folders.begin(); folder != folders.end(); folder++)
+	    listFolder(folder);
+    }
+    else
+	QtConcurrent::blockingMap(folders, ListFolder(this));
+
+    QList<ScanResult> scanJobs;
+    for (QVector<Folder>::iterator folder = folders.begin(); folder != folders.end(); folder++)
+    {
+	scanJobs += folder->jobs;
+	folder->jobs.clear();
+    }
+
+    done.storeRelease(0);
+    scanTotal = scanJobs.length();
+    emit progress(tr("Scanning"), 0, scanTotal);
+    QList<ScanResult> results;
+    if (jobs <= 1)
+    {
+	for (QList<ScanResult>::iterator job = scanJobs.begin(); job != scanJobs.end(); job++)
+	    results.append(scan(*job));
+    }
+    else
+	results = QtConcurrent::blockingMapped<QList<ScanResult> >(scanJobs, Scan(this));
+
+    // Show what generating the missing thumbnails cost
+    int generated = 0;
+    qint64 generateTime = 0, generateMax = 0;
+    for (QList<ScanResult>::iterator result = results.begin(); result != results.end(); result++)
+    {
+	if (result->generated < 0)
+	    continue;
+	generated++;
+	generateTime += result->generated;
+	generateMax = qMax(generateMax, result->generated);
+	if (debug)
+	    cerr << "thumbnail: " << Join(folders[result->folder].name, result->filename).toStdString()
+		 << " at 1/" << result->denominator << " in " << result->generated / 1000 << " us" << endl;
+    }
+    if (debug && generated != 0)
+	cerr << generated << " thumbnails generated, " << generateTime / generated / 1000 << " us on average, "
+	     << generateMax / 1000 << " us max" << endl;
+
+    // Save the index and thumbnails of every directory
+    QVector<QList<ScanResult> > byFolder(folders.size());
+    for (QList<ScanResult>::iterator result = results.begin(); result != results.end(); result++)
+	byFolder[result->folder].append(*result);
+    for (int i = 0; i < folders.size(); i++)
+	if (folders[i].index != NULL)
+	    finishFolder(&folders[i], byFolder[i]);
+
+    // Photos taken close to each other share one reverse geocoding request
+    QVector<GeoPoint> points;
+    QList<const ScanResult *> pending;
+    for (QList<ScanResult>::iterator result = results.begin(); result != results.end() && !IsCancelled(); result++)
+    {
+	Folder &folder = folders[result->folder];
+
+	if (!result->needLocation || result->cancelled)
+	    continue;
+
+	// Use "Unbekannt" as the location if we do not have any coodinates
+	if (result->record.latitude == 0.0 && result->record.longitude == 0.0)
+	{
+	    folder.locations.insert(result->filename, "Unbekannt");
+	    folder.changed.insert(result->filename, "Unbekannt");
+	    emit located(Join(folder.name, result->filename), "Unbekannt");
+	}
+	else
+	{
+	    GeoPoint p = { result->record.longitude, result->record.latitude };
+
+	    points.append(p);
+	    pending.append(&*result);
+	}
+    }
+    QVector<int> representative;
+    QMultiHash<int,int> members;
+    {
+	StatTimer timer(PHASE_CLUSTER);
+
+	representative = cluster_points(points, cluster_radius);
+	for (int i = 0; i < points.size(); i++)
+	    members.insert(representative[i], i);
+    }
+
+    // Resolve coordinates into a location, one request per cluster
+    AsyncResolver resolver(resolver_inflight, resolverDelay > 0.0 ? 1.0 / resolverDelay : 0.0);
+    QEventLoop loop;
+    int answered = 0, expected = 0, clusters = members.uniqueKeys().size();
+    bool queueing = true;
+
+    // Hand the location of each representative to all members of its cluster
+    QObject::connect(&resolver, &AsyncResolver::resolved, &loop,
+	[&](int id, QString location) {
+	    answered++;
+	    if (location.length() != 0)
+	    {
+		for (QMultiHash<int,int>::iterator m = members.find(id); m != members.end() && m.key() == id; m++)
+		{
+		    const ScanResult *result = pending[m.value()];
+		    Folder &folder = folders[result->folder];
+
+		    folder.locations.insert(result->filename, location);
+		    folder.changed.insert(result->filename, location);
+		    emit located(Join(folder.name, result->filename), location);
+		}
+	    }
+	    emit progress(tr("Resolving"), answered, clusters);
+	    if (!queueing && answered == expected)
+		loop.quit();
+	});
+    QObject::connect(this, &Indexer::cancelled, &loop, &QEventLoop::quit);
+
+    qint64 resolveStart = Stats::Now();
+    count = 0;
+    emit progress(tr("Resolving"), 0, clusters);
+    for (int i = 0; i < points.size() && !IsCancelled(); i++)
+    {
+	if (representative[i] != i)
+	    continue;
+
+	int before = answered;
+	// Once we have used up our requests, only the cache is asked
+	if (resolver.Lookup(i, points[i].lon, points[i].lat, maxRequests == 0 || count < maxRequests))
+	{
+	    count++;
+	    expected++;
+	}
+	else if (answered > before)
+	    expected++;
+    }
+    queueing = false;
+    if (answered < expected && !IsCancelled())
+	loop.exec();
+    resolver.Cancel();
+    Stats::Time(PHASE_RESOLVE, resolveStart, Stats::Now() - resolveStart);
+
+    if (debug)
+	cerr << points.size() << " photos to resolve, " << answered << " clusters answered, "
+	     << resolver.Requests() << " requests" << endl;
+
+    // Only what has changed is written
+    {
+	StatTimer saving(PHASE_SAVE);
+
+	for (QVector<Folder>::iterator folder = folders.begin(); folder != folders.end(); folder++)
+	    if (folder->store != NULL && !folder->store->Save(folder->locations, folder->changed, folder->removed))
+		cerr << path(*folder, ".location.csv").toStdString() << ": cannot save the locations" << endl;
+    }
+
+    if (catalog != NULL && catalog->IsValid())
+	updateCatalog();
+}
+
+/*
+ * NAME: updateCatalog
+ * PURPOSE: To bring the global catalog up to date with the directories
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Only directories whose index or locations have changed, or
+ *	which the catalog does not know yet, are written. Directories
+ *	below the top one that are gone are dropped, unless the indexer
+ *	was cancelled and may not have seen all of them.
+ */
+void
+Indexer::updateCatalog()
+{
+    StatTimer timer(PHASE_CATALOG);
+    QStringList paths;
+
+    for (QVector<Folder>::iterator folder = folders.begin(); folder != folders.end(); folder++)
+    {
+	paths.append(path(*folder));
+	// Not even listed, we know nothing about it
+	if (folder->index == NULL && IsCancelled())
+	    continue;
+	if (!folder->modified && folder->changed.isEmpty() && folder->removed.isEmpty()
+	 && catalog->Known(path(*folder), folder->index != NULL ? folder->index->Count() : 0))
+	    continue;
+	if (!catalog->Update(path(*folder), folder->index, folder->locations))
+	    cerr << path(*folder).toStdString() << ": cannot update the catalog" << endl;
+    }
+
+    if (recursive && !IsCancelled())
+	catalog->Prune(directory, paths);
+}
+
+/*
+ * NAME: finishFolder
+ * PURPOSE: To save the index and thumbnails of a directory
+ * ARGUMENTS: folder: the directory
+ *	results: the scan results of its images, in filename order
+ * RETURNS: Nothing
+ * NOTE: Files not scanned because of Cancel() are left out of the
+ *	index, they are done next time.
+ */
+void
+Indexer::finishFolder(Folder *folder, const QList<ScanResult> &results)
+{
+    StatTimer timer(PHASE_INDEX);
+    // Rewrite the index if a file was changed, added or removed
+    QMap<QByteArray,MetaRecord> records;
+    bool indexModified = (quint32) results.length() != folder->index->Count();
+    bool allStored = true;	// every thumbnail made it into the pack
+    for (QList<ScanResult>::const_iterator result = results.begin(); result != results.end(); result++)
+    {
+	if (result->cancelled)
+	{
+	    indexModified = true;
+	    continue;
+	}
+	if (result->unsaved)
+	    allStored = false;
+	records.insert(result->filename.toUtf8(), result->record);
+	if (!result->fresh)
+	    indexModified = true;
+    }
+
+    // Drop the thumbnails of images that are gone or have changed once they take up a lot of room
+    quint64 live = 0;
+    for (QMap<QByteArray,MetaRecord>::iterator r = records.begin(); r != records.end(); r++)
+	if (r.value().thumbnailKind == THUMB_PACK)
+	    live += ThumbPack::EntrySize(r.key(), r.value().thumbnailLength);
+    quint64 packSize = folder->thumbwriter->Size();
+    delete folder->thumbwriter;
+    folder->thumbwriter = NULL;
+    if (!IsCancelled() && packSize > PACK_COMPACT_MIN && packSize - live > packSize / 4
+     && ThumbPack::Compact(path(*folder, ".fpv-thumbs"), &records))
+    {
+	if (debug)
+	    cerr << path(*folder, ".fpv-thumbs").toStdString() << " compacted, " << packSize << " bytes before" << endl;
+	indexModified = true;
+    }
+
+    folder->modified = indexModified;
+    bool indexSaved = !indexModified;
+    if (indexModified && MetaIndex::Save(path(*folder, ".fpv-index"), records))
+    {
+	delete folder->index;
+	folder->index = new MetaIndex(path(*folder, ".fpv-index"));
+	indexSaved = true;
+    }
+    // The old thumbnail files are in the pack now
+    if (folder->oldThumbnails && indexSaved && allStored && !IsCancelled())
+	QDir(path(*folder, ".thumbnails")).removeRecursively();
+
+    // The viewer reads the thumbnails from a fresh mapping of the pack
+    if (indexModified)
+	emit indexed(folder->name, Thumbnails(path(*folder), *folder->index));
+}
+
+/*
+ * NAME: scan
+ * PURPOSE: To extract the Exif data of a single image and save its thumbnail
+ * ARGUMENTS: job: folder, filename and the stat fingerprint of the file
+ * RETURNS: job with the record filled in
+ * NOTE: This runs on the worker threads, so it must not touch the location maps.
+ *	Images without an Exif thumbnail get one generated from a 1/8
+ *	scale decode. If that fails too, the record says THUMB_NONE
+ *	and it is not tried again until the file changes. A thumbnail
+ *	that cannot be stored in the pack is not THUMB_NONE: the record
+ *	gets no fingerprint, so the image is scanned again next time.
+ *	On a local filesystem, an embedded thumbnail of an upright image
+ *	is only referred to by its position in the image; any other is
+ *	turned upright once here and appended to the pack.
+ */
+ScanResult
+Indexer::scan(ScanResult job)
+{
+    const Folder &folder = folders.at(job.folder);
+    QByteArray name(job.filename.toUtf8());
+    QFile oldThumbnail(path(folder, ".thumbnails/" + job.filename));
+    Thumbnailer thumbnailer(THUMB_SIZE);
+    std::vector<unsigned char> generated;
+    const unsigned char *data = NULL;
+    size_t length = 0;
+    unsigned long position, positionLength;
+    quint32 offset;
+
+    if (IsCancelled())
+    {
+	job.cancelled = true;
+	return job;
+    }
+
+    StatTimer scanning(PHASE_SCAN);
+    tick(tr("Scanning"), scanTotal);
+    if (job.fresh)
+    {
+	Stats::Count(STAT_FILES_FRESH);
+	return job;
+    }
+
+    Stats::Count(STAT_FILES_SCANNED);
+    Exif exif(path(folder, job.filename));
+
+    job.record.latitude = exif.Latitude();
+    job.record.longitude = exif.Longitude();
+    job.record.timestamp = exif.Timestamp();
+    job.record.orientation = exif.OrientationCode();
+
+    // Nothing to store if the thumbnail can be read from the image itself
+    if (folder.thumbsInline && job.record.orientation <= 1
+     && exif.ThumbnailPosition(&position, &positionLength)
+     && (quint64) position + positionLength <= 0xFFFFFFFFULL)
+    {
+	job.record.thumbnailKind = THUMB_INLINE;
+	job.record.thumbnailOffset = position;
+	job.record.thumbnailLength = positionLength;
+	Stats::Count(STAT_THUMBS_INLINE);
+	return job;
+    }
+
+    StatTimer thumbnailTimer(PHASE_THUMBNAIL);
+
+    // A thumbnail from before the pack is as good as a new one
+    QByteArray saved;
+    if (folder.oldThumbnails && oldThumbnail.open(QIODevice::ReadOnly))
+    {
+	saved = oldThumbnail.readAll();
+	data = (const unsigned char *) saved.constData();
+	length = saved.length();
+    }
+    if (length == 0)
+	data = exif.Thumbnail(&length);
+    // The viewer shows the thumbnails as they are
+    if (data != NULL && length != 0 && job.record.orientation > 1)
+    {
+	if (thumbnailer.Orient(data, length, job.record.orientation, &generated))
+	{
+	    data = &generated[0];
+	    length = generated.size();
+	}
+	else
+	    data = NULL;
+    }
+    if (data == NULL || length == 0)
+    {
+	// No thumbnail in the Exif data, make one from the image itself
+	QElapsedTimer timer;
+
+	timer.start();
+	if (thumbnailer.Generate(QFile::encodeName(path(folder, job.filename)).constData(), &generated, job.record.orientation))
+	{
+	    data = &generated[0];
+	    length = generated.size();
+	    job.generated = timer.nsecsElapsed();
+	    job.denominator = thumbnailer.Denominator();
+	    Stats::Count(STAT_THUMBS_GENERATED);
+	}
+    }
+
+    job.record.thumbnailKind = THUMB_NONE;
+    job.record.thumbnailOffset = 0;
+    job.record.thumbnailLength = 0;
+    if (data != NULL && length != 0)
+    {
+	if (folder.thumbwriter->Append(name, data, length, &offset))
+	{
+	    job.record.thumbnailKind = THUMB_PACK;
+	    job.record.thumbnailOffset = offset;
+	    job.record.thumbnailLength = length;
+	    Stats::Count(STAT_THUMB_BYTES, length);
+	}
+	else
+	{
+	    // Never Fresh(), eg the disk is full
+	    job.unsaved = true;
+	    job.record.size = 0;
+	    job.record.mtime = 0;
+	    job.record.inode = 0;
+	}
+    }
+
+    return job;
+}
+
+/*
+ * NAME: thumbnailPresent
+ * PURPOSE: To check that the thumbnail of a record is where it says
+ * ARGUMENTS: folder: the directory of the image
+ *	record: the record from the index
+ *	filename: name of the image
+ * RETURNS: true if the thumbnail is in the pack or can be read from
+ *	the image, or there is none
+ * NOTE: Records of thumbnails in .thumbnails/ are not, so the image is
+ *	scanned again and its thumbnail moved into the pack. The same
+ *	happens to embedded thumbnails once the directory is found to
+ *	be on a network filesystem.
+ */
+bool
+Indexer::thumbnailPresent(const Folder &folder, const MetaRecord *record, const QString &filename)
+{
+    const unsigned char *data;
+    quint32 length;
+
+    switch (record->thumbnailKind)
+    {
+    case THUMB_NONE:
+	return true;
+    case THUMB_INLINE:
+	return folder.thumbsInline;
+    case THUMB_PACK:
+	return folder.thumbwriter->Entry(record->thumbnailOffset, filename.toUtf8(), &data, &length)
+	    && length == record->thumbnailLength;
+    }
+
+    return false;
+}
@@ -0,0 +1,124 @@
+# ifndef	INDEXER_H
+# define	INDEXER_H
+
+# include	<QThread>
+# include	<QString>
+# include	<QStringList>
+# include	<QMap>
+# include	<QVector>
+# include	<QAtomicInt>
+# include	<QSharedPointer>
+# include	<QMetaType>
+# include	"MetaIndex.h"
+# include	"ThumbPack.h"
+# include	"LocationStore.h"
+
+/*
+ * Result of scanning a single image file.
+ * Filled in by the worker threads, merged into the location map
+ * by Indexer::run() in filename order.
+ */
+struct ScanResult {
+    int folder;			// which of the indexer's directories
+    QString filename;		// in that directory
+    bool needLocation;
+    bool fresh;			// record is still valid, nothing to do
+    bool cancelled;		// not scanned, the indexer was cancelled
+    bool unsaved;		// thumbnail could not be stored, tried again next time
+    MetaRecord record;
+    qint64 generated;		// nanoseconds it took to generate the thumbnail, -1 if not
+    int denominator;		//	and the scale the image was decoded at
+};
+
+/*
+ * Brings the location maps (.location.csv), the indexes (.fpv-index)
+ * and the thumbnails (.fpv-thumbs) of a directory, and optionally of
+ * all directories below it, up to date without blocking the caller:
+ * the work is done by a thread of its own, which reports its progress
+ * and every location it finds.
+ * Every directory keeps its own files. Photos are named by their
+ * pathname relative to the top directory. The global catalog, if
+ * there is one, is updated from them at the end of a run.
+ * Everything is done by absolute pathname, so the caller may change
+ * into another directory meanwhile.
+ */
+class Indexer : public QThread {
+    Q_OBJECT
+public:
+    Indexer(QString directory, bool recursive, float resolverDelay, unsigned int maxRequests, unsigned int jobs, QObject *parent = 0);
+    ~Indexer();
+    QMap<QString,QString> Load();
+    QStringList Folders() const;
+    void Cancel();
+    bool IsCancelled() const;
+    QString Directory() const;
+    static QSharedPointer<ThumbPack> Thumbnails(QString directory, const MetaIndex &index);
+    static QString Join(const QString &folder, const QString &name);
+    static QString Split(const QString &name, QString *folder);
+    static QStringList Tree(QString directory);
+signals:
+    void progress(QString phase, int done, int total);
+    void located(QString name, QString location);
+    void indexed(QString folder, QSharedPointer<ThumbPack> pack);
+    void cancelled();
+protected:
+    void run();
+private:
+    struct Folder {
+	int number;		// in folders
+	QString name;		// relative to the top directory, "" for the top itself
+	QMap<QString,QString> locations;	// by file name in the folder
+	LocationStore *store;	// where they are kept
+	QMap<QString,QString> changed;	// locations found, to be saved
+	QStringList removed;	// rows dropped when loading, to be saved
+	MetaIndex *index;
+	bool modified;		// index rewritten by finishFolder()
+	ThumbPack *thumbwriter;	// used by scan() while scanning
+	bool thumbsInline;	// embedded thumbnails are used in place
+	bool oldThumbnails;	// there is a .thumbnails/ from before the pack
+	QList<ScanResult> jobs;
+    };
+    // Run the per-folder and per-file work for QtConcurrent
+    struct LoadSubfolder {
+	typedef void result_type;
+	LoadSubfolder(Indexer *new_indexer) : indexer(new_indexer) {}
+	void operator()(Folder &folder) { indexer->loadSubfolder(&folder); }
+	Indexer *indexer;
+    };
+    struct ListFolder {
+	typedef void result_type;
+	ListFolder(Indexer *new_indexer) : indexer(new_indexer) {}
+	void operator()(Folder &folder) { indexer->listFolder(&folder); }
+	Indexer *indexer;
+    };
+    struct Scan {
+	typedef ScanResult result_type;
+	Scan(Indexer *new_indexer) : indexer(new_indexer) {}
+	ScanResult operator()(const ScanResult &job) { return indexer->scan(job); }
+	Indexer *indexer;
+    };
+    void addFolder(const QString &name);
+    void traverse();
+    void tick(const QString &phase, int total);
+    void loadFolder(Folder *folder);
+    void loadSubfolder(Folder *folder);
+    void listFolder(Folder *folder);
+    ScanResult scan(ScanResult job);
+    void updateCatalog();
+    void finishFolder(Folder *folder, const QList<ScanResult> &results);
+    bool thumbnailPresent(const Folder &folder, const MetaRecord *record, const QString &filename);
+    QString path(const Folder &folder) const;
+    QString path(const Folder &folder, const QString &name) const;
+    QString directory;		// absolute
+    bool recursive;
+    float resolverDelay;
+    unsigned int maxRequests;
+    unsigned int jobs;
+    QVector<Folder> folders;
+    QAtomicInt stop;
+    QAtomicInt done;		// for the progress of the current phase
+    int scanTotal;
+};
+
+Q_DECLARE_METATYPE(QSharedPointer<ThumbPack>)
+# endif // INDEXER_H
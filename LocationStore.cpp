@@ -0,0 +1,438 @@
+# include	<sys/types.h>
+# include	<sys/stat.h>
+# include	<sys/mman.h>
+# include	<sys/file.h>
+# include	<fcntl.h>
+# include	<unistd.h>
+# include	<errno.h>
+# include	<string.h>
+# include	<QFile>
+# include	<QSaveFile>
+# include	<QByteArray>
+# include	<QVarLengthArray>
+# include	"LocationStore.h"
+
+/*
+ * NAME: decode
+ * PURPOSE: To decode a field of the location map
+ * ARGUMENTS: p: where the field starts
+ *	end: end of the line
+ *	field: where to store the field
+ * RETURNS: where the field ends, at the "," or at end
+ * NOTE: The fields are quoted, "," "\"" and "%" within are
+ *	encoded as "%2c" "%22" and "%25". This is done in a single
+ *	pass, without allocating anything but the QString.
+ */
+static const char *
+decode(const char *p, const char *end, QString *field)
+{
+    const char *comma, *start = p, *stop, *percent;
+
+    if ((comma = (const char *) memchr(p, ',', end - p)) == NULL)
+	comma = end;
+    stop = comma;
+    if (stop - start >= 2 && start[0] == '"' && stop[-1] == '"')
+    {
+	start++;
+	stop--;
+    }
+
+    // Most fields have nothing encoded
+    if ((percent = (const char *) memchr(start, '%', stop - start)) == NULL)
+    {
+	*field = QString::fromUtf8(start, stop - start);
+	return comma;
+    }
+
+    QVarLengthArray<char, 256> buffer(stop - start);
+    char *q = buffer.data();
+
+    memcpy(q, start, percent - start);
+    q += percent - start;
+    for (p = percent; p < stop; p++)
+    {
+	if (*p == '%' && stop - p >= 3 && p[1] == '2' && (p[2] == 'c' || p[2] == '2' || p[2] == '5'))
+	{
+	    *q++ = p[2] == 'c' ? ',' : p[2] == '2' ? '"' : '%';
+	    p += 2;
+	}
+	else
+	    *q++ = *p;
+    }
+    *field = QString::fromUtf8(buffer.data(), q - buffer.data());
+    return comma;
+}
+
+/*
+ * NAME: decode_line
+ * PURPOSE: To split a line of the location map into name and location
+ * ARGUMENTS: p: where the line starts
+ *	end: end of the line, without the newline
+ *	name: where to store the name
+ *	location: where to store the location
+ * RETURNS: the number of fields, the location is only set if 2 or more
+ */
+static int
+decode_line(const char *p, const char *end, QString *name, QString *location)
+{
+    int fields = 1;
+
+    while (end > p && end[-1] == '\r')
+	end--;
+
+    p = decode(p, end, name);
+    if (p < end)
+    {
+	decode(p + 1, end, location);
+	fields = 2;
+    }
+
+    return fields;
+}
+
+/*
+ * NAME: map_file
+ * PURPOSE: To map a file for reading
+ * ARGUMENTS: filename: pathname of the file
+ *	length: where to store its length
+ * RETURNS: the mapping or NULL if the file cannot be read or is empty
+ */
+static const char *
+map_file(const QString &filename, size_t *length)
+{
+    struct stat st;
+    void *m;
+    int fd;
+
+    *length = 0;
+    if ((fd = open(QFile::encodeName(filename).constData(), O_RDONLY)) == -1)
+	return NULL;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+	close(fd);
+	return NULL;
+    }
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+	return NULL;
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+
+    *length = st.st_size;
+    return (const char *) m;
+}
+
+/*
+ * NAME: encode
+ * PURPOSE: The reverse of decode() for a single field
+ * ARGUMENTS: s: the field
+ * RETURNS: the field as it is written, in quotes
+ */
+static QByteArray
+encode(QString s)
+{
+    QString result(s);
+
+    result.replace("%", "%25");
+    result.replace("\"", "%22");
+    result.replace(",", "%2c");
+
+    return '"' + result.toUtf8() + '"';
+}
+
+/*
+ * NAME: sync_directory
+ * PURPOSE: To make a rename within a directory stick
+ * ARGUMENTS: directory: pathname of the directory
+ * RETURNS: true on success
+ */
+static bool
+sync_directory(const QString &directory)
+{
+    int fd = open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY);
+    bool ok;
+
+    if (fd == -1)
+	return false;
+    ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/*
+ * NAME: lock_journal
+ * PURPOSE: To open the journal for writing, for this process only
+ * ARGUMENTS: filename: pathname of the journal, created if need be
+ * RETURNS: the file descriptor, locked, or -1 on error
+ * NOTE: Other processes may write the same journal, eg a batch
+ *	indexer while the viewer is open. The lock is released by
+ *	closing the file descriptor. A journal removed by compact()
+ *	while we waited for the lock is not written to.
+ */
+static int
+lock_journal(const QString &filename)
+{
+    QByteArray name(QFile::encodeName(filename));
+    struct stat locked, current;
+    int fd;
+
+    while (1)
+    {
+	if ((fd = open(name.constData(), O_RDWR | O_CREAT, 0644)) == -1)
+	    return -1;
+	if (flock(fd, LOCK_EX) == -1 || fstat(fd, &locked) == -1)
+	{
+	    close(fd);
+	    return -1;
+	}
+	if (stat(name.constData(), &current) == 0)
+	{
+	    if (current.st_dev == locked.st_dev && current.st_ino == locked.st_ino)
+		return fd;
+	}
+	else if (errno != ENOENT)
+	{
+	    close(fd);
+	    return -1;
+	}
+	close(fd);
+    }
+}
+
+/*
+ * NAME: complete_end
+ * PURPOSE: To find the end of the last complete line of the journal
+ * ARGUMENTS: fd: the journal, locked
+ * RETURNS: the offset just past its last newline, 0 if there is none,
+ *	-1 on error
+ */
+static off_t
+complete_end(int fd)
+{
+    char buffer[4096];
+    struct stat st;
+    off_t end;
+
+    if (fstat(fd, &st) == -1)
+	return -1;
+    for (end = st.st_size; end > 0; )
+    {
+	size_t n = end < (off_t) sizeof(buffer) ? end : sizeof(buffer);
+
+	if (pread(fd, buffer, n, end - n) != (ssize_t) n)
+	    return -1;
+	const char *eol = (const char *) memrchr(buffer, '\n', n);
+	if (eol != NULL)
+	    return end - n + (eol - buffer) + 1;
+	end -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * NAME: LocationStore
+ * PURPOSE: Constructor of the LocationStore class
+ * ARGUMENTS: new_directory: the directory whose locations are stored
+ * RETURNS: Nothing
+ * NOTE: Nothing is read until Load() is called
+ */
+LocationStore::LocationStore(QString new_directory)
+{
+    directory = new_directory;
+    csvName = directory + "/.location.csv";
+    journalName = directory + "/.location.journal";
+    csvSize = 0;
+    journalSize = 0;
+}
+
+/*
+ * NAME: Load
+ * PURPOSE: To read the location map
+ * ARGUMENTS: locations: where to store the locations, by file name
+ * RETURNS: true if there was anything to read
+ * NOTE: A line of the journal with a name only means the photo has
+ *	been removed. An incomplete last line, left behind by a crash
+ *	while appending, is ignored and overwritten by the next Save().
+ */
+bool
+LocationStore::Load(QMap<QString,QString> *locations)
+{
+    return read(locations, &csvSize, &journalSize);
+}
+
+/*
+ * NAME: read
+ * PURPOSE: To read .location.csv and apply the journal
+ * ARGUMENTS: locations: where to store the locations, by file name
+ *	csvLength: where to store the length of .location.csv
+ *	journalLength: where to store the length of the complete
+ *		lines of the journal
+ * RETURNS: true if there was anything to read
+ */
+bool
+LocationStore::read(QMap<QString,QString> *locations, qint64 *csvLength, qint64 *journalLength) const
+{
+    QString name, location;
+    const char *data, *p, *end, *eol;
+    size_t length;
+    bool found = false;
+
+    if ((data = map_file(csvName, &length)) != NULL)
+    {
+	for (p = data, end = data + length; p < end; p = eol + 1)
+	{
+	    if ((eol = (const char *) memchr(p, '\n', end - p)) == NULL)
+		eol = end;
+	    if (decode_line(p, eol, &name, &location) >= 2)
+		locations->insert(name, location);
+	}
+	munmap((void *) data, length);
+	*csvLength = length;
+	found = true;
+    }
+    else if (access(QFile::encodeName(csvName).constData(), F_OK) == 0)
+	found = true;
+
+    if ((data = map_file(journalName, &length)) != NULL)
+    {
+	// Only complete lines count
+	for (p = data, end = data + length; p < end && (eol = (const char *) memchr(p, '\n', end - p)) != NULL; p = eol + 1)
+	{
+	    if (decode_line(p, eol, &name, &location) >= 2)
+		locations->insert(name, location);
+	    else if (name.length() != 0)
+		locations->remove(name);
+	}
+	munmap((void *) data, length);
+	*journalLength = p - data;
+	found = true;
+    }
+
+    return found;
+}
+
+/*
+ * NAME: Save
+ * PURPOSE: To save the changes to the location map
+ * ARGUMENTS: locations: all locations, by file name
+ *	changed: the locations that have been added or changed since Load()
+ *	removed: the file names that have been removed since Load()
+ * RETURNS: true on success
+ * NOTE: Only the changes are written. The whole map is only written
+ *	when the journal has grown to half the size of .location.csv.
+ */
+bool
+LocationStore::Save(const QMap<QString,QString> &locations, const QMap<QString,QString> &changed, const QStringList &removed)
+{
+    if (changed.isEmpty() && removed.isEmpty())
+	return true;
+
+    if (!append(changed, removed))
+	return compact(locations, removed);
+    if (journalSize > JOURNAL_COMPACT_MIN && journalSize > csvSize / 2)
+	return compact(locations, removed);
+
+    return true;
+}
+
+/*
+ * NAME: append
+ * PURPOSE: To append changes to the journal
+ * ARGUMENTS: changed: the locations that have been added or changed
+ *	removed: the file names that have been removed
+ * RETURNS: true once the changes are on disk
+ * NOTE: The changes are written with a single write() and synced,
+ *	at the end of the journal as it is now: others may have
+ *	appended to it since Load(). Only an incomplete last line,
+ *	which a crash while appending may have left, is cut off.
+ */
+bool
+LocationStore::append(const QMap<QString,QString> &changed, const QStringList &removed)
+{
+    QByteArray lines;
+    off_t end;
+    int fd;
+
+    for (QStringList::const_iterator name = removed.begin(); name != removed.end(); name++)
+	lines += encode(*name) + '\n';
+    for (QMap<QString,QString>::const_iterator elem = changed.begin(); elem != changed.end(); elem++)
+	lines += encode(elem.key()) + ',' + encode(elem.value()) + '\n';
+
+    if ((fd = lock_journal(journalName)) == -1)
+	return false;
+
+    // Cut off what a crash may have left of an earlier append
+    bool created = lseek(fd, 0, SEEK_END) == 0;
+    if ((end = complete_end(fd)) == -1 || ftruncate(fd, end) == -1
+     || pwrite(fd, lines.constData(), lines.length(), end) != (ssize_t) lines.length() || fsync(fd) == -1)
+    {
+	close(fd);
+	return false;
+    }
+    close(fd);
+    // A new journal must not get lost with its directory entry
+    if (created && !sync_directory(directory))
+	return false;
+
+    journalSize = end + lines.length();
+    return true;
+}
+
+/*
+ * NAME: compact
+ * PURPOSE: To write the whole location map and clear the journal
+ * ARGUMENTS: locations: all locations, by file name
+ *	removed: the file names that have been removed since Load()
+ * RETURNS: true on success
+ * NOTE: .location.csv is replaced atomically and the rename is synced
+ *	before the journal is removed. If that does not happen, the
+ *	journal is applied once more on the next Load(), which does
+ *	no harm.
+ *	The journal is locked meanwhile, and what others have written
+ *	since Load() is read again and kept, unless locations has
+ *	another location for the same photo or it has been removed.
+ */
+bool
+LocationStore::compact(const QMap<QString,QString> &locations, const QStringList &removed)
+{
+    QSaveFile file(csvName);
+    QMap<QString,QString> merged;
+    QByteArray lines;
+    qint64 csvLength = 0, journalLength = 0;
+    int fd;
+
+    if ((fd = lock_journal(journalName)) == -1)
+	return false;
+    read(&merged, &csvLength, &journalLength);
+    for (QMap<QString,QString>::const_iterator elem = locations.begin(); elem != locations.end(); elem++)
+	merged.insert(elem.key(), elem.value());
+    // Not in the journal if append() has failed
+    for (QStringList::const_iterator name = removed.begin(); name != removed.end(); name++)
+	merged.remove(*name);
+
+    if (!file.open(QIODevice::WriteOnly))
+    {
+	close(fd);
+	return false;
+    }
+
+    for (QMap<QString,QString>::const_iterator elem = merged.begin(); elem != merged.end(); elem++)
+	lines += encode(elem.key()) + ',' + encode(elem.value()) + '\n';
+    file.write(lines);
+
+    // commit() syncs the new file before renaming it
+    if (!file.commit() || !sync_directory(directory))
+    {
+	close(fd);
+	return false;
+    }
+    csvSize = lines.length();
+
+    // Still locked, so nothing is appended to it in between
+    bool ok = unlink(QFile::encodeName(journalName).constData()) == 0 || errno == ENOENT;
+    close(fd);
+    if (ok)
+	journalSize = 0;
+    return ok;
+}
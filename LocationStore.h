@@ -0,0 +1,36 @@
+# ifndef	LOCATIONSTORE_H
+# define	LOCATIONSTORE_H
+
+# include	<QString>
+# include	<QStringList>
+# include	<QMap>
+
+/*
+ * The location map of a directory: .location.csv, which holds a
+ * "name","location" line per photo, and .location.journal, to which
+ * the changes since are appended. Once the journal has grown large
+ * enough, both are compacted into a new .location.csv.
+ * The journal is applied on top of .location.csv when loading, so
+ * a crash at any point loses at most the changes being appended.
+ * Writers lock the journal, so several processes may save the
+ * locations of the same directory.
+ */
+class LocationStore {
+public:
+    LocationStore(QString directory);
+    bool Load(QMap<QString,QString> *locations);
+    bool Save(const QMap<QString,QString> &locations, const QMap<QString,QString> &changed, const QStringList &removed);
+private:
+    bool append(const QMap<QString,QString> &changed, const QStringList &removed);
+    bool compact(const QMap<QString,QString> &locations, const QStringList &removed);
+    bool read(QMap<QString,QString> *locations, qint64 *csvLength, qint64 *journalLength) const;
+    QString directory;
+    QString csvName;
+    QString journalName;
+    qint64 csvSize;
+    qint64 journalSize;		// up to the end of the last complete line
+};
+
+// The journal is not compacted while it is smaller than this
+# define	JOURNAL_COMPACT_MIN	(64 * 1024)
+# endif // LOCATIONSTORE_H
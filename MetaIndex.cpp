@@ -0,0 +1,265 @@
+# include	<sys/types.h>
+# include	<sys/stat.h>
+# include	<sys/mman.h>
+# include	<fcntl.h>
+# include	<unistd.h>
+# include	<string.h>
+# include	<time.h>
+# include	<QFile>
+# include	<QSaveFile>
+# include	"MetaIndex.h"
+
+/*
+ * Layout of the index file:
+ *	MetaHeader
+ *	MetaRecord[count], sorted by the UTF-8 bytes of the file name
+ *	string table holding the file names
+ * The file is written in host byte order, it is a cache and
+ * is rebuilt if it does not match.
+ */
+struct MetaHeader {
+    char magic[8];
+    quint32 version;
+    quint32 recordSize;
+    quint32 count;
+    quint32 stringsLength;
+};
+
+static const char metaMagic[8] = { 'F', 'P', 'V', 'I', 'N', 'D', 'E', 'X' };
+# define	META_VERSION	3	// 3: the thumbnails are upright
+
+static_assert(sizeof(MetaHeader) % 8 == 0, "records must stay aligned");
+static_assert(sizeof(MetaRecord) == 64, "records must not contain padding");
+
+/*
+ * NAME: MetaIndex
+ * PURPOSE: Constructor of the MetaIndex class
+ * ARGUMENTS: filename: pathname of the index file (eg ".fpv-index")
+ * RETURNS: Nothing
+ * NOTE: The index is memory-mapped. A missing or damaged index
+ *	is treated as an empty one.
+ */
+MetaIndex::MetaIndex(QString filename)
+{
+    struct stat st;
+    int fd;
+
+    map = NULL;
+    mapLength = 0;
+    records = NULL;
+    count = 0;
+    strings = NULL;
+    stringsLength = 0;
+
+    if ((fd = open(QFile::encodeName(filename).constData(), O_RDONLY)) == -1)
+	return;
+
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(MetaHeader))
+    {
+	close(fd);
+	return;
+    }
+
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED)
+	return;
+    map = (unsigned char *) m;
+    mapLength = st.st_size;
+
+    const MetaHeader *header = (const MetaHeader *) map;
+    if (memcmp(header->magic, metaMagic, sizeof(metaMagic)) != 0
+     || header->version != META_VERSION
+     || header->recordSize != sizeof(MetaRecord)
+     || sizeof(MetaHeader) + (quint64) header->count * sizeof(MetaRecord) + header->stringsLength != mapLength)
+    {
+	munmap(map, mapLength);
+	map = NULL;
+	mapLength = 0;
+	return;
+    }
+
+    count = header->count;
+    records = (const MetaRecord *) (map + sizeof(MetaHeader));
+    stringsLength = header->stringsLength;
+    strings = (const char *) (records + count);
+}
+
+/*
+ * NAME: ~MetaIndex
+ * PURPOSE: Destructor of the MetaIndex class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: All this destructor does is unmap the index
+ */
+MetaIndex::~MetaIndex()
+{
+    if (map != NULL)
+	munmap(map, mapLength);
+}
+
+/*
+ * NAME: Count
+ * PURPOSE: Access method of the number of records
+ * ARGUMENTS: None
+ * RETURNS: number of records in the index
+ */
+quint32
+MetaIndex::Count() const
+{
+    return count;
+}
+
+/*
+ * NAME: At
+ * PURPOSE: To walk through the records
+ * ARGUMENTS: i: number of the record, 0 .. Count() - 1
+ * RETURNS: pointer to the record in the mapped index
+ */
+const MetaRecord *
+MetaIndex::At(quint32 i) const
+{
+    return &records[i];
+}
+
+/*
+ * NAME: Name
+ * PURPOSE: To get the file name of a record
+ * ARGUMENTS: record: a record of this index
+ * RETURNS: file name relative to the directory, empty if damaged
+ */
+QString
+MetaIndex::Name(const MetaRecord *record) const
+{
+    if ((quint64) record->nameOffset + record->nameLength > stringsLength)
+	return QString();
+
+    return QString::fromUtf8(strings + record->nameOffset, record->nameLength);
+}
+
+/*
+ * NAME: Lookup
+ * PURPOSE: To find the record of an image file
+ * ARGUMENTS: name: file name relative to the directory
+ * RETURNS: pointer to the record in the mapped index or NULL
+ */
+const MetaRecord *
+MetaIndex::Lookup(const QString &name) const
+{
+    QByteArray key(name.toUtf8());
+    quint32 low = 0, high = count;
+
+    while (low < high)
+    {
+	quint32 mid = low + (high - low) / 2;
+	const MetaRecord *r = &records[mid];
+	int cmp;
+
+	if ((quint64) r->nameOffset + r->nameLength > stringsLength)
+	    return NULL;	// damaged, the caller will re-parse
+	cmp = memcmp(key.constData(), strings + r->nameOffset, qMin((quint32) key.length(), (quint32) r->nameLength));
+	if (cmp == 0)
+	    cmp = key.length() - r->nameLength;
+	if (cmp == 0)
+	    return r;
+	if (cmp < 0)
+	    high = mid;
+	else
+	    low = mid + 1;
+    }
+
+    return NULL;
+}
+
+/*
+ * NAME: Fresh
+ * PURPOSE: To check if a record still describes a file
+ * ARGUMENTS: record: the record from the index
+ *	st: result of stat() on the file
+ * RETURNS: true if size, mtime and inode are unchanged
+ */
+bool
+MetaIndex::Fresh(const MetaRecord *record, const struct stat &st)
+{
+    MetaRecord now;
+
+    Fingerprint(&now, st);
+    return record->size == now.size && record->mtime == now.mtime && record->inode == now.inode;
+}
+
+/*
+ * NAME: Fingerprint
+ * PURPOSE: To fill in the stat fingerprint of a record
+ * ARGUMENTS: record: the record to fill in
+ *	st: result of stat() on the file
+ * RETURNS: Nothing
+ */
+void
+MetaIndex::Fingerprint(MetaRecord *record, const struct stat &st)
+{
+    record->size = st.st_size;
+    record->mtime = (qint64) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    record->inode = st.st_ino;
+}
+
+/*
+ * NAME: Date
+ * PURPOSE: To format the "original" date of a record the way Exif::Date() does
+ * ARGUMENTS: record: the record from the index
+ * RETURNS: String containing day.month.year or an empty string
+ */
+QString
+MetaIndex::Date(const MetaRecord *record)
+{
+    time_t t = record->timestamp;
+    struct tm tm;
+
+    if (record->timestamp == 0 || gmtime_r(&t, &tm) == NULL)
+	return QString("");
+
+    return QString("%1.%2.%3").arg(tm.tm_mday).arg(tm.tm_mon + 1).arg(tm.tm_year + 1900);
+}
+
+/*
+ * NAME: Save
+ * PURPOSE: To write an index file
+ * ARGUMENTS: filename: pathname of the index file
+ *	records: the records, keyed by the UTF-8 file name
+ * RETURNS: true on success
+ * NOTE: The file is replaced atomically, so a MetaIndex that
+ *	still maps the old file is not disturbed.
+ */
+bool
+MetaIndex::Save(QString filename, const QMap<QByteArray,MetaRecord> &records)
+{
+    QSaveFile file(filename);
+    MetaHeader header;
+    QByteArray strings;
+
+    if (!file.open(QIODevice::WriteOnly))
+	return false;
+
+    memcpy(header.magic, metaMagic, sizeof(metaMagic));
+    header.version = META_VERSION;
+    header.recordSize = sizeof(MetaRecord);
+    header.count = records.size();
+    for (QMap<QByteArray,MetaRecord>::const_iterator r = records.begin(); r != records.end(); r++)
+	strings += r.key();
+    header.stringsLength = strings.length();
+    file.write((const char *) &header, sizeof(header));
+
+    // QMap iterates in key order, which is the order Lookup() expects
+    quint32 offset = 0;
+    for (QMap<QByteArray,MetaRecord>::const_iterator r = records.begin(); r != records.end(); r++)
+    {
+	MetaRecord record(r.value());
+
+	record.nameOffset = offset;
+	record.nameLength = r.key().length();
+	offset += r.key().length();
+	file.write((const char *) &record, sizeof(record));
+    }
+    file.write(strings);
+
+    return file.commit();
+}
@@ -0,0 +1,59 @@
+# ifndef	METAINDEX_H
+# define	METAINDEX_H
+
+# include	<sys/types.h>
+# include	<sys/stat.h>
+# include	<QString>
+# include	<QByteArray>
+# include	<QMap>
+
+/*
+ * One record per image file in the per-directory index (.fpv-index).
+ * The records are fixed size and are used in place from the mapped file.
+ * The size, mtime and inode are the stat fingerprint: if they
+ * still match, the Exif data need not be read again.
+ */
+struct MetaRecord {
+    quint64 size;
+    qint64 mtime;		// nanoseconds since the epoch
+    quint64 inode;
+    double latitude;		// 0.0/0.0 if there are no coordinates
+    double longitude;
+    qint64 timestamp;		// DateTimeOriginal as if it was UTC, 0 if unknown
+    quint32 nameOffset;		// into the string table, UTF-8, not terminated
+    quint16 nameLength;
+    quint8 orientation;		// Exif orientation 1..8, 0 if unknown, already applied to the thumbnail
+    quint8 thumbnailKind;	// see below
+    quint32 thumbnailOffset;	// where the thumbnail is, depends on thumbnailKind
+    quint32 thumbnailLength;
+};
+
+// Values of MetaRecord::thumbnailKind
+# define	THUMB_NONE	0	// the image has no thumbnail, none could be generated
+# define	THUMB_FILE	1	// saved or generated as .thumbnails/<name> (old, moved to the pack)
+# define	THUMB_PACK	2	// in .fpv-thumbs, at thumbnailOffset
+# define	THUMB_INLINE	3	// the Exif thumbnail, at thumbnailOffset in the image itself
+
+class MetaIndex {
+public:
+    MetaIndex(QString filename);
+    ~MetaIndex();
+    const MetaRecord *Lookup(const QString &name) const;
+    quint32 Count() const;
+    const MetaRecord *At(quint32 i) const;
+    QString Name(const MetaRecord *record) const;
+    static bool Fresh(const MetaRecord *record, const struct stat &st);
+    static void Fingerprint(MetaRecord *record, const struct stat &st);
+    static QString Date(const MetaRecord *record);
+    static bool Save(QString filename, const QMap<QByteArray,MetaRecord> &records);
+private:
+    MetaIndex(const MetaIndex &);
+    MetaIndex &operator=(const MetaIndex &);
+    unsigned char *map;
+    size_t mapLength;
+    const MetaRecord *records;
+    quint32 count;
+    const char *strings;
+    quint32 stringsLength;
+};
+# endif // METAINDEX_H
@@ -0,0 +1,193 @@
+# include	<QHash>
+# include	"PhotoModel.h"
+# include	"MetaIndex.h"
+# include	"Indexer.h"
+
+extern QHash<QString,MetaIndex *> metaindexes;
+
+/*
+ * NAME: PhotoModel
+ * PURPOSE: Constructor of the PhotoModel class
+ * ARGUMENTS: names: QStringlist of pathnames relative to the top directory, in the order they are to be shown
+ *	locationmap: QMap<QString,QString> mapping pathnames to locations (street, place, ...)
+ *	parent: parent object
+ * RETURNS: Nothing
+ * NOTE: A new location header is started whenever the location changes.
+ *	Only the names are collected here, the
+ *	thumbnails are loaded by the delegate when they are painted.
+ */
+PhotoModel::PhotoModel(QStringList names, QMap<QString,QString> *new_locationmap, QObject *parent)
+    : QAbstractListModel(parent)
+{
+    locationmap = new_locationmap;
+    build(names);
+}
+
+/*
+ * NAME: Update
+ * PURPOSE: To show a different set of photos, eg when more have been located
+ * ARGUMENTS: names: QStringlist of file names, in the order they are to be shown
+ * RETURNS: Nothing
+ * NOTE: The locations and dates are looked up again as well
+ */
+void
+PhotoModel::Update(QStringList names)
+{
+    beginResetModel();
+    photos.clear();
+    rows.clear();
+    build(names);
+    endResetModel();
+}
+
+/*
+ * NAME: build
+ * PURPOSE: To group the photos into headers and rows
+ * ARGUMENTS: names: QStringlist of file names, in the order they are to be shown
+ * RETURNS: Nothing
+ */
+void
+PhotoModel::build(QStringList names)
+{
+    QString currentLocation("");
+    int headerRow = -1;		// of the current location
+
+    photos.reserve(names.length());
+    for (QStringList::iterator name = names.begin(); name != names.end(); name++)
+    {
+	QString location(locationmap->value(*name));
+	QString folder, file(Indexer::Split(*name, &folder));
+	const MetaIndex *metaindex = metaindexes.value(folder, NULL);
+	const MetaRecord *record = metaindex != NULL ? metaindex->Lookup(file) : NULL;
+	Photo photo;
+	QString date;
+
+	// The index has everything we need; files it does not know yet
+	// get their date once indexed() has delivered their record
+	photo.name = *name;
+	if (record != NULL)
+	    date = MetaIndex::Date(record);
+
+	if (location != currentLocation)
+	{
+	    Row header;
+
+	    header.header = true;
+	    header.location = location;
+	    header.date = date;
+	    header.first = header.count = 0;
+	    rows.append(header);
+	    headerRow = rows.size() - 1;
+	}
+	else if (headerRow >= 0 && rows[headerRow].date.isEmpty())
+	    rows[headerRow].date = date;
+	if (rows.isEmpty() || rows.last().header || rows.last().count >= PHOTO_COLUMNS)
+	{
+	    Row row;
+
+	    row.header = false;
+	    row.first = photos.size();
+	    row.count = 0;
+	    rows.append(row);
+	}
+	rows.last().count++;
+	photos.append(photo);
+
+        currentLocation = location;
+    }
+}
+
+/*
+ * NAME: rowCount
+ * PURPOSE: To tell the view the number of rows
+ * ARGUMENTS: parent: must be the invalid index, this is a flat list
+ * RETURNS: number of headers plus number of photo rows
+ */
+int
+PhotoModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+/*
+ * NAME: Photos
+ * PURPOSE: Access method of the number of photos
+ * ARGUMENTS: None
+ * RETURNS: number of photos in the model
+ */
+int
+PhotoModel::Photos() const
+{
+    return photos.size();
+}
+
+/*
+ * NAME: Names
+ * PURPOSE: Access method of the photos
+ * ARGUMENTS: None
+ * RETURNS: their names, in the order they are shown
+ */
+QStringList
+PhotoModel::Names() const
+{
+    QStringList names;
+
+    names.reserve(photos.size());
+    for (QVector<Photo>::const_iterator photo = photos.begin(); photo != photos.end(); photo++)
+	names.append(photo->name);
+    return names;
+}
+
+/*
+ * NAME: data
+ * PURPOSE: To hand out the data of a row
+ * ARGUMENTS: index: the row
+ *	role: which data, Qt::DisplayRole is the location of a header
+ * RETURNS: the data or an invalid QVariant
+ */
+QVariant
+PhotoModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size())
+	return QVariant();
+
+    const Row &row = rows[index.row()];
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+	return row.header ? QVariant(row.location) : QVariant();
+    case HeaderRole:
+	return row.header;
+    case DateRole:
+	return row.header ? QVariant(row.date) : QVariant();
+    case NamesRole:
+    {
+	QStringList names;
+
+	for (int i = row.first; i < row.first + row.count; i++)
+	    names.append(photos[i].name);
+	return names;
+    }
+    }
+
+    return QVariant();
+}
+
+/*
+ * NAME: flags
+ * PURPOSE: To tell the view what can be done with a row
+ * ARGUMENTS: index: the row
+ * RETURNS: the flags
+ * NOTE: Headers are "editable" so the view can open a label on
+ *	them, in which the location can be selected.
+ */
+Qt::ItemFlags
+PhotoModel::flags(const QModelIndex &index) const
+{
+    Qt::ItemFlags f(QAbstractListModel::flags(index));
+
+    if (index.isValid() && index.row() < rows.size() && rows[index.row()].header)
+	f |= Qt::ItemIsEditable;
+    return f;
+}
@@ -0,0 +1,48 @@
+# ifndef	PHOTOMODEL_H
+# define	PHOTOMODEL_H
+
+# include	<QAbstractListModel>
+# include	<QStringList>
+# include	<QVector>
+# include	<QMap>
+
+// Number of thumbnails per row
+# define	PHOTO_COLUMNS	4
+
+/*
+ * The photos of a directory, or of a directory tree, grouped by location.
+ * Every row of the model is either the header of a location
+ * (location and date) or a row of up to PHOTO_COLUMNS photos.
+ */
+class PhotoModel : public QAbstractListModel {
+    Q_OBJECT
+public:
+    enum Roles {
+	HeaderRole = Qt::UserRole,	// bool: is this a header row
+	DateRole,			// QString: date of the first photo of a header
+	NamesRole			// QStringList: file names of a photo row
+    };
+    PhotoModel(QStringList names, QMap<QString,QString> *locationmap, QObject *parent = 0);
+    void Update(QStringList names);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    int Photos() const;
+    QStringList Names() const;
+private:
+    void build(QStringList names);
+    struct Photo {
+	QString name;
+    };
+    struct Row {
+	bool header;
+	QString location;	// headers only
+	QString date;		// headers only
+	int first;		// photo rows only: index of the first photo
+	int count;		//	and their number
+    };
+    QVector<Photo> photos;
+    QVector<Row> rows;
+    QMap<QString,QString> *locationmap;
+};
+# endif // PHOTOMODEL_H
@@ -0,0 +1,412 @@
+# include	<QPainter>
+# include	<QPixmap>
+# include	<QMouseEvent>
+# include	<QHelpEvent>
+# include	<QToolTip>
+# include	<QScrollBar>
+# include	<QSet>
+# include	<QLabel>
+# include	<QTextDocument>
+# include	<QAbstractTextDocumentLayout>
+# include	<QDebug>
+# include	"PhotoView.h"
+# include	"PhotoModel.h"
+# include	"Indexer.h"
+
+extern int debug;
+
+/*
+ * NAME: PhotoDelegate
+ * PURPOSE: Constructor of the PhotoDelegate class
+ * ARGUMENTS: new_cache: where the thumbnails come from
+ *	new_packs: the thumbnails of the directories
+ *	parent: parent object
+ * RETURNS: Nothing
+ */
+PhotoDelegate::PhotoDelegate(ThumbnailCache *new_cache, const PackMap *new_packs, QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+    cache = new_cache;
+    packs = new_packs;
+}
+
+/*
+ * NAME: sizeHint
+ * PURPOSE: To tell the view the size of a row
+ * ARGUMENTS: option: style options
+ *	index: the row
+ * RETURNS: the size
+ * NOTE: This does not depend on the thumbnails, so the view can lay
+ *	out all rows without loading any of them.
+ */
+QSize
+PhotoDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    if (index.data(PhotoModel::HeaderRole).toBool())
+	return QSize(PHOTO_COLUMNS * (THUMB_SIZE + THUMB_SPACING), option.fontMetrics.height() + 3 * THUMB_SPACING);
+
+    return QSize(PHOTO_COLUMNS * (THUMB_SIZE + THUMB_SPACING), THUMB_SIZE + THUMB_SPACING);
+}
+
+/*
+ * NAME: paint
+ * PURPOSE: To paint a row
+ * ARGUMENTS: painter: the painter
+ *	option: style options, option.rect is where the row goes
+ *	index: the row
+ * RETURNS: Nothing
+ */
+void
+PhotoDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    painter->save();
+
+    if (index.data(PhotoModel::HeaderRole).toBool())
+    {
+	QRect r(option.rect.adjusted(THUMB_SPACING, THUMB_SPACING, -THUMB_SPACING, 0));
+	QTextDocument location;
+	QAbstractTextDocumentLayout::PaintContext context;
+
+	location.setDefaultFont(option.font);
+	location.setDocumentMargin(0);
+	location.setHtml(Html(index.data(Qt::DisplayRole).toString()));
+	context.palette = option.palette;
+	QPointF origin(r.x(), r.y() + (r.height() - location.size().height()) / 2);
+	painter->translate(origin);
+	location.documentLayout()->draw(painter, context);
+	painter->translate(-origin);
+	painter->setFont(option.font);
+	painter->drawText(r, Qt::AlignRight | Qt::AlignVCenter, index.data(PhotoModel::DateRole).toString());
+    }
+    else
+    {
+	QStringList names(index.data(PhotoModel::NamesRole).toStringList());
+
+	for (int column = 0; column < names.length(); column++)
+	{
+	    QRect cell(option.rect.x() + column * (THUMB_SIZE + THUMB_SPACING), option.rect.y(), THUMB_SIZE, THUMB_SIZE);
+	    QString file;
+	    QSharedPointer<ThumbPack> pack(PhotoView::Pack(*packs, names[column], &file));
+	    QPixmap image;
+
+	    if (!pack.isNull())
+		image = cache->Get(pack, file);
+	    if (image.isNull())
+	    {
+		// Still on its way, or there is none
+		if (!pack.isNull() && !cache->Missing(pack, file))
+		    painter->fillRect(cell, option.palette.midlight());
+		painter->drawRect(cell.adjusted(0, 0, -1, -1));
+		continue;
+	    }
+	    // Centered in its cell
+	    painter->drawPixmap(cell.x() + (THUMB_SIZE - image.width()) / 2,
+				cell.y() + (THUMB_SIZE - image.height()) / 2, image);
+	}
+    }
+
+    painter->restore();
+}
+
+/*
+ * NAME: Html
+ * PURPOSE: To make the rich text a header shows
+ * ARGUMENTS: location: the location
+ * RETURNS: the location in bold
+ * NOTE: The location is taken as rich text, as the label of the
+ *	headers used to, so the entities of the geocoder are shown
+ *	decoded.
+ */
+QString
+PhotoDelegate::Html(const QString &location)
+{
+    return QString("<b>") + location + QString("</b>");
+}
+
+/*
+ * NAME: createEditor
+ * PURPOSE: To make a label in which the location of a header can be selected
+ * ARGUMENTS: parent: the viewport
+ *	option: style options
+ *	index: the header row
+ * RETURNS: the label, NULL for photo rows
+ * NOTE: The label goes away once it loses the focus
+ */
+QWidget *
+PhotoDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(option);
+
+    if (!index.data(PhotoModel::HeaderRole).toBool())
+	return NULL;
+
+    QLabel *label = new QLabel(parent);
+    label->setTextInteractionFlags(Qt::TextSelectableByMouse | Qt::TextSelectableByKeyboard);
+    label->setFocusPolicy(Qt::StrongFocus);
+    label->setAutoFillBackground(true);
+    label->setContentsMargins(THUMB_SPACING, THUMB_SPACING, THUMB_SPACING, 0);
+    return label;
+}
+
+/*
+ * NAME: setEditorData
+ * PURPOSE: To put the location and the date into the label of a header
+ * ARGUMENTS: editor: the label
+ *	index: the header row
+ * RETURNS: Nothing
+ */
+void
+PhotoDelegate::setEditorData(QWidget *editor, const QModelIndex &index) const
+{
+    QLabel *label = qobject_cast<QLabel *>(editor);
+
+    if (label != NULL)
+	label->setText(QString("<table width=\"100%\"><tr><td>") + Html(index.data(Qt::DisplayRole).toString())
+		       + QString("</td><td align=\"right\">") + index.data(PhotoModel::DateRole).toString().toHtmlEscaped()
+		       + QString("</td></tr></table>"));
+}
+
+/*
+ * NAME: setModelData
+ * PURPOSE: Nothing is written back from the label of a header
+ * ARGUMENTS: editor, model, index: unused
+ * RETURNS: Nothing
+ */
+void
+PhotoDelegate::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const
+{
+    Q_UNUSED(editor);
+    Q_UNUSED(model);
+    Q_UNUSED(index);
+}
+
+/*
+ * NAME: PhotoView
+ * PURPOSE: Constructor of the PhotoView class
+ * ARGUMENTS: new_cache: where the thumbnails come from
+ *	new_packs: the thumbnails of the directories
+ *	parent: parent widget
+ * RETURNS: Nothing
+ */
+PhotoView::PhotoView(ThumbnailCache *new_cache, const PackMap &new_packs, QWidget *parent)
+    : QListView(parent)
+{
+    cache = new_cache;
+    packs = new_packs;
+    keptPosition = -1;
+    setItemDelegate(new PhotoDelegate(cache, &packs, this));
+    // Repaint when a thumbnail arrives, Qt merges the updates
+    connect(cache, SIGNAL(thumbnailReady(QString)), viewport(), SLOT(update()));
+
+    scheduleTimer.setSingleShot(true);
+    scheduleTimer.setInterval(20);
+    connect(&scheduleTimer, SIGNAL(timeout()), this, SLOT(schedule()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), &scheduleTimer, SLOT(start()));
+    connect(verticalScrollBar(), SIGNAL(rangeChanged(int,int)), &scheduleTimer, SLOT(start()));
+    connect(verticalScrollBar(), SIGNAL(rangeChanged(int,int)), this, SLOT(restorePosition()));
+
+    setSelectionMode(QAbstractItemView::NoSelection);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    // Lay out big directories in batches, so the window shows up at once
+    setLayoutMode(QListView::Batched);
+    setBatchSize(500);
+    setMinimumWidth(PHOTO_COLUMNS * (THUMB_SIZE + THUMB_SPACING) + 2 * frameWidth()
+		    + style()->pixelMetric(QStyle::PM_ScrollBarExtent));
+}
+
+/*
+ * NAME: NameAt
+ * PURPOSE: To find the image at a position in the viewport
+ * ARGUMENTS: pos: the position
+ * RETURNS: the file name of the image or an empty string
+ */
+QString
+PhotoView::NameAt(const QPoint &pos) const
+{
+    QModelIndex index(indexAt(pos));
+    QStringList names;
+    int column;
+
+    if (!index.isValid() || index.data(PhotoModel::HeaderRole).toBool())
+	return QString("");
+
+    names = index.data(PhotoModel::NamesRole).toStringList();
+    column = (pos.x() - visualRect(index).x()) / (THUMB_SIZE + THUMB_SPACING);
+    if (column < 0 || column >= names.length())
+	return QString("");
+
+    return names[column];
+}
+
+/*
+ * NAME: mousePressEvent
+ * PURPOSE: To tell which image has been clicked on
+ * ARGUMENTS: event: the mouse event
+ * RETURNS: Nothing
+ * NOTE: Only the left button is reported, through imageClicked().
+ *	A click on a header opens its label.
+ */
+void
+PhotoView::mousePressEvent(QMouseEvent *event)
+{
+    QString name(NameAt(event->pos()));
+
+    if (debug)
+	qDebug() << "Clicked" << name << (unsigned int) event->button();
+    if (event->button() == Qt::LeftButton && name.length() != 0)
+	emit imageClicked(name);
+    // The location of a header can be selected in a label
+    if (event->button() == Qt::LeftButton && indexAt(event->pos()).data(PhotoModel::HeaderRole).toBool())
+	edit(indexAt(event->pos()));
+
+    QListView::mousePressEvent(event);
+}
+
+/*
+ * NAME: viewportEvent
+ * PURPOSE: To show the file name of an image as its tool tip
+ * ARGUMENTS: event: the event
+ * RETURNS: true if the event has been handled
+ */
+bool
+PhotoView::viewportEvent(QEvent *event)
+{
+    if (event->type() == QEvent::ToolTip)
+    {
+	QHelpEvent *help = static_cast<QHelpEvent *>(event);
+	QString name(NameAt(help->pos()));
+
+	if (name.length() != 0)
+	    QToolTip::showText(help->globalPos(), name, viewport());
+	else
+	    QToolTip::hideText();
+	return true;
+    }
+
+    return QListView::viewportEvent(event);
+}
+
+/*
+ * NAME: resizeEvent
+ * PURPOSE: To reschedule when more or less rows are visible
+ * ARGUMENTS: event: the resize event
+ * RETURNS: Nothing
+ */
+void
+PhotoView::resizeEvent(QResizeEvent *event)
+{
+    QListView::resizeEvent(event);
+    scheduleTimer.start();
+}
+
+/*
+ * NAME: SetPack
+ * PURPOSE: To take the thumbnails of a directory from a different
+ *	pack, eg once the directory has been indexed
+ * ARGUMENTS: folder: the directory, relative to the top directory
+ *	new_pack: its thumbnails
+ * RETURNS: Nothing
+ */
+void
+PhotoView::SetPack(const QString &folder, QSharedPointer<ThumbPack> new_pack)
+{
+    packs.insert(folder, new_pack);
+    viewport()->update();
+    scheduleTimer.start();
+}
+
+/*
+ * NAME: Pack
+ * PURPOSE: To find the thumbnails of a photo
+ * ARGUMENTS: packs: the thumbnails of the directories
+ *	name: pathname of the photo relative to the top directory
+ *	file: where to store its name in the pack
+ * RETURNS: the pack of its directory, NULL if there is none
+ */
+QSharedPointer<ThumbPack>
+PhotoView::Pack(const PackMap &packs, const QString &name, QString *file)
+{
+    QString folder;
+
+    *file = Indexer::Split(name, &folder);
+    return packs.value(folder);
+}
+
+/*
+ * NAME: KeepPosition
+ * PURPOSE: To stay where we are when the model is about to be reset
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: The rows are laid out in batches after a reset, so the
+ *	position is restored as the scroll range grows.
+ */
+void
+PhotoView::KeepPosition()
+{
+    keptPosition = verticalScrollBar()->value();
+}
+
+/*
+ * NAME: restorePosition
+ * PURPOSE: To scroll back to the position saved by KeepPosition()
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+PhotoView::restorePosition()
+{
+    if (keptPosition < 0)
+	return;
+
+    verticalScrollBar()->setValue(qMin(keptPosition, verticalScrollBar()->maximum()));
+    if (verticalScrollBar()->maximum() >= keptPosition)
+	keptPosition = -1;
+}
+
+/*
+ * NAME: schedule
+ * PURPOSE: To queue the thumbnails around the visible rows
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: The visible thumbnails get priority 0, the others the
+ *	distance of their row from the visible ones. Queued thumbnails
+ *	more than PREFETCH_SCREENS screens away are cancelled.
+ */
+void
+PhotoView::schedule()
+{
+    QAbstractItemModel *m = model();
+    QSet<QString> keep;
+    int rows, first, last, screen;
+
+    if (m == NULL || (rows = m->rowCount()) == 0)
+	return;
+
+    QModelIndex top(indexAt(QPoint(0, 0))), bottom(indexAt(QPoint(0, viewport()->height() - 1)));
+    first = top.isValid() ? top.row() : 0;
+    last = bottom.isValid() ? bottom.row() : rows - 1;
+    screen = last - first + 1;
+
+    for (int row = qMax(0, first - PREFETCH_SCREENS * screen); row <= qMin(rows - 1, last + PREFETCH_SCREENS * screen); row++)
+    {
+	QModelIndex index(m->index(row, 0));
+	int priority = row < first ? first - row : row > last ? row - last : 0;
+
+	if (index.data(PhotoModel::HeaderRole).toBool())
+	    continue;
+
+	QStringList names(index.data(PhotoModel::NamesRole).toStringList());
+	for (int column = 0; column < names.length(); column++)
+	{
+	    QString file;
+	    QSharedPointer<ThumbPack> pack(Pack(packs, names[column], &file));
+
+	    if (pack.isNull())
+		continue;
+	    keep.insert(pack->Key(file));
+	    cache->Prefetch(pack, file, priority);
+	}
+    }
+    cache->CancelExcept(keep);
+}
@@ -0,0 +1,76 @@
+# ifndef	PHOTOVIEW_H
+# define	PHOTOVIEW_H
+
+# include	<QListView>
+# include	<QStyledItemDelegate>
+# include	<QString>
+# include	<QTimer>
+# include	<QSharedPointer>
+# include	<QHash>
+# include	"ThumbnailCache.h"
+# include	"ThumbPack.h"
+
+// Size of a thumbnail cell, thumbnails are scaled down to fit
+# define	THUMB_SIZE	160
+# define	THUMB_SPACING	4
+
+// Thumbnails this many screens above and below the visible ones are decoded ahead
+# define	PREFETCH_SCREENS	2
+
+// The thumbnails of every directory shown, by its name relative to the top directory
+typedef QHash<QString,QSharedPointer<ThumbPack> > PackMap;
+
+/*
+ * Paints the rows of a PhotoModel: a header with the location and
+ * the date, or a row of thumbnails. The location is rich text, as
+ * the geocoder has it. A header that is clicked on gets a label, so
+ * the location can be selected.
+ */
+class PhotoDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    PhotoDelegate(ThumbnailCache *cache, const PackMap *packs, QObject *parent = 0);
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    void setEditorData(QWidget *editor, const QModelIndex &index) const;
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const;
+    static QString Html(const QString &location);
+private:
+    ThumbnailCache *cache;
+    const PackMap *packs;	// where the thumbnails are, owned by the view
+};
+
+/*
+ * The thumbnail grid. The photos are named by their pathname relative
+ * to the top directory, their thumbnails are in the pack of their
+ * directory. Only the rows in the viewport are painted,
+ * so the number of photos does not matter much. Thumbnails that are
+ * still being decoded are shown as placeholders. Whenever the view
+ * scrolls, the thumbnails near the visible rows are queued, nearest
+ * first, and those further away are taken off the queue.
+ */
+class PhotoView : public QListView {
+    Q_OBJECT
+public:
+    PhotoView(ThumbnailCache *cache, const PackMap &packs, QWidget *parent = 0);
+    QString NameAt(const QPoint &pos) const;
+    void SetPack(const QString &folder, QSharedPointer<ThumbPack> new_pack);
+    static QSharedPointer<ThumbPack> Pack(const PackMap &packs, const QString &name, QString *file);
+    void KeepPosition();
+signals:
+    void imageClicked(QString name);
+private slots:
+    void schedule();
+    void restorePosition();
+protected:
+    void mousePressEvent(QMouseEvent *event);
+    bool viewportEvent(QEvent *event);
+    void resizeEvent(QResizeEvent *event);
+private:
+    ThumbnailCache *cache;
+    PackMap packs;		// where the thumbnails are
+    QTimer scheduleTimer;	// merges the scroll events
+    int keptPosition;		// to scroll back to after a reset, -1 if none
+};
+# endif // PHOTOVIEW_H
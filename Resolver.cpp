@@ -1,9 +1,14 @@
 # include	<stdio.h>
 # include	<curl/curl.h>
 # include	<iostream>
-# include	<QRegularExpressionMatch>
+# include	<string.h>
+# include	<QVector>
+# include	<QStringList>
 # include	<QDebug>
+# include	<QElapsedTimer>
+# include	<unistd.h>
 # include	"Resolver.h"
+# include	"Stats.h"
 
 using namespace std;
 
@@ -26,8 +31,117 @@ Resolver::~Resolver()
 {
 }
 
+GeoCache *Resolver::cache = NULL;
+GeoDB *Resolver::geodb = NULL;
+float Resolver::delay = 0.0;
+QByteArray Resolver::baseUrl(DEFAULT_GEOCODER);
+unsigned long Resolver::requests = 0;
+
+/*
+ * NAME: SetCache
+ * PURPOSE: To set the coordinate cache consulted before any request
+ * ARGUMENTS: new_cache: the cache, NULL for none
+ * RETURNS: Nothing
+ */
+void
+Resolver::SetCache(GeoCache *new_cache)
+{
+    cache = new_cache;
+}
+
+/*
+ * NAME: SetDelay
+ * PURPOSE: To set the minimum time between two requests to the reverse geocoder
+ * ARGUMENTS: new_delay: delay in seconds
+ * RETURNS: Nothing
+ */
+void
+Resolver::SetDelay(float new_delay)
+{
+    delay = new_delay;
+}
+
+/*
+ * NAME: SetBaseUrl
+ * PURPOSE: To set the reverse geocoder to ask
+ * ARGUMENTS: new_baseUrl: URL up to, but excluding, "/reverse",
+ *	eg "http://localhost:8080"
+ * RETURNS: Nothing
+ * NOTE: The geocoder must understand Nominatim's reverse requests
+ */
+void
+Resolver::SetBaseUrl(QString new_baseUrl)
+{
+    baseUrl = new_baseUrl.toUtf8();
+    while (baseUrl.endsWith('/'))
+	baseUrl.chop(1);
+}
+
+/*
+ * NAME: SetOfflineDB
+ * PURPOSE: To answer all lookups from an offline database
+ * ARGUMENTS: new_geodb: the database, NULL to use the online geocoder
+ * RETURNS: Nothing
+ */
+void
+Resolver::SetOfflineDB(GeoDB *new_geodb)
+{
+    geodb = new_geodb;
+}
+
+/*
+ * NAME: OfflineDB
+ * PURPOSE: Access method of the offline database
+ * ARGUMENTS: None
+ * RETURNS: the database or NULL
+ */
+GeoDB *
+Resolver::OfflineDB()
+{
+    return geodb;
+}
+
+/*
+ * NAME: Cache
+ * PURPOSE: Access method of the coordinate cache
+ * ARGUMENTS: None
+ * RETURNS: the cache or NULL
+ */
+GeoCache *
+Resolver::Cache()
+{
+    return cache;
+}
+
+/*
+ * NAME: Requests
+ * PURPOSE: Access method of the number of requests sent so far
+ * ARGUMENTS: None
+ * RETURNS: number of requests sent to the reverse geocoder
+ */
+unsigned long
+Resolver::Requests()
+{
+    return requests;
+}
+
 static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp);
-QString resolve_pattern(QString pat, QString s);
+
+/*
+ * A pattern compiled into a list of items: either literal text
+ * or a field with its alternatives.
+ */
+struct PatternItem {
+    QString literal;
+    QStringList alternatives;	// empty for literal text
+    bool optional;
+};
+typedef QVector<PatternItem> PatternProgram;
+
+static PatternProgram compile_pattern(QString pat);
+static const QVector<PatternProgram> &compiled_patterns(void);
+static QString run_pattern(const PatternProgram &program, const AddressFields &fields);
+static QString tidy(QString s);
 
 /*
  * The following is a list of specifications which fields from the
@@ -56,64 +170,243 @@ static QString pattern[] = {
  * PURPOSE: To reverse geoencode a location given its longitude and latitude
  * ARGUMENTS: lon: the location's longitude
  *	lat: the location's latitude
+ *	online: if false, only the cache is consulted
  * RETURNS: a string describing the location
+ *	or an empty string if it is not cached and online is false
+ * NOTE: Requests are spaced at least "delay" seconds apart.
+ *	With an offline database, that is asked instead.
  */
 QString
-Resolver::Location(double lon, double lat)
+Resolver::Location(double lon, double lat, bool online)
 {
-    CURL *curl = curl_easy_init();
-    char url[1024];
+    static QElapsedTimer lastRequest;
+    CURL *curl;
     struct MemoryStruct membuffer;
-    int i;
     QString location;
 
-    if (!curl)
+    if (geodb != NULL)
+	return Offline(lon, lat);
+    if (cache != NULL && cache->Lookup(lon, lat, &location))
+	return location;
+    if (!online)
+	return QString("");
+
+    if ((curl = curl_easy_init()) == NULL)
 	return QString("");
 
+    if (lastRequest.isValid() && delay > 0.0)
+    {
+	qint64 wait = (qint64) (delay * 1000) - lastRequest.elapsed();
+
+	if (wait > 0)
+	{
+	    StatTimer timer(PHASE_SLEEP);
+
+	    usleep(wait * 1000);
+	}
+    }
+    lastRequest.start();
+    requests++;
+    Stats::Count(STAT_HTTP_REQUESTS);
+
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Fruity Picture Viewer/0.1");
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
     membuffer.memory = NULL;
     membuffer.size = 0;
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &membuffer);
-    snprintf(url, sizeof(url), "http://nominatim.openstreetmap.org/reverse?format=xml&lat=%f&lon=%f&zoom=18&addressdetails=1", lat, lon);
+    QByteArray url(Url(lon, lat));
     qDebug() << "URL=" << url;
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_perform(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url.constData());
+    {
+	StatTimer timer(PHASE_HTTP);
+	QElapsedTimer latency;
+	long status = 0;
+
+	latency.start();
+	if (curl_easy_perform(curl) != CURLE_OK
+	 || curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status) != CURLE_OK || status != 200)
+	    Stats::Count(STAT_HTTP_FAILURES);
+	Stats::Latency(latency.nsecsElapsed());
+    }
     // fprintf(stderr, "%s", membuffer.memory);
 
-    QString s(membuffer.memory);
-    for (i = 0; pattern[i].length() != 0; i++)
+    location = Format(QString(membuffer.memory), lon, lat);
+
+    free(membuffer.memory);
+
+    curl_easy_cleanup(curl);
+
+    return location;
+}
+
+/*
+ * NAME: Url
+ * PURPOSE: To build the request URL for a pair of coordinates
+ * ARGUMENTS: lon: the location's longitude
+ *	lat: the location's latitude
+ * RETURNS: the URL
+ */
+QByteArray
+Resolver::Url(double lon, double lat)
+{
+    char query[256];
+
+    snprintf(query, sizeof(query), "/reverse?format=xml&lat=%f&lon=%f&zoom=18&addressdetails=1", lat, lon);
+
+    return baseUrl + query;
+}
+
+/*
+ * NAME: Format
+ * PURPOSE: To turn the response of the reverse geocoder into a location
+ * ARGUMENTS: s: the XML response
+ *	lon: the location's longitude
+ *	lat: the location's latitude
+ * RETURNS: a string describing the location,
+ *	"Unbekannt (lon/lat)" if none of the patterns matches
+ * NOTE: Successfully resolved locations are entered into the cache
+ */
+QString
+Resolver::Format(QString s, double lon, double lat)
+{
+    QString location(Compose(s));
+
+    if (location.length() == 0)
     {
-	location = resolve_pattern(pattern[i], s);
+	cerr << "********\n" << s.toStdString().c_str() << "\n********\n";
+	location = Unknown(lon, lat);
+    }
+    else if (cache != NULL)
+	cache->Insert(lon, lat, location);
+
+    return location;
+}
+
+/*
+ * NAME: Compose
+ * PURPOSE: To compose a location from the first pattern that matches
+ * ARGUMENTS: s: the XML response
+ * RETURNS: the location or an empty string
+ */
+QString
+Resolver::Compose(QString s)
+{
+    return Compose(Fields(s));
+}
+
+/*
+ * NAME: Compose
+ * PURPOSE: To compose a location from the first pattern that matches
+ * ARGUMENTS: fields: the address fields
+ * RETURNS: the location or an empty string
+ */
+QString
+Resolver::Compose(const AddressFields &fields)
+{
+    const QVector<PatternProgram> &programs = compiled_patterns();
+
+    for (QVector<PatternProgram>::const_iterator program = programs.begin(); program != programs.end(); program++)
+    {
+	QString location(run_pattern(*program, fields));
 
 	if (location.length())
-	{
-	    // remove multiple white space that may have been a result
-	    // of an optional tag (eg postcode).
-	    location.replace(QRegExp("\\s+"), " ");
-	    // remove white specae preceding a comma
-	    // that may have been a result of an optional tag (eg house_number)
-	    location.replace(QRegExp("\\s+,"), ",");
-	    break;
-	}
+	    return tidy(location);
     }
 
-    if (location.length() == 0)
+    return QString("");
+}
+
+/*
+ * NAME: Fields
+ * PURPOSE: To collect the fields of a response of the reverse geocoder
+ * ARGUMENTS: xml: the XML response
+ * RETURNS: the text of every element "<tag>text</tag>" without
+ *	attributes or children, keyed by the tag
+ * NOTE: This is a single pass over the response. If a tag occurs
+ *	more than once, the first one counts.
+ */
+AddressFields
+Resolver::Fields(QString xml)
+{
+    AddressFields fields;
+    const QChar *p = xml.constData(), *end = p + xml.length();
+
+    while (p < end)
     {
-	cerr << "********\n" << s.toStdString().c_str() << "\n********\n";
-	QString lons, lats;
-	lons.setNum(lon);
-	lats.setNum(lat);
-	location = QString("Unbekannt") + " (" + lons + "/" + lats + ")";
+	const QChar *tag, *tagEnd, *text, *textEnd;
+
+	// Find the next opening tag
+	while (p < end && *p != '<')
+	    p++;
+	if (++p >= end)
+	    break;
+	if (*p == '/' || *p == '?' || *p == '!')
+	    continue;
+	tag = p;
+	while (p < end && *p != '>' && !p->isSpace() && *p != '/')
+	    p++;
+	if (p >= end || *p != '>')
+	    continue;		// attributes or empty element, not a field
+	tagEnd = p;
+
+	// The text up to the next tag, which must close this one
+	text = ++p;
+	while (p < end && *p != '<' && *p != '>')
+	    p++;
+	textEnd = p;
+	if (textEnd == text || end - p < 3 + (tagEnd - tag) || p[0] != '<' || p[1] != '/'
+	 || p[2 + (tagEnd - tag)] != '>'
+	 || memcmp(p + 2, tag, (tagEnd - tag) * sizeof(QChar)) != 0)
+	    continue;
+
+	QString name(tag, tagEnd - tag);
+	if (!fields.contains(name))
+	    fields.insert(name, QString(text, textEnd - text));
+	p += 3 + (tagEnd - tag);
     }
 
-    free(membuffer.memory);
+    return fields;
+}
 
-    curl_easy_cleanup(curl);
+/*
+ * NAME: Unknown
+ * PURPOSE: To describe a location that could not be resolved
+ * ARGUMENTS: lon: the location's longitude
+ *	lat: the location's latitude
+ * RETURNS: "Unbekannt (lon/lat)"
+ */
+QString
+Resolver::Unknown(double lon, double lat)
+{
+    QString lons, lats;
 
-    return location;
+    lons.setNum(lon);
+    lats.setNum(lat);
+    return QString("Unbekannt") + " (" + lons + "/" + lats + ")";
+}
+
+/*
+ * NAME: Offline
+ * PURPOSE: To reverse geocode a location from the offline database
+ * ARGUMENTS: lon: the location's longitude
+ *	lat: the location's latitude
+ * RETURNS: a string describing the location, formatted by the same
+ *	patterns as the answers of the online geocoder
+ */
+QString
+Resolver::Offline(double lon, double lat)
+{
+    AddressFields fields;
+    QString location;
+
+    Stats::Count(STAT_OFFLINE_LOOKUPS);
+    if (!geodb->Lookup(lon, lat, &fields))
+	return Unknown(lon, lat);
+
+    location = Compose(fields);
+    return location.length() != 0 ? location : Unknown(lon, lat);
 }
 
 /*
@@ -147,69 +440,146 @@ WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
 }
 
 /*
- * NAME: resolve_pattern
- * PURPOSE: To resolve a given pattern using data from an XML structure
+ * NAME: compile_pattern
+ * PURPOSE: To compile a pattern into a list of items
  * ARGUMENTS: pat: pattern, eg "<pedestrian>, <postcode?> <city>, <country>"
- *	xml: XML string to use
- * RETURNS: resolved string if ALL fields in the pattern can be resolved
- *	else returns empty string
+ * RETURNS: the compiled pattern, empty if the pattern is malformed
  */
-QString
-resolve_pattern(QString pat, QString xml)
+static PatternProgram
+compile_pattern(QString pat)
 {
-    //     "<road> <house_number>, <postcode?> <city>, <country>",
+    PatternProgram program;
     int len = pat.length(), i = 0;
-    QString result;
-    // qDebug() << "resolve_pattern(\"" << pat << "\",\"" << "..." << "\")";
-    // qDebug() << "xml=" << xml;
 
     while (i < len)
     {
-        QString c, tag;
-	QRegularExpression re;
+	PatternItem item;
 	int end;
-	bool match, optional;
 
-        c = pat[i];
-	if (c != "<") {
-	    // qDebug() << "  Appending '" << c << "'";
-	    result += c;
-	    i++;
+	item.optional = false;
+	if (pat[i] != '<')
+	{
+	    // Collect the text up to the next field
+	    end = pat.indexOf('<', i);
+	    if (end == -1)
+		end = len;
+	    item.literal = pat.mid(i, end - i);
+	    program.append(item);
+	    i = end;
 	    continue;
 	}
 	end = pat.indexOf('>', i);
 	if (end == -1)
-	    break;
+	    return PatternProgram();
 
-	tag = pat.mid(i+1, end-i-1);
-	// qDebug() << "tag=" << tag;
+	QString tag(pat.mid(i+1, end-i-1));
 	// If the tag ends with a '?', this tag is optional
-	if (optional = tag.endsWith('?')) {
-	    // qDebug() << "    is optional";
+	if ((item.optional = tag.endsWith('?')))
 	    tag.chop(1);	// peel off the '?'
+	item.alternatives = tag.split('|');
+	program.append(item);
+
+	i = end + 1;
+    }
+
+    return program;
+}
+
+/*
+ * NAME: compiled_patterns
+ * PURPOSE: To get pattern[] in compiled form
+ * ARGUMENTS: None
+ * RETURNS: the compiled patterns, in the order of pattern[]
+ * NOTE: The patterns are compiled on first use
+ */
+static const QVector<PatternProgram> &
+compiled_patterns()
+{
+    static const QVector<PatternProgram> programs = [] {
+	QVector<PatternProgram> p;
+
+	for (int i = 0; pattern[i].length() != 0; i++)
+	    p.append(compile_pattern(pattern[i]));
+	return p;
+    }();
+
+    return programs;
+}
+
+/*
+ * NAME: run_pattern
+ * PURPOSE: To resolve a compiled pattern using the fields of a response
+ * ARGUMENTS: program: the compiled pattern
+ *	fields: the address fields
+ * RETURNS: resolved string if ALL fields in the pattern can be resolved
+ *	else returns empty string
+ */
+static QString
+run_pattern(const PatternProgram &program, const AddressFields &fields)
+{
+    QString result;
+
+    if (program.isEmpty())
+	return QString("");
+
+    for (PatternProgram::const_iterator item = program.begin(); item != program.end(); item++)
+    {
+	bool match = false;
+
+	if (item->alternatives.isEmpty())
+	{
+	    result += item->literal;
+	    continue;
 	}
 
-	QStringList alternatives(tag.split('|'));
-	match = false;
-	for (QStringList::iterator alternative = alternatives.begin(); alternative != alternatives.end(); alternative++)
+	for (QStringList::const_iterator alternative = item->alternatives.begin(); alternative != item->alternatives.end(); alternative++)
 	{
-	    // qDebug() << "    checking alternative" << *alternative;
-	    re = QRegularExpression("<" + *alternative + ">([^>]+)</" + *alternative + ">");
-	    if (match = re.match(xml).hasMatch())
+	    AddressFields::const_iterator field = fields.constFind(*alternative);
+
+	    if (field != fields.constEnd())
 	    {
-		// qDebug() << "        has a match" << re.match(xml).captured(1);
+		result += field.value();
+		match = true;
 		break;
 	    }
 	}
-	if (!optional && !match)
-	    break;
+	if (!item->optional && !match)
+	    return QString("");
+    }
 
-	// optional || match
-	if (match)
-	    result += re.match(xml).captured(1);
+    return result;
+}
 
-	i = end + 1;
+/*
+ * NAME: tidy
+ * PURPOSE: To clean up the white space in a composed location
+ * ARGUMENTS: s: the location
+ * RETURNS: the location with runs of white space collapsed into
+ *	one blank and no white space before a comma
+ * NOTE: Optional fields that are missing (eg postcode, house_number)
+ *	leave such white space behind.
+ */
+static QString
+tidy(QString s)
+{
+    QString result;
+    bool space = false;
+
+    result.reserve(s.length());
+    for (QString::const_iterator c = s.begin(); c != s.end(); c++)
+    {
+	if (c->isSpace())
+	{
+	    space = true;
+	    continue;
+	}
+	if (space && *c != ',')
+	    result += ' ';
+	space = false;
+	result += *c;
     }
+    if (space)
+	result += ' ';
 
-    return (i >= len) ? result : QString("");
+    return result;
 }
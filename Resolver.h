@@ -2,11 +2,41 @@
 # define	RESOLVER_H
 
 # include	<QString>
+# include	<QByteArray>
+# include	<QHash>
+# include	"GeoCache.h"
+# include	"GeoDB.h"
+
+// Fields of a reverse geocoder response, eg "road" -> "Hauptstraße"
+typedef QHash<QString,QString> AddressFields;
 
 class Resolver {
 public:
     Resolver();
     ~Resolver();
-    QString Location(double, double);
+    QString Location(double, double, bool online = true);
+    static QByteArray Url(double, double);
+    static QString Format(QString, double, double);
+    static QString Compose(QString);
+    static QString Compose(const AddressFields &);
+    static AddressFields Fields(QString);
+    static QString Unknown(double, double);
+    static QString Offline(double, double);
+    static void SetCache(GeoCache *);
+    static GeoCache *Cache();
+    static void SetOfflineDB(GeoDB *);
+    static GeoDB *OfflineDB();
+    static void SetDelay(float);
+    static void SetBaseUrl(QString);
+    static unsigned long Requests();
+private:
+    static GeoCache *cache;
+    static GeoDB *geodb;
+    static float delay;
+    static QByteArray baseUrl;
+    static unsigned long requests;
 };
+
+# define	DEFAULT_GEOCODER	"http://nominatim.openstreetmap.org"
+# define	USER_AGENT	"Fruity Picture Viewer/0.1"
 # endif // RESOLVER_H
@@ -0,0 +1,190 @@
+# include	<QtConcurrent>
+# include	<QMutexLocker>
+# include	"Scheduler.h"
+
+/*
+ * NAME: Scheduler
+ * PURPOSE: Constructor of the Scheduler class
+ * ARGUMENTS: threads: max number of items running at the same time
+ * RETURNS: Nothing
+ */
+Scheduler::Scheduler(int threads)
+{
+    maxWorkers = threads < 1 ? 1 : threads;
+    pool.setMaxThreadCount(maxWorkers);
+    workers = 0;
+    submitted = 0;
+    cancelled = 0;
+}
+
+/*
+ * NAME: ~Scheduler
+ * PURPOSE: Destructor of the Scheduler class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Queued items are dropped, running ones are waited for
+ */
+Scheduler::~Scheduler()
+{
+    CancelAll();
+    pool.waitForDone();
+}
+
+/*
+ * NAME: Submit
+ * PURPOSE: To queue a work item
+ * ARGUMENTS: key: identifies the item
+ *	priority: lower is more urgent
+ *	work: what to do, run in one of the threads
+ * RETURNS: Nothing
+ * NOTE: If an item with that key is already queued, only its priority
+ *	is changed.
+ */
+void
+Scheduler::Submit(const QString &key, int priority, Work work)
+{
+    QMutexLocker locker(&mutex);
+    QHash<QString,Job>::iterator job = jobs.find(key);
+
+    if (job != jobs.end())
+    {
+	order.remove(job->rank);
+	job->rank.first = priority;
+	order.insert(job->rank, key);
+	return;
+    }
+
+    Job j;
+    j.rank = Rank(priority, submitted++);
+    j.work = work;
+    jobs.insert(key, j);
+    order.insert(j.rank, key);
+
+    if (workers < maxWorkers)
+    {
+	workers++;
+	QtConcurrent::run(&pool, [this] { drain(); });
+    }
+}
+
+/*
+ * NAME: Reprioritise
+ * PURPOSE: To change the priority of a queued item
+ * ARGUMENTS: key: identifies the item
+ *	priority: the new priority
+ * RETURNS: true if the item was still queued
+ */
+bool
+Scheduler::Reprioritise(const QString &key, int priority)
+{
+    QMutexLocker locker(&mutex);
+    QHash<QString,Job>::iterator job = jobs.find(key);
+
+    if (job == jobs.end())
+	return false;
+
+    order.remove(job->rank);
+    job->rank.first = priority;
+    order.insert(job->rank, key);
+    return true;
+}
+
+/*
+ * NAME: Queued
+ * PURPOSE: To find out if an item is still waiting for a thread
+ * ARGUMENTS: key: identifies the item
+ * RETURNS: true if it is queued
+ */
+bool
+Scheduler::Queued(const QString &key)
+{
+    QMutexLocker locker(&mutex);
+
+    return jobs.contains(key);
+}
+
+/*
+ * NAME: CancelExcept
+ * PURPOSE: To drop the queued items that are no longer wanted
+ * ARGUMENTS: keep: the keys of the items to keep
+ * RETURNS: the keys of the dropped items
+ * NOTE: Items that are already running are not affected
+ */
+QStringList
+Scheduler::CancelExcept(const QSet<QString> &keep)
+{
+    QMutexLocker locker(&mutex);
+    QStringList dropped;
+
+    for (QHash<QString,Job>::iterator job = jobs.begin(); job != jobs.end(); )
+    {
+	if (keep.contains(job.key()))
+	{
+	    job++;
+	    continue;
+	}
+	dropped.append(job.key());
+	order.remove(job->rank);
+	job = jobs.erase(job);
+    }
+    cancelled += dropped.length();
+
+    return dropped;
+}
+
+/*
+ * NAME: CancelAll
+ * PURPOSE: To drop all queued items
+ * ARGUMENTS: None
+ * RETURNS: the keys of the dropped items
+ */
+QStringList
+Scheduler::CancelAll()
+{
+    return CancelExcept(QSet<QString>());
+}
+
+/*
+ * NAME: Cancelled
+ * PURPOSE: Access method of the number of items dropped
+ * ARGUMENTS: None
+ * RETURNS: number of cancelled items
+ */
+quint64
+Scheduler::Cancelled()
+{
+    QMutexLocker locker(&mutex);
+
+    return cancelled;
+}
+
+/*
+ * NAME: drain
+ * PURPOSE: To run queued items, most urgent first, until there are none
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Runs in a pool thread. The item to run is chosen only when the
+ *	thread is free, so priorities changed meanwhile are honoured.
+ */
+void
+Scheduler::drain()
+{
+    while (1)
+    {
+	Work work;
+
+	mutex.lock();
+	if (order.isEmpty())
+	{
+	    workers--;
+	    mutex.unlock();
+	    return;
+	}
+	QMap<Rank,QString>::iterator first = order.begin();
+	work = jobs.take(first.value()).work;
+	order.erase(first);
+	mutex.unlock();
+
+	work();
+    }
+}
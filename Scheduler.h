@@ -0,0 +1,50 @@
+# ifndef	SCHEDULER_H
+# define	SCHEDULER_H
+
+# include	<functional>
+# include	<QHash>
+# include	<QMap>
+# include	<QPair>
+# include	<QSet>
+# include	<QString>
+# include	<QStringList>
+# include	<QMutex>
+# include	<QThreadPool>
+
+/*
+ * Runs work items on a pool of threads, most urgent first.
+ * Every item has a key, a queued item can be given a new priority
+ * or be cancelled by its key until a thread has picked it up.
+ * Lower numbers are more urgent, items of equal priority run
+ * in the order they were submitted.
+ */
+class Scheduler {
+public:
+    typedef std::function<void()> Work;
+    Scheduler(int threads);
+    ~Scheduler();
+    void Submit(const QString &key, int priority, Work work);
+    bool Reprioritise(const QString &key, int priority);
+    bool Queued(const QString &key);
+    QStringList CancelExcept(const QSet<QString> &keep);
+    QStringList CancelAll();
+    quint64 Cancelled();
+private:
+    Scheduler(const Scheduler &);
+    Scheduler &operator=(const Scheduler &);
+    typedef QPair<int,quint64> Rank;	// priority, then submission order
+    struct Job {
+	Rank rank;
+	Work work;
+    };
+    void drain();
+    QMutex mutex;			// protects everything below
+    QHash<QString,Job> jobs;
+    QMap<Rank,QString> order;
+    quint64 submitted;
+    quint64 cancelled;
+    int workers;			// threads draining the queue
+    int maxWorkers;
+    QThreadPool pool;
+};
+# endif // SCHEDULER_H
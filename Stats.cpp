@@ -0,0 +1,280 @@
+# include	<unistd.h>
+# include	<iomanip>
+# include	<QFile>
+# include	<QMutexLocker>
+# include	"Stats.h"
+
+using namespace std;
+
+// Names of the counters and phases, in the order of their enums
+static const char *counterNames[STAT_COUNTERS] = {
+    "directories", "files_listed", "files_fresh", "files_scanned", "exif_bytes",
+    "thumbs_inline", "thumbs_generated", "thumb_bytes",
+    "geocache_hits", "geocache_misses", "offline_lookups", "http_requests", "http_failures",
+    "thumbcache_hits", "thumbcache_misses"
+};
+static const char *phaseNames[PHASE_PHASES] = {
+    "load", "createBox", "refresh", "list", "scan", "exif", "thumbnail", "index",
+    "cluster", "resolve", "http", "sleep", "save", "catalog"
+};
+
+bool Stats::enabled = false;
+bool Stats::tracing = false;
+QElapsedTimer Stats::clock;
+QAtomicInteger<qint64> Stats::counters[STAT_COUNTERS];
+QAtomicInteger<qint64> Stats::times[PHASE_PHASES];
+QAtomicInteger<qint64> Stats::calls[PHASE_PHASES];
+QAtomicInteger<qint64> Stats::histogram[STATS_BUCKETS];
+QMutex Stats::mutex;
+QVector<Stats::Event> Stats::events;
+
+/*
+ * NAME: Enable
+ * PURPOSE: To start counting and timing
+ * ARGUMENTS: trace: keep every timed phase as a trace event as well
+ * RETURNS: Nothing
+ * NOTE: To be called before any other thread is started
+ */
+void
+Stats::Enable(bool trace)
+{
+    clock.start();
+    tracing = trace;
+    enabled = true;
+}
+
+/*
+ * NAME: Enabled
+ * PURPOSE: Access method of whether anything is recorded
+ * ARGUMENTS: None
+ * RETURNS: true if Enable() has been called
+ */
+bool
+Stats::Enabled()
+{
+    return enabled;
+}
+
+/*
+ * NAME: Now
+ * PURPOSE: To get the time a phase starts
+ * ARGUMENTS: None
+ * RETURNS: nanoseconds since Enable()
+ */
+qint64
+Stats::Now()
+{
+    return clock.nsecsElapsed();
+}
+
+/*
+ * NAME: Count
+ * PURPOSE: To add to a counter
+ * ARGUMENTS: counter: which one
+ *	n: how much
+ * RETURNS: Nothing
+ * NOTE: This is safe to call from any thread
+ */
+void
+Stats::Count(StatCounter counter, qint64 n)
+{
+    if (enabled)
+	counters[counter].fetchAndAddRelaxed(n);
+}
+
+/*
+ * NAME: Time
+ * PURPOSE: To add the time of a phase
+ * ARGUMENTS: phase: which one
+ *	start: when it started, see Now()
+ *	nsecs: how long it took
+ * RETURNS: Nothing
+ * NOTE: This is safe to call from any thread. Once STATS_MAX_EVENTS
+ *	events have been kept, only the totals are added to.
+ */
+void
+Stats::Time(StatPhase phase, qint64 start, qint64 nsecs)
+{
+    if (!enabled)
+	return;
+
+    times[phase].fetchAndAddRelaxed(nsecs);
+    calls[phase].fetchAndAddRelaxed(1);
+    if (tracing)
+    {
+	Event event = { start, nsecs, thread(), phase };
+	QMutexLocker locker(&mutex);
+
+	if (events.size() < STATS_MAX_EVENTS)
+	    events.append(event);
+    }
+}
+
+/*
+ * NAME: Latency
+ * PURPOSE: To add a request to the HTTP latency histogram
+ * ARGUMENTS: nsecs: how long the request took
+ * RETURNS: Nothing
+ */
+void
+Stats::Latency(qint64 nsecs)
+{
+    int bucket = 0;
+
+    if (!enabled)
+	return;
+
+    for (qint64 ms = nsecs / 1000000; ms > 0 && bucket < STATS_BUCKETS - 1; ms >>= 1)
+	bucket++;
+    histogram[bucket].fetchAndAddRelaxed(1);
+}
+
+/*
+ * NAME: thread
+ * PURPOSE: To number the threads for the trace
+ * ARGUMENTS: None
+ * RETURNS: a small number, the same for every call from a thread
+ */
+int
+Stats::thread()
+{
+    static QAtomicInt next(1);
+    static thread_local int number = 0;
+
+    if (number == 0)
+	number = next.fetchAndAddRelaxed(1);
+    return number;
+}
+
+/*
+ * NAME: Report
+ * PURPOSE: To print a summary of the counters and timers
+ * ARGUMENTS: out: where to print it
+ * RETURNS: Nothing
+ * NOTE: Phases and counters that never came up are left out
+ */
+void
+Stats::Report(ostream &out)
+{
+    out << "phase            calls     total ms      avg us   (summed over all threads)" << endl;
+    for (int p = 0; p < PHASE_PHASES; p++)
+    {
+	qint64 n = calls[p].loadAcquire(), t = times[p].loadAcquire();
+
+	if (n == 0)
+	    continue;
+	out << left << setw(12) << phaseNames[p] << right << setw(10) << n
+	    << setw(13) << t / 1000000 << setw(12) << t / n / 1000 << endl;
+    }
+
+    for (int c = 0; c < STAT_COUNTERS; c++)
+	if (counters[c].loadAcquire() != 0)
+	    out << left << setw(20) << counterNames[c] << right << setw(15) << counters[c].loadAcquire() << endl;
+
+    int last = STATS_BUCKETS - 1;
+    while (last >= 0 && histogram[last].loadAcquire() == 0)
+	last--;
+    if (last >= 0)
+	out << "HTTP latency:" << endl;
+    for (int b = 0; b <= last; b++)
+    {
+	if (b == STATS_BUCKETS - 1)
+	    out << "  >= " << right << setw(6) << (1 << (b - 1)) << " ms";
+	else
+	    out << "  <  " << right << setw(6) << (1 << b) << " ms";
+	out << setw(10) << histogram[b].loadAcquire() << endl;
+    }
+    out << left;
+}
+
+/*
+ * NAME: WriteJson
+ * PURPOSE: To write the counters and timers as JSON
+ * ARGUMENTS: filename: where to write them
+ * RETURNS: true on success
+ * NOTE: {"phases": {"exif": {"calls": 12, "nsecs": 3456}, ...},
+ *	"counters": {"files_scanned": 12, ...},
+ *	"http_latency_ms": {"1": 0, "2": 3, ...}}
+ *	The latency buckets are named by their upper bound,
+ *	the last one is "inf".
+ */
+bool
+Stats::WriteJson(QString filename)
+{
+    QFile file(filename);
+    QByteArray json("{\n  \"phases\": {");
+
+    for (int p = 0; p < PHASE_PHASES; p++)
+	json += QString("%1\n    \"%2\": {\"calls\": %3, \"nsecs\": %4}").arg(p ? "," : "")
+	    .arg(phaseNames[p]).arg(calls[p].loadAcquire()).arg(times[p].loadAcquire()).toUtf8();
+    json += "\n  },\n  \"counters\": {";
+    for (int c = 0; c < STAT_COUNTERS; c++)
+	json += QString("%1\n    \"%2\": %3").arg(c ? "," : "")
+	    .arg(counterNames[c]).arg(counters[c].loadAcquire()).toUtf8();
+    json += "\n  },\n  \"http_latency_ms\": {";
+    for (int b = 0; b < STATS_BUCKETS; b++)
+	json += QString("%1\"%2\": %3").arg(b ? ", " : "")
+	    .arg(b == STATS_BUCKETS - 1 ? QString("inf") : QString::number(1 << b))
+	    .arg(histogram[b].loadAcquire()).toUtf8();
+    json += "}\n}\n";
+
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(json) == json.length();
+}
+
+/*
+ * NAME: WriteTrace
+ * PURPOSE: To write the trace events in the Chrome trace event format
+ * ARGUMENTS: filename: where to write them
+ * RETURNS: true on success
+ * NOTE: Every timed phase is a complete ("X") event, the times
+ *	are in microseconds. The file can be loaded into chrome://tracing
+ *	or ui.perfetto.dev.
+ */
+bool
+Stats::WriteTrace(QString filename)
+{
+    QFile file(filename);
+    QMutexLocker locker(&mutex);
+    qint64 pid = getpid();
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	return false;
+
+    file.write("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int i = 0; i < events.size(); i++)
+    {
+	const Event &e = events.at(i);
+
+	file.write(QString("%1{\"name\": \"%2\", \"cat\": \"fpv\", \"ph\": \"X\", \"ts\": %3, \"dur\": %4, \"pid\": %5, \"tid\": %6}\n")
+		   .arg(i ? "," : "").arg(phaseNames[e.phase])
+		   .arg(e.start / 1000.0, 0, 'f', 3).arg(e.duration / 1000.0, 0, 'f', 3)
+		   .arg(pid).arg(e.thread).toUtf8());
+    }
+    file.write("]}\n");
+
+    return file.error() == QFile::NoError;
+}
+
+/*
+ * NAME: StatTimer
+ * PURPOSE: Constructor of the StatTimer class, starts the timer
+ * ARGUMENTS: new_phase: the phase to be timed
+ * RETURNS: Nothing
+ */
+StatTimer::StatTimer(StatPhase new_phase)
+{
+    phase = new_phase;
+    start = Stats::Enabled() ? Stats::Now() : -1;
+}
+
+/*
+ * NAME: ~StatTimer
+ * PURPOSE: Destructor of the StatTimer class, adds the time of the phase
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+StatTimer::~StatTimer()
+{
+    if (start >= 0)
+	Stats::Time(phase, start, Stats::Now() - start);
+}
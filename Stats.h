@@ -0,0 +1,106 @@
+# ifndef	STATS_H
+# define	STATS_H
+
+# include	<iostream>
+# include	<QAtomicInteger>
+# include	<QElapsedTimer>
+# include	<QMutex>
+# include	<QVector>
+# include	<QString>
+
+// What is counted
+enum StatCounter {
+    STAT_DIRECTORIES,		// directories listed
+    STAT_FILES_LISTED,		// images found in them
+    STAT_FILES_FRESH,		// images whose index record was up to date
+    STAT_FILES_SCANNED,		// images whose Exif data was read
+    STAT_EXIF_BYTES,		// bytes of Exif segments mapped
+    STAT_THUMBS_INLINE,		// thumbnails left in the image
+    STAT_THUMBS_GENERATED,	// thumbnails made from the image itself
+    STAT_THUMB_BYTES,		// bytes appended to the thumbnail packs
+    STAT_GEOCACHE_HITS,
+    STAT_GEOCACHE_MISSES,
+    STAT_OFFLINE_LOOKUPS,	// locations from the offline database
+    STAT_HTTP_REQUESTS,
+    STAT_HTTP_FAILURES,		// transfer errors and status codes other than 200
+    STAT_THUMBCACHE_HITS,	// decoded thumbnails painted from the cache
+    STAT_THUMBCACHE_MISSES,
+    STAT_COUNTERS
+};
+
+// What is timed, by StatTimer
+enum StatPhase {
+    PHASE_LOAD,			// Viewer: index, thumbnails and locations read
+    PHASE_CREATEBOX,		// Viewer: the thumbnail view built
+    PHASE_REFRESH,		// Viewer: the model updated with new locations
+    PHASE_LIST,			// a directory listed
+    PHASE_SCAN,			// an image scanned, all of it
+    PHASE_EXIF,			// its Exif data parsed
+    PHASE_THUMBNAIL,		// its thumbnail oriented, generated and stored
+    PHASE_INDEX,		// the index of a directory written
+    PHASE_CLUSTER,		// the coordinates clustered
+    PHASE_RESOLVE,		// waiting for the reverse geocoder
+    PHASE_HTTP,			// a reverse geocoding request
+    PHASE_SLEEP,		// the delay between two requests
+    PHASE_SAVE,			// the locations saved
+    PHASE_CATALOG,		// the global catalog updated
+    PHASE_PHASES
+};
+
+// The HTTP latency histogram has buckets of < 1, < 2, < 4, ... ms
+# define	STATS_BUCKETS	16
+
+// At most this many trace events are kept
+# define	STATS_MAX_EVENTS	1000000
+
+/*
+ * Counters and timers of where the time goes. Nothing is recorded
+ * unless Enable() has been called, so the counters and timers can
+ * stay in the code at the cost of a test each. The times of a phase
+ * are summed over all threads. With tracing, every timed phase is
+ * also kept as an event for the Chrome trace viewer (chrome://tracing).
+ */
+class Stats {
+public:
+    static void Enable(bool trace = false);
+    static bool Enabled();
+    static void Count(StatCounter counter, qint64 n = 1);
+    static void Time(StatPhase phase, qint64 start, qint64 nsecs);
+    static void Latency(qint64 nsecs);
+    static qint64 Now();
+    static void Report(std::ostream &out);
+    static bool WriteJson(QString filename);
+    static bool WriteTrace(QString filename);
+private:
+    struct Event {
+	qint64 start;		// nanoseconds since Enable()
+	qint64 duration;
+	int thread;
+	StatPhase phase;
+    };
+    static int thread();
+    static bool enabled;
+    static bool tracing;
+    static QElapsedTimer clock;
+    static QAtomicInteger<qint64> counters[STAT_COUNTERS];
+    static QAtomicInteger<qint64> times[PHASE_PHASES];	// nanoseconds
+    static QAtomicInteger<qint64> calls[PHASE_PHASES];
+    static QAtomicInteger<qint64> histogram[STATS_BUCKETS];
+    static QMutex mutex;	// protects events
+    static QVector<Event> events;
+};
+
+/*
+ * Times a phase from its construction to the end of the scope.
+ */
+class StatTimer {
+public:
+    StatTimer(StatPhase phase);
+    ~StatTimer();
+private:
+    StatTimer(const StatTimer &);
+    StatTimer &operator=(const StatTimer &);
+    StatPhase phase;
+    qint64 start;		// -1 if not enabled
+};
+# endif // STATS_H
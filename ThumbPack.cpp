@@ -0,0 +1,568 @@
+# include	<sys/types.h>
+# include	<sys/stat.h>
+# include	<sys/mman.h>
+# include	<sys/vfs.h>
+# include	<sys/file.h>
+# include	<fcntl.h>
+# include	<unistd.h>
+# include	<string.h>
+# include	<QFile>
+# include	<QFileInfo>
+# include	<QSaveFile>
+# include	<QMutexLocker>
+# include	"ThumbPack.h"
+
+/*
+ * Layout of the pack:
+ *	PackHeader
+ *	entries, each one PackEntry, the UTF-8 file name and the JPEG data
+ * The name is there so a thumbnail can be checked against its record.
+ */
+struct PackHeader {
+    char magic[8];
+    quint32 version;
+    quint32 reserved;
+};
+
+struct PackEntry {
+    quint32 nameLength;
+    quint32 dataLength;
+};
+
+static const char packMagic[8] = { 'F', 'P', 'V', 'T', 'H', 'U', 'M', 'B' };
+# define	PACK_VERSION	1
+
+// Offsets are stored as 32 bits
+# define	PACK_MAX_SIZE	0xFFFFFFFFULL
+
+/*
+ * Network and user space filesystems (statfs() f_type): a mapped file
+ * there can change under our feet, which is a SIGBUS rather than a
+ * read error, and every page fault is a round trip.
+ */
+static const unsigned long remoteFilesystems[] = {
+    0x6969,		// NFS
+    0x517B,		// SMB
+    0xFF534D42,		// CIFS
+    0xFE534D42,		// SMB2
+    0x65735546,		// FUSE (sshfs etc.)
+    0x01021997,		// 9P
+    0x00C36400,		// Ceph
+    0x73757245,		// Coda
+    0x5346414F,		// AFS
+};
+
+/*
+ * NAME: ThumbRef
+ * PURPOSE: Constructor of the ThumbRef class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+ThumbRef::ThumbRef()
+{
+    data = NULL;
+    length = 0;
+    map = NULL;
+    mapLength = 0;
+}
+
+/*
+ * NAME: ~ThumbRef
+ * PURPOSE: Destructor of the ThumbRef class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Unmaps the image, if the thumbnail is embedded in it
+ */
+ThumbRef::~ThumbRef()
+{
+    if (map != NULL)
+	munmap(map, mapLength);
+}
+
+/*
+ * NAME: Data
+ * PURPOSE: Access method of the thumbnail
+ * ARGUMENTS: None
+ * RETURNS: pointer to the JPEG data, valid as long as the ThumbRef
+ *	and the ThumbPack live
+ */
+const unsigned char *
+ThumbRef::Data() const
+{
+    return data;
+}
+
+/*
+ * NAME: Length
+ * PURPOSE: Access method of the length of the thumbnail
+ * ARGUMENTS: None
+ * RETURNS: length of the JPEG data
+ */
+quint32
+ThumbRef::Length() const
+{
+    return length;
+}
+
+/*
+ * NAME: ThumbPack
+ * PURPOSE: Constructor of the ThumbPack class
+ * ARGUMENTS: filename: pathname of the pack (eg ".fpv-thumbs")
+ *	writable: true to append thumbnails
+ * RETURNS: Nothing
+ * NOTE: The pack is mapped as it is now; thumbnails appended later
+ *	are only seen by a ThumbPack constructed afterwards. On a
+ *	network filesystem it is read with pread() instead, the same
+ *	way: a mapping there faults if another client changes the file.
+ *	A damaged pack is started afresh when opened for writing. This
+ *	is done under the lock of the pack, so a pack another process
+ *	has just created is not mistaken for one.
+ */
+ThumbPack::ThumbPack(QString filename, bool writable)
+{
+    QByteArray name(QFile::encodeName(filename));
+    PackHeader header;
+    struct stat st;
+    int f;
+
+    pathname = QFileInfo(filename).absoluteFilePath();
+    directory = QFileInfo(filename).absolutePath();
+    fd = -1;
+    map = NULL;
+    mapLength = 0;
+    readFd = -1;
+    readLength = 0;
+    end = 0;
+
+    if ((f = open(name.constData(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644)) == -1)
+	return;
+    if ((writable && flock(f, LOCK_EX) == -1) || fstat(f, &st) == -1)
+    {
+	close(f);
+	return;
+    }
+
+    if ((size_t) st.st_size < sizeof(header)
+     || pread(f, &header, sizeof(header), 0) != sizeof(header)
+     || memcmp(header.magic, packMagic, sizeof(packMagic)) != 0
+     || header.version != PACK_VERSION)
+    {
+	if (!writable)
+	{
+	    close(f);
+	    return;
+	}
+	memcpy(header.magic, packMagic, sizeof(packMagic));
+	header.version = PACK_VERSION;
+	header.reserved = 0;
+	if (ftruncate(f, 0) == -1 || pwrite(f, &header, sizeof(header), 0) != sizeof(header))
+	{
+	    close(f);
+	    return;
+	}
+	st.st_size = sizeof(header);
+    }
+    end = st.st_size;
+
+    if (st.st_size > (off_t) sizeof(header) && CanReference(directory))
+    {
+	void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, f, 0);
+
+	if (m != MAP_FAILED)
+	{
+	    map = (unsigned char *) m;
+	    mapLength = st.st_size;
+	}
+    }
+    else if (st.st_size > (off_t) sizeof(header) && (readFd = open(name.constData(), O_RDONLY)) != -1)
+	readLength = st.st_size;
+
+    if (writable)
+    {
+	flock(f, LOCK_UN);
+	fd = f;
+    }
+    else
+    {
+	close(f);
+	end = map != NULL ? mapLength : readLength;
+    }
+}
+
+/*
+ * NAME: ~ThumbPack
+ * PURPOSE: Destructor of the ThumbPack class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+ThumbPack::~ThumbPack()
+{
+    if (map != NULL)
+	munmap(map, mapLength);
+    if (readFd != -1)
+	close(readFd);
+    if (fd != -1)
+	close(fd);
+}
+
+/*
+ * NAME: IsValid
+ * PURPOSE: To check whether the pack could be opened
+ * ARGUMENTS: None
+ * RETURNS: true if thumbnails can be read (and appended, if writable)
+ */
+bool
+ThumbPack::IsValid() const
+{
+    return fd != -1 || map != NULL || readFd != -1;
+}
+
+/*
+ * NAME: Key
+ * PURPOSE: To name a thumbnail uniquely across directories
+ * ARGUMENTS: name: file name of the image
+ * RETURNS: pathname of the pack, the file name and where the thumbnail is
+ * NOTE: A thumbnail that is redone while the directory is shown gets
+ *	a new offset, and so a new key in a pack opened afterwards.
+ */
+QString
+ThumbPack::Key(const QString &name) const
+{
+    QHash<QString,Location>::const_iterator t = table.find(name);
+
+    if (t == table.end())
+	return pathname + ":" + name;
+
+    return pathname + ":" + name + "@" + QString::number(t.value().offset);
+}
+
+/*
+ * NAME: Size
+ * PURPOSE: Access method of the size of the pack
+ * ARGUMENTS: None
+ * RETURNS: size in bytes, including what has been appended
+ */
+quint64
+ThumbPack::Size() const
+{
+    return end;
+}
+
+/*
+ * NAME: EntrySize
+ * PURPOSE: To find out how much room a thumbnail takes in the pack
+ * ARGUMENTS: name: UTF-8 file name of the image
+ *	length: length of the thumbnail
+ * RETURNS: size in bytes
+ */
+quint64
+ThumbPack::EntrySize(const QByteArray &name, quint32 length)
+{
+    return sizeof(PackEntry) + name.length() + length;
+}
+
+/*
+ * NAME: Append
+ * PURPOSE: To add a thumbnail to the pack
+ * ARGUMENTS: name: UTF-8 file name of the image
+ *	data, length: the thumbnail
+ *	offset: where to store the offset of the thumbnail in the pack
+ * RETURNS: true on success
+ * NOTE: This may be called from several threads at once. Other
+ *	processes may append to the same pack, so the thumbnail goes
+ *	to the end of the pack as it is now, under its lock.
+ */
+bool
+ThumbPack::Append(const QByteArray &name, const unsigned char *data, size_t length, quint32 *offset)
+{
+    QMutexLocker locker(&mutex);
+    PackEntry entry;
+    QByteArray buffer;
+    off_t at;
+
+    if (fd == -1 || !lock())
+	return false;
+
+    if ((at = lseek(fd, 0, SEEK_END)) < (off_t) sizeof(PackHeader) || (quint64) at + EntrySize(name, length) > PACK_MAX_SIZE)
+    {
+	flock(fd, LOCK_UN);
+	return false;
+    }
+
+    entry.nameLength = name.length();
+    entry.dataLength = length;
+    buffer.reserve(EntrySize(name, length));
+    buffer.append((const char *) &entry, sizeof(entry));
+    buffer.append(name);
+    buffer.append((const char *) data, length);
+    bool ok = pwrite(fd, buffer.constData(), buffer.length(), at) == buffer.length();
+    flock(fd, LOCK_UN);
+    if (!ok)
+	return false;
+
+    *offset = at;
+    end = at + buffer.length();
+    return true;
+}
+
+/*
+ * NAME: lock
+ * PURPOSE: To lock the pack for appending
+ * ARGUMENTS: None
+ * RETURNS: true if fd is the pack and is locked
+ * NOTE: Called with the mutex held. A pack that has been compacted
+ *	since it was opened has been replaced, the new one is opened
+ *	and appended to instead.
+ */
+bool
+ThumbPack::lock()
+{
+    QByteArray name(QFile::encodeName(pathname));
+    struct stat locked, current;
+    int f;
+
+    while (1)
+    {
+	if (flock(fd, LOCK_EX) == -1 || fstat(fd, &locked) == -1)
+	    return false;
+	if (stat(name.constData(), &current) == 0 && current.st_dev == locked.st_dev && current.st_ino == locked.st_ino)
+	    return true;
+	flock(fd, LOCK_UN);
+	if ((f = open(name.constData(), O_RDWR)) == -1)
+	    return false;
+	close(fd);
+	fd = f;
+    }
+}
+
+/*
+ * NAME: Entry
+ * PURPOSE: To get a thumbnail by its offset
+ * ARGUMENTS: offset: offset of the thumbnail in the pack
+ *	name: UTF-8 file name of the image it must belong to
+ *	data: where to store a pointer to the thumbnail
+ *	length: where to store the length of the thumbnail
+ *	copy: where to read the thumbnail to if the pack is not mapped,
+ *		NULL to only check it is there
+ * RETURNS: true if there is a thumbnail of that image at that offset
+ * NOTE: data points into the mapped pack or into copy; it is NULL if
+ *	the pack is not mapped and there is no copy.
+ */
+bool
+ThumbPack::Entry(quint32 offset, const QByteArray &name, const unsigned char **data, quint32 *length, QByteArray *copy) const
+{
+    PackEntry entry;
+    quint64 size = map != NULL ? mapLength : readLength;
+    QByteArray head;
+
+    if ((map == NULL && readFd == -1) || offset < sizeof(PackHeader) || (quint64) offset + sizeof(entry) + name.length() > size)
+	return false;
+
+    if (map != NULL)
+	head = QByteArray::fromRawData((const char *) map + offset, sizeof(entry) + name.length());
+    else
+    {
+	head.resize(sizeof(entry) + name.length());
+	if (pread(readFd, head.data(), head.length(), offset) != head.length())
+	    return false;
+    }
+
+    memcpy(&entry, head.constData(), sizeof(entry));
+    if (entry.nameLength != (quint32) name.length()
+     || (quint64) offset + EntrySize(name, entry.dataLength) > size
+     || memcmp(head.constData() + sizeof(entry), name.constData(), name.length()) != 0)
+	return false;
+
+    *length = entry.dataLength;
+    if (map != NULL)
+	*data = map + offset + sizeof(entry) + entry.nameLength;
+    else if (copy != NULL)
+    {
+	copy->resize(entry.dataLength);
+	if (pread(readFd, copy->data(), entry.dataLength, offset + sizeof(entry) + entry.nameLength) != (ssize_t) entry.dataLength)
+	    return false;
+	*data = (const unsigned char *) copy->constData();
+    }
+    else
+	*data = NULL;
+    return true;
+}
+
+/*
+ * NAME: Insert
+ * PURPOSE: To tell a reader where the thumbnail of an image is
+ * ARGUMENTS: name: file name of the image
+ *	record: its record, images without a thumbnail are ignored
+ * RETURNS: Nothing
+ * NOTE: Not thread-safe, fill in the table before handing out the pack
+ */
+void
+ThumbPack::Insert(const QString &name, const MetaRecord &record)
+{
+    Location location;
+
+    if (record.thumbnailKind != THUMB_PACK && record.thumbnailKind != THUMB_INLINE)
+	return;
+
+    location.kind = record.thumbnailKind;
+    location.offset = record.thumbnailOffset;
+    location.length = record.thumbnailLength;
+    table.insert(name, location);
+}
+
+/*
+ * NAME: Find
+ * PURPOSE: To get the thumbnail of an image
+ * ARGUMENTS: name: file name of the image
+ *	thumbnail: where to store the thumbnail
+ * RETURNS: true if the image has a thumbnail
+ * NOTE: An embedded thumbnail is mapped from the image; it must
+ *	still be inside the file and look like a JPEG, in case the
+ *	image has been replaced since it was indexed.
+ */
+bool
+ThumbPack::Find(const QString &name, ThumbRef *thumbnail) const
+{
+    QHash<QString,Location>::const_iterator t = table.find(name);
+    struct stat st;
+    size_t start;
+    void *m;
+    int f;
+
+    if (t == table.end())
+	return false;
+
+    if (t.value().kind == THUMB_PACK)
+	return Entry(t.value().offset, name.toUtf8(), &thumbnail->data, &thumbnail->length, &thumbnail->copy);
+
+    if ((f = open(QFile::encodeName(directory + "/" + name).constData(), O_RDONLY)) == -1)
+	return false;
+    if (fstat(f, &st) == -1 || (quint64) t.value().offset + t.value().length > (quint64) st.st_size)
+    {
+	close(f);
+	return false;
+    }
+    start = t.value().offset & ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+    m = mmap(NULL, t.value().offset - start + t.value().length, PROT_READ, MAP_PRIVATE, f, start);
+    close(f);
+    if (m == MAP_FAILED)
+	return false;
+
+    thumbnail->map = m;
+    thumbnail->mapLength = t.value().offset - start + t.value().length;
+    thumbnail->data = (const unsigned char *) m + (t.value().offset - start);
+    thumbnail->length = t.value().length;
+
+    return thumbnail->length >= 2 && thumbnail->data[0] == 0xFF && thumbnail->data[1] == 0xD8;
+}
+
+/*
+ * NAME: Compact
+ * PURPOSE: To drop the thumbnails no record refers to any more
+ * ARGUMENTS: filename: pathname of the pack
+ *	records: the records of the images in the directory, keyed
+ *		by the UTF-8 file name; their offsets are updated
+ * RETURNS: true on success, the records are unchanged on failure
+ * NOTE: The new pack replaces the old one atomically. The records
+ *	must be saved afterwards; if that does not happen, Entry()
+ *	notices that the offsets no longer match.
+ *	The old pack is locked meanwhile, so nobody appends to it;
+ *	a writer that was waiting appends to the new one.
+ */
+bool
+ThumbPack::Compact(QString filename, QMap<QByteArray,MetaRecord> *records)
+{
+    int f = open(QFile::encodeName(filename).constData(), O_RDONLY);
+
+    if (f == -1)
+	return false;
+    if (flock(f, LOCK_EX) == -1)
+    {
+	close(f);
+	return false;
+    }
+
+    bool ok = compact(filename, records);
+    close(f);
+    return ok;
+}
+
+/*
+ * NAME: compact
+ * PURPOSE: To copy the thumbnails still referred to into a new pack
+ * ARGUMENTS: filename: pathname of the pack, locked
+ *	records: as for Compact()
+ * RETURNS: true on success, the records are unchanged on failure
+ */
+bool
+ThumbPack::compact(QString filename, QMap<QByteArray,MetaRecord> *records)
+{
+    ThumbPack old(filename);
+    QSaveFile file(filename);
+    QMap<QByteArray,MetaRecord> compacted(*records);
+    PackHeader header;
+    quint64 offset;
+
+    if (!old.IsValid() || !file.open(QIODevice::WriteOnly))
+	return false;
+
+    memcpy(header.magic, packMagic, sizeof(packMagic));
+    header.version = PACK_VERSION;
+    header.reserved = 0;
+    file.write((const char *) &header, sizeof(header));
+    offset = sizeof(header);
+
+    for (QMap<QByteArray,MetaRecord>::iterator r = compacted.begin(); r != compacted.end(); r++)
+    {
+	const unsigned char *data;
+	quint32 length;
+	QByteArray copy;
+
+	if (r.value().thumbnailKind != THUMB_PACK)
+	    continue;
+	if (!old.Entry(r.value().thumbnailOffset, r.key(), &data, &length, &copy))
+	{
+	    r.value().thumbnailKind = THUMB_NONE;
+	    continue;
+	}
+
+	PackEntry entry;
+	entry.nameLength = r.key().length();
+	entry.dataLength = length;
+	file.write((const char *) &entry, sizeof(entry));
+	file.write(r.key());
+	file.write((const char *) data, length);
+	r.value().thumbnailOffset = offset;
+	r.value().thumbnailLength = length;
+	offset += EntrySize(r.key(), length);
+    }
+
+    if (!file.commit())
+	return false;
+
+    *records = compacted;
+    return true;
+}
+
+/*
+ * NAME: CanReference
+ * PURPOSE: To decide whether embedded thumbnails can be used in place
+ * ARGUMENTS: directory: directory of the images
+ * RETURNS: true if the images are on a local filesystem
+ * NOTE: Elsewhere the embedded thumbnails are copied into the pack,
+ *	and the pack is read rather than mapped.
+ */
+bool
+ThumbPack::CanReference(QString directory)
+{
+    struct statfs fs;
+
+    if (statfs(QFile::encodeName(directory).constData(), &fs) == -1)
+	return false;
+
+    for (size_t i = 0; i < sizeof(remoteFilesystems) / sizeof(remoteFilesystems[0]); i++)
+	if ((unsigned long) fs.f_type == remoteFilesystems[i])
+	    return false;
+
+    return true;
+}
@@ -0,0 +1,83 @@
+# ifndef	THUMBPACK_H
+# define	THUMBPACK_H
+
+# include	<QString>
+# include	<QByteArray>
+# include	<QHash>
+# include	<QMap>
+# include	<QMutex>
+# include	"MetaIndex.h"
+
+/*
+ * A thumbnail handed out by ThumbPack::Find(). It either points into
+ * the mapped pack, or into a copy read from a pack that is not mapped,
+ * or, if the thumbnail is embedded in its image, into a mapping of
+ * just those bytes of the image; the last two go away with the ThumbRef.
+ */
+class ThumbRef {
+public:
+    ThumbRef();
+    ~ThumbRef();
+    const unsigned char *Data() const;
+    quint32 Length() const;
+private:
+    friend class ThumbPack;
+    ThumbRef(const ThumbRef &);
+    ThumbRef &operator=(const ThumbRef &);
+    const unsigned char *data;
+    quint32 length;
+    void *map;			// of the image, NULL if in the pack
+    size_t mapLength;
+    QByteArray copy;		// read from the pack, if it is not mapped
+};
+
+/*
+ * All thumbnails of a directory in one file (.fpv-thumbs).
+ * Thumbnails are only ever appended; the offset of a thumbnail is kept
+ * in its MetaRecord (thumbnailKind THUMB_PACK), which makes .fpv-index
+ * the offset table of the pack. Thumbnails of deleted or changed
+ * images are left behind until the pack is compacted.
+ * Readers use the thumbnails in place from the mapped file. Where
+ * mapping is slow and unsafe (see CanReference()), they are read
+ * with pread() instead.
+ * Thumbnails embedded in the images (thumbnailKind THUMB_INLINE) are
+ * not copied into the pack at all, readers map them from the image.
+ * Writers lock the pack (flock), so several processes may append
+ * to the pack of the same directory.
+ */
+class ThumbPack {
+public:
+    ThumbPack(QString filename, bool writable = false);
+    ~ThumbPack();
+    bool IsValid() const;
+    QString Key(const QString &name) const;
+    bool Append(const QByteArray &name, const unsigned char *data, size_t length, quint32 *offset);
+    bool Entry(quint32 offset, const QByteArray &name, const unsigned char **data, quint32 *length, QByteArray *copy = NULL) const;
+    void Insert(const QString &name, const MetaRecord &record);
+    bool Find(const QString &name, ThumbRef *thumbnail) const;
+    quint64 Size() const;
+    static quint64 EntrySize(const QByteArray &name, quint32 length);
+    static bool Compact(QString filename, QMap<QByteArray,MetaRecord> *records);
+    static bool CanReference(QString directory);
+private:
+    ThumbPack(const ThumbPack &);
+    ThumbPack &operator=(const ThumbPack &);
+    bool lock();
+    static bool compact(QString filename, QMap<QByteArray,MetaRecord> *records);
+    struct Location {
+	quint8 kind;		// THUMB_PACK or THUMB_INLINE
+	quint32 offset;
+	quint32 length;
+    };
+    QString pathname;		// absolute
+    QString directory;		// where the images are
+    int fd;			// for appending, -1 if read only
+    unsigned char *map;
+    size_t mapLength;
+    int readFd;			// for pread() if the pack is not mapped, else -1
+    quint64 readLength;		//	and its size when it was opened
+    quint64 end;		// end of the pack after our last append
+    QMutex mutex;		// protects fd and end
+    QHash<QString,Location> table;	// where the thumbnails are, for readers
+};
+# endif // THUMBPACK_H
@@ -0,0 +1,308 @@
+# include	<limits.h>
+# include	<QThread>
+# include	<QElapsedTimer>
+# include	"ThumbnailCache.h"
+# include	"Stats.h"
+
+/*
+ * NAME: ThumbnailCache
+ * PURPOSE: Constructor of the ThumbnailCache class
+ * ARGUMENTS: budget: max number of bytes of decoded thumbnails to keep
+ *	new_size: thumbnails are scaled down to fit a square of this size
+ *	parent: parent object
+ * RETURNS: Nothing
+ */
+ThumbnailCache::ThumbnailCache(qint64 budget, int new_size, QObject *parent)
+    : QObject(parent), scheduler(QThread::idealThreadCount())
+{
+    // QCache counts in int
+    cache.setMaxCost((int) qBound((qint64) 1, budget, (qint64) INT_MAX));
+    size = new_size;
+    hits = misses = evictions = decodes = 0;
+    decodeTime = 0;
+}
+
+/*
+ * NAME: ~ThumbnailCache
+ * PURPOSE: Destructor of the ThumbnailCache class
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: Decodes that have not started yet are dropped,
+ *	the running ones are waited for by the scheduler.
+ */
+ThumbnailCache::~ThumbnailCache()
+{
+}
+
+/*
+ * NAME: Get
+ * PURPOSE: To get the thumbnail of an image that is to be painted
+ * ARGUMENTS: pack: the thumbnail pack of the image's directory
+ *	name: file name of the image
+ * RETURNS: the thumbnail or a null pixmap if it
+ *	has not been decoded yet
+ * NOTE: A thumbnail that is not in the cache is decoded before
+ *	anything else, thumbnailReady() is emitted when it has arrived.
+ *	Painting it again while it is on its way is not another miss.
+ */
+QPixmap
+ThumbnailCache::Get(const QSharedPointer<ThumbPack> &pack, const QString &name)
+{
+    QString key(pack->Key(name));
+    QPixmap *pixmap = cache.object(key);
+
+    if (pixmap != NULL)
+    {
+	hits++;
+	Stats::Count(STAT_THUMBCACHE_HITS);
+	return *pixmap;
+    }
+    if (missing.contains(key))
+	return QPixmap();
+
+    QHash<QString,bool>::iterator p = pending.find(key);
+    if (p == pending.end() || !p.value())
+    {
+	misses++;
+	Stats::Count(STAT_THUMBCACHE_MISSES);
+    }
+    queue(key, pack, name, 0);
+    pending[key] = true;
+
+    return QPixmap();
+}
+
+/*
+ * NAME: Prefetch
+ * PURPOSE: To have a thumbnail decoded that will probably be painted soon
+ * ARGUMENTS: pack: the thumbnail pack of the image's directory
+ *	name: file name of the image
+ *	priority: 0 for visible, higher for further away
+ * RETURNS: Nothing
+ * NOTE: If it is already queued, it gets the new priority
+ */
+void
+ThumbnailCache::Prefetch(const QSharedPointer<ThumbPack> &pack, const QString &name, int priority)
+{
+    QString key(pack->Key(name));
+
+    if (cache.contains(key) || missing.contains(key))
+	return;
+
+    queue(key, pack, name, priority);
+    if (!pending.contains(key))
+	pending.insert(key, false);
+}
+
+/*
+ * NAME: CancelExcept
+ * PURPOSE: To drop the queued decodes that are no longer wanted
+ * ARGUMENTS: keep: keys (ThumbPack::Key()) of the thumbnails still wanted
+ * RETURNS: Nothing
+ */
+void
+ThumbnailCache::CancelExcept(const QSet<QString> &keep)
+{
+    cancelled(scheduler.CancelExcept(keep));
+}
+
+/*
+ * NAME: CancelAll
+ * PURPOSE: To drop all queued decodes, eg when leaving a directory
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+ThumbnailCache::CancelAll()
+{
+    cancelled(scheduler.CancelAll());
+}
+
+/*
+ * NAME: queue
+ * PURPOSE: To queue a thumbnail for decoding, or change its priority
+ * ARGUMENTS: key: key of the thumbnail in the cache
+ *	pack: the thumbnail pack of the image's directory
+ *	name: file name of the image
+ *	priority: 0 for visible, higher for further away
+ * RETURNS: Nothing
+ * NOTE: The decoder holds on to the pack, so it stays mapped even if
+ *	the directory is left meanwhile.
+ */
+void
+ThumbnailCache::queue(const QString &key, const QSharedPointer<ThumbPack> &pack, const QString &name, int priority)
+{
+    int s = size;
+
+    if (pending.contains(key) && !scheduler.Queued(key))
+	return;		// running already
+
+    scheduler.Submit(key, priority, [this, key, pack, name, s] {
+	QElapsedTimer timer;
+
+	timer.start();
+	QImage image(Decode(*pack, name, s));
+	QMetaObject::invokeMethod(this, "decoded", Qt::QueuedConnection,
+	    Q_ARG(QString, key), Q_ARG(QImage, image), Q_ARG(qint64, timer.nsecsElapsed()));
+    });
+}
+
+/*
+ * NAME: cancelled
+ * PURPOSE: To forget about decodes the scheduler has dropped
+ * ARGUMENTS: keys: their keys
+ * RETURNS: Nothing
+ * NOTE: So they are queued again when they are wanted again
+ */
+void
+ThumbnailCache::cancelled(const QStringList &keys)
+{
+    for (QStringList::const_iterator key = keys.begin(); key != keys.end(); key++)
+	pending.remove(*key);
+}
+
+/*
+ * NAME: Missing
+ * PURPOSE: To find out if a thumbnail could not be decoded
+ * ARGUMENTS: pack: the thumbnail pack of the image's directory
+ *	name: file name of the image
+ * RETURNS: true if it does not exist or is damaged
+ */
+bool
+ThumbnailCache::Missing(const QSharedPointer<ThumbPack> &pack, const QString &name) const
+{
+    return missing.contains(pack->Key(name));
+}
+
+/*
+ * NAME: Decode
+ * PURPOSE: To load a thumbnail
+ * ARGUMENTS: pack: the thumbnail pack of the image's directory
+ *	name: file name of the image
+ *	size: the thumbnail is scaled down to fit a square of this size
+ * RETURNS: the thumbnail or a null image
+ * NOTE: This is safe to run in any thread. The JPEG data is decoded
+ *	straight from the mapped pack or image. The thumbnails were
+ *	turned upright when they were indexed.
+ */
+QImage
+ThumbnailCache::Decode(const ThumbPack &pack, const QString &name, int size)
+{
+    ThumbRef thumbnail;
+    QImage image;
+
+    if (!pack.Find(name, &thumbnail) || !image.loadFromData(thumbnail.Data(), thumbnail.Length(), "JPEG"))
+	return image;
+
+    if (image.width() > size || image.height() > size)
+	image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    return image;
+}
+
+/*
+ * NAME: decoded
+ * PURPOSE: To enter a decoded thumbnail into the cache
+ * ARGUMENTS: key: key of the thumbnail
+ *	image: the thumbnail, a null image if it could not be decoded
+ *	nsecs: time it took to decode it
+ * RETURNS: Nothing
+ * NOTE: Runs in the GUI thread, as QPixmap must be created there.
+ *	QCache throws out the least recently used thumbnails to make room.
+ *	A thumbnail bigger than the whole cache is entered at the cost
+ *	of the whole cache, or it would be decoded again on every paint.
+ */
+void
+ThumbnailCache::decoded(QString key, QImage image, qint64 nsecs)
+{
+    pending.remove(key);
+    decodes++;
+    decodeTime += nsecs;
+
+    if (image.isNull())
+	missing.insert(key);
+    else
+    {
+	int cost = image.width() * image.height() * image.depth() / 8;
+	int before = cache.count();
+
+	// QCache drops what costs more than it holds; it is shown once all the same
+	cost = qMin(cost, cache.maxCost());
+	cache.insert(key, new QPixmap(QPixmap::fromImage(image)), cost);
+	evictions += before + 1 - cache.count();
+    }
+
+    emit thumbnailReady(key);
+}
+
+/*
+ * NAME: Cancelled
+ * PURPOSE: Access method of the number of decodes dropped
+ * ARGUMENTS: None
+ * RETURNS: number of decodes cancelled before they started
+ */
+quint64
+ThumbnailCache::Cancelled()
+{
+    return scheduler.Cancelled();
+}
+
+/*
+ * NAME: Hits
+ * PURPOSE: Access method of the number of thumbnails found in the cache
+ * ARGUMENTS: None
+ * RETURNS: number of hits
+ */
+quint64
+ThumbnailCache::Hits() const
+{
+    return hits;
+}
+
+/*
+ * NAME: Misses
+ * PURPOSE: Access method of the number of thumbnails not found in the cache
+ * ARGUMENTS: None
+ * RETURNS: number of misses
+ */
+quint64
+ThumbnailCache::Misses() const
+{
+    return misses;
+}
+
+/*
+ * NAME: Evictions
+ * PURPOSE: Access method of the number of thumbnails thrown out of the cache
+ * ARGUMENTS: None
+ * RETURNS: number of evictions
+ */
+quint64
+ThumbnailCache::Evictions() const
+{
+    return evictions;
+}
+
+/*
+ * NAME: Decoded
+ * PURPOSE: Access method of the number of thumbnails decoded
+ * ARGUMENTS: None
+ * RETURNS: number of decodes, including the failed ones
+ */
+quint64
+ThumbnailCache::Decoded() const
+{
+    return decodes;
+}
+
+/*
+ * NAME: DecodeTime
+ * PURPOSE: Access method of the time spent decoding
+ * ARGUMENTS: None
+ * RETURNS: nanoseconds, summed over all decoder threads
+ */
+qint64
+ThumbnailCache::DecodeTime() const
+{
+    return decodeTime;
+}
@@ -0,0 +1,58 @@
+# ifndef	THUMBNAILCACHE_H
+# define	THUMBNAILCACHE_H
+
+# include	<QObject>
+# include	<QCache>
+# include	<QSet>
+# include	<QHash>
+# include	<QPixmap>
+# include	<QImage>
+# include	<QString>
+# include	<QSharedPointer>
+# include	"Scheduler.h"
+# include	"ThumbPack.h"
+
+/*
+ * The decoded thumbnails, keyed by ThumbPack::Key(), least recently
+ * used first out once the byte budget is exceeded. Missing thumbnails
+ * are decoded from their pack by a Scheduler, scaled down there if
+ * need be, and announced by thumbnailReady() when they
+ * have arrived. The view tells which thumbnails it wants next, the
+ * visible ones first.
+ */
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+public:
+    ThumbnailCache(qint64 budget, int size, QObject *parent = 0);
+    ~ThumbnailCache();
+    QPixmap Get(const QSharedPointer<ThumbPack> &pack, const QString &name);
+    void Prefetch(const QSharedPointer<ThumbPack> &pack, const QString &name, int priority);
+    void CancelExcept(const QSet<QString> &keep);
+    void CancelAll();
+    bool Missing(const QSharedPointer<ThumbPack> &pack, const QString &name) const;
+    quint64 Hits() const;
+    quint64 Misses() const;
+    quint64 Evictions() const;
+    quint64 Decoded() const;
+    qint64 DecodeTime() const;
+    quint64 Cancelled();
+    static QImage Decode(const ThumbPack &pack, const QString &name, int size);
+signals:
+    void thumbnailReady(QString key);
+private slots:
+    void decoded(QString key, QImage image, qint64 nsecs);
+private:
+    QCache<QString,QPixmap> cache;	// cost is in bytes
+    void queue(const QString &key, const QSharedPointer<ThumbPack> &pack, const QString &name, int priority);
+    void cancelled(const QStringList &keys);
+    QHash<QString,bool> pending;	// being decoded, true if painted meanwhile
+    QSet<QString> missing;		// could not be decoded
+    Scheduler scheduler;
+    int size;				// thumbnails are scaled to fit size x size
+    quint64 hits;
+    quint64 misses;
+    quint64 evictions;
+    quint64 decodes;
+    qint64 decodeTime;			// nanoseconds, summed over all threads
+};
+# endif // THUMBNAILCACHE_H
@@ -0,0 +1,331 @@
+# include	<stdio.h>
+# include	<stdlib.h>
+# include	<string.h>
+# include	<setjmp.h>
+# include	<vector>
+# include	<jpeglib.h>
+# include	"Thumbnailer.h"
+
+// Quality of the generated thumbnails
+# define	THUMB_QUALITY	85
+
+/*
+ * libjpeg reports errors through error_exit(), which must not return.
+ * We jump back into Generate() instead of letting it exit().
+ */
+struct ThumbnailerError {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void
+thumbnailer_error_exit(j_common_ptr cinfo)
+{
+    longjmp(((ThumbnailerError *) cinfo->err)->jump, 1);
+}
+
+static void
+thumbnailer_output_message(j_common_ptr)
+{
+    // Damaged images are not worth a message each
+}
+
+/*
+ * NAME: encode
+ * PURPOSE: To encode pixels as a JPEG image
+ * ARGUMENTS: pixels: the image, row by row
+ *	w, h: its width and height
+ *	components: 1 for grayscale, 3 for RGB
+ *	jpeg: where to store the JPEG image
+ * RETURNS: true on success
+ * NOTE: This is a function of its own, so nothing of convert() is
+ *	live across the setjmp() here.
+ */
+static bool
+encode(const std::vector<unsigned char> &pixels, int w, int h, int components, std::vector<unsigned char> *jpeg)
+{
+    struct jpeg_compress_struct cinfo;
+    ThumbnailerError cerr;
+    // volatile: used after longjmp()
+    unsigned char * volatile out = NULL;
+    unsigned long outLength = 0;
+
+    cinfo.err = jpeg_std_error(&cerr.pub);
+    cerr.pub.error_exit = thumbnailer_error_exit;
+    cerr.pub.output_message = thumbnailer_output_message;
+    if (setjmp(cerr.jump))
+    {
+	jpeg_destroy_compress(&cinfo);
+	free(out);
+	return false;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, (unsigned char **) &out, &outLength);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = components;
+    cinfo.in_color_space = components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, THUMB_QUALITY, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+	JSAMPROW row = (JSAMPROW) &pixels[(size_t) cinfo.next_scanline * w * components];
+
+	jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg->assign(out, out + outLength);
+    jpeg_destroy_compress(&cinfo);
+    free(out);
+
+    return true;
+}
+
+/*
+ * NAME: Thumbnailer
+ * PURPOSE: Constructor of the Thumbnailer class
+ * ARGUMENTS: new_size: the thumbnails are scaled to fit a square of this size
+ * RETURNS: Nothing
+ */
+Thumbnailer::Thumbnailer(int new_size)
+{
+    size = new_size < 1 ? 1 : new_size;
+    width = height = 0;
+    denominator = 1;
+}
+
+/*
+ * NAME: Width
+ * PURPOSE: Access method of the width of the last image
+ * ARGUMENTS: None
+ * RETURNS: width in pixels at full scale
+ */
+int
+Thumbnailer::Width() const
+{
+    return width;
+}
+
+/*
+ * NAME: Height
+ * PURPOSE: Access method of the height of the last image
+ * ARGUMENTS: None
+ * RETURNS: height in pixels at full scale
+ */
+int
+Thumbnailer::Height() const
+{
+    return height;
+}
+
+/*
+ * NAME: Denominator
+ * PURPOSE: Access method of the scale the last image was decoded at
+ * ARGUMENTS: None
+ * RETURNS: 1, 2, 4 or 8 for 1/1 ... 1/8
+ */
+int
+Thumbnailer::Denominator() const
+{
+    return denominator;
+}
+
+/*
+ * NAME: orient
+ * PURPOSE: To turn an image upright
+ * ARGUMENTS: in: the pixels, w x h with the given number of components
+ *	orientation: Exif orientation of the image, 1..8
+ *	out: where to store the upright pixels
+ *	ow, oh: where to store their width and height
+ * RETURNS: Nothing
+ * NOTE: Orientations 5..8 swap width and height
+ */
+static void
+orient(const std::vector<unsigned char> &in, int w, int h, int components, int orientation,
+       std::vector<unsigned char> *out, int *ow, int *oh)
+{
+    bool swap = orientation >= 5 && orientation <= 8;
+
+    *ow = swap ? h : w;
+    *oh = swap ? w : h;
+    out->resize(in.size());
+    for (int y = 0; y < *oh; y++)
+    {
+	unsigned char *o = &(*out)[(size_t) y * *ow * components];
+
+	for (int x = 0; x < *ow; x++, o += components)
+	{
+	    int sx, sy;
+
+	    // Where the pixel that ends up at x, y is in the stored image
+	    switch (orientation)
+	    {
+	    case 2: sx = w - 1 - x; sy = y; break;		// mirrored
+	    case 3: sx = w - 1 - x; sy = h - 1 - y; break;	// upside down
+	    case 4: sx = x; sy = h - 1 - y; break;		// mirrored upside down
+	    case 5: sx = y; sy = x; break;			// transposed
+	    case 6: sx = y; sy = h - 1 - x; break;		// "Right-top", turn clockwise
+	    case 7: sx = w - 1 - y; sy = h - 1 - x; break;	// transversed
+	    case 8: sx = w - 1 - y; sy = x; break;		// "Left-bottom", turn anticlockwise
+	    default: sx = x; sy = y; break;
+	    }
+	    memcpy(o, &in[((size_t) sy * w + sx) * components], components);
+	}
+    }
+}
+
+/*
+ * NAME: Generate
+ * PURPOSE: To make a thumbnail of a JPEG image
+ * ARGUMENTS: source: pathname of the image
+ *	jpeg: where to store the thumbnail, a JPEG image
+ *	orientation: Exif orientation of the image
+ * RETURNS: true on success
+ * NOTE: The image is decoded at the smallest of 1/8, 1/4, 1/2 and 1/1
+ *	that is still at least as big as the thumbnail, then scaled down
+ *	by averaging and turned upright.
+ *	This is safe to call from several threads, each with its own
+ *	Thumbnailer.
+ */
+bool
+Thumbnailer::Generate(const char *source, std::vector<unsigned char> *jpeg, int orientation)
+{
+    FILE *in;
+    bool ok;
+
+    if ((in = fopen(source, "rb")) == NULL)
+	return false;
+
+    ok = convert(in, NULL, 0, orientation, jpeg);
+    fclose(in);
+
+    return ok;
+}
+
+/*
+ * NAME: Orient
+ * PURPOSE: To turn a thumbnail upright
+ * ARGUMENTS: data, length: the thumbnail, eg the one from the Exif data
+ *	orientation: Exif orientation of the image
+ *	jpeg: where to store the upright thumbnail
+ * RETURNS: true on success
+ * NOTE: The thumbnail is scaled down as well if it is bigger than size
+ */
+bool
+Thumbnailer::Orient(const unsigned char *data, size_t length, int orientation, std::vector<unsigned char> *jpeg)
+{
+    return convert(NULL, data, length, orientation, jpeg);
+}
+
+/*
+ * NAME: convert
+ * PURPOSE: To decode, scale down, turn and encode a JPEG image
+ * ARGUMENTS: in: the image file, or NULL
+ *	data, length: the image in memory, if in is NULL
+ *	orientation: Exif orientation of the image
+ *	jpeg: where to store the thumbnail
+ * RETURNS: true on success
+ */
+bool
+Thumbnailer::convert(FILE *in, const unsigned char *data, size_t length, int orientation, std::vector<unsigned char> *jpeg)
+{
+    struct jpeg_decompress_struct dinfo;
+    ThumbnailerError derr;
+    std::vector<unsigned char> pixels, thumb, upright;
+    std::vector<unsigned int> sum;
+    std::vector<unsigned int> hits;
+    int w, h, tw, th, uw, uh, components;
+
+    dinfo.err = jpeg_std_error(&derr.pub);
+    derr.pub.error_exit = thumbnailer_error_exit;
+    derr.pub.output_message = thumbnailer_output_message;
+    if (setjmp(derr.jump))
+    {
+	jpeg_destroy_decompress(&dinfo);
+	return false;
+    }
+    jpeg_create_decompress(&dinfo);
+    if (in != NULL)
+	jpeg_stdio_src(&dinfo, in);
+    else
+	jpeg_mem_src(&dinfo, (unsigned char *) data, length);
+    jpeg_read_header(&dinfo, TRUE);
+
+    width = dinfo.image_width;
+    height = dinfo.image_height;
+    if (dinfo.jpeg_color_space == JCS_CMYK || dinfo.jpeg_color_space == JCS_YCCK)
+	longjmp(derr.jump, 1);	// would need a colour conversion of our own
+    dinfo.out_color_space = dinfo.jpeg_color_space == JCS_GRAYSCALE ? JCS_GRAYSCALE : JCS_RGB;
+
+    // The smallest scale that does not make the thumbnail blurry
+    for (denominator = 8; denominator > 1; denominator /= 2)
+	if ((width > height ? width : height) / denominator >= size)
+	    break;
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denominator;
+    dinfo.dct_method = JDCT_IFAST;
+    dinfo.do_fancy_upsampling = FALSE;
+    dinfo.do_block_smoothing = FALSE;
+
+    jpeg_start_decompress(&dinfo);
+    w = dinfo.output_width;
+    h = dinfo.output_height;
+    components = dinfo.output_components;
+    pixels.resize((size_t) w * h * components);
+    while (dinfo.output_scanline < dinfo.output_height)
+    {
+	JSAMPROW row = &pixels[(size_t) dinfo.output_scanline * w * components];
+
+	jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+
+    // Scale down to fit, each target pixel is the mean of its source pixels
+    if (w > size || h > size)
+    {
+	if (w >= h)
+	{
+	    tw = size;
+	    th = (int) ((long) h * size / w);
+	}
+	else
+	{
+	    th = size;
+	    tw = (int) ((long) w * size / h);
+	}
+	if (tw < 1)
+	    tw = 1;
+	if (th < 1)
+	    th = 1;
+    }
+    else
+    {
+	tw = w;
+	th = h;
+    }
+    sum.assign((size_t) tw * th * components, 0);
+    hits.assign((size_t) tw * th, 0);
+    for (int y = 0; y < h; y++)
+    {
+	const unsigned char *p = &pixels[(size_t) y * w * components];
+	size_t ty = (size_t) y * th / h;
+
+	for (int x = 0; x < w; x++, p += components)
+	{
+	    size_t t = ty * tw + (size_t) x * tw / w;
+
+	    for (int c = 0; c < components; c++)
+		sum[t * components + c] += p[c];
+	    hits[t]++;
+	}
+    }
+    thumb.resize(sum.size());
+    for (size_t t = 0; t < hits.size(); t++)
+	for (int c = 0; c < components; c++)
+	    thumb[t * components + c] = hits[t] ? (unsigned char) (sum[t * components + c] / hits[t]) : 0;
+    orient(thumb, tw, th, components, orientation, &upright, &uw, &uh);
+
+    return encode(upright, uw, uh, components, jpeg);
+}
@@ -0,0 +1,30 @@
+# ifndef	THUMBNAILER_H
+# define	THUMBNAILER_H
+# include	<stddef.h>
+# include	<stdio.h>
+# include	<vector>
+
+/*
+ * Makes a thumbnail from a JPEG image that does not bring one along.
+ * The image is decoded by libjpeg at a reduced scale (usually 1/8),
+ * so only the DC coefficients of most blocks are needed and the full
+ * resolution image is never produced.
+ * The thumbnails are turned upright according to the Exif orientation,
+ * so they can be shown as they are.
+ */
+class Thumbnailer {
+public:
+    Thumbnailer(int size);
+    bool Generate(const char *source, std::vector<unsigned char> *jpeg, int orientation = 1);
+    bool Orient(const unsigned char *data, size_t length, int orientation, std::vector<unsigned char> *jpeg);
+    int Width() const;
+    int Height() const;
+    int Denominator() const;
+private:
+    bool convert(FILE *in, const unsigned char *data, size_t length, int orientation, std::vector<unsigned char> *jpeg);
+    int size;			// the thumbnail fits into size x size
+    int width;			// of the last image
+    int height;
+    int denominator;		// it was decoded at 1/denominator
+};
+# endif // THUMBNAILER_H
@@ -1,34 +1,55 @@
 # include	"Viewer.h"
-# include	<QMatrix>
 # include	<unistd.h>
-# include	"Exif.h"
-# include	"clickablelabel.h"
+# include	<QProcess>
+# include	"PhotoModel.h"
+# include	"PhotoView.h"
+# include	"ImageViewer.h"
+# include	"Stats.h"
 
-extern void update_index(float resolver_delay, unsigned int maxrequests);
 extern float resolver_delay;
+extern unsigned int scan_jobs;
+extern bool recursive;
+extern QString external_viewer;
 extern QMap<QString,QString> *locationmap;
+extern QHash<QString,MetaIndex *> metaindexes;
+
+// Max number of reverse geocoding requests per run, for all directories together
+# define	MAX_REQUESTS	100
 
 /*
  * NAME: Viewer
  * PURPOSE: Constructor of the Viewer class
- * ARGUMENTS: names: QStringlist of file names
- *	locationmap: QMap<QString,QString> mapping file names to locations (street, place, ...)
- *	new_settings: QSettings for this program
+ * ARGUMENTS: new_settings: QSettings for this program
+ *	new_thumbnails: cache of decoded thumbnails
  * RETURNS: Nothing
+ * NOTE: The photos of the current directory (and those below it, if
+ *	recursive) are shown right away, as far as they are known;
+ *	the directories are indexed meanwhile.
  */
-Viewer::Viewer(QStringList names, QMap<QString,QString> *locationmap, QSettings *new_settings)
+Viewer::Viewer(QSettings *new_settings, ThumbnailCache *new_thumbnails)
 {
     // qDebug() << "new_settings->directory" << new_settings->value("directory", ".").toString();
     settings = new_settings;
+    thumbnails = new_thumbnails;
+    groupbox = NULL;
+    view = NULL;
+    model = NULL;
+    imageViewer = NULL;
     createMenu();
-    createBox(names, locationmap);
+
+    progressBar = new QProgressBar;
+    progressBar->hide();
+    refreshTimer.setSingleShot(true);
+    refreshTimer.setInterval(500);
+    connect(&refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
 
     // Create the top window that contains the menubar and the subwindow
     mainLayout = new QVBoxLayout;
     mainLayout->setMenuBar(menuBar);
-    mainLayout->addWidget(groupbox);
+    mainLayout->addWidget(progressBar);
 
     setLayout(mainLayout);
+    load();
 }
 
 /*
@@ -36,10 +57,15 @@ Viewer::Viewer(QStringList names, QMap<QString,QString> *locationmap, QSettings
  * PURPOSE: Desctructor of the Viewer class
  * ARGUMENTS: None
  * RETURNS: Nothing
- * NOTE: This destructor does nothing
+ * NOTE: The indexers still running, that of the current directory
+ *	and those cancelled before, are cancelled and waited for, so
+ *	what they have done so far is saved before the catalog is closed.
  */
 Viewer::~Viewer()
 {
+    delete indexer;
+    for (QList<QPointer<Indexer> >::iterator i = retired.begin(); i != retired.end(); i++)
+	delete *i;
 }
 
 /*
@@ -65,16 +91,18 @@ Viewer::createMenu()
 /*
  * NAME: createBox
  * PURPOSE: To create the main window displaying the locations/thumbnails
- * ARGUMENTS: names: QStringlist of file names
- *	locationmap: QMap<QString,QString> mapping file names to locations (street, place, ...)
+ * ARGUMENTS: names: QStringlist of pathnames relative to the current directory
+ *	locationmap: QMap<QString,QString> mapping pathnames to locations (street, place, ...)
+ *	packs: the thumbnails of the directories
  * RETURNS: Nothing
+ * NOTE: The thumbnails are shown by a PhotoView, which only paints
+ *	the rows that are visible.
  */
 void
-Viewer::createBox(QStringList names, QMap<QString,QString> *locationmap)
+Viewer::createBox(QStringList names, QMap<QString,QString> *locationmap, const PackMap &packs)
 {
-    int row, col;
-    QString currentLocation("");
     QString currentDirectory(QDir().canonicalPath());
+    StatTimer timer(PHASE_CREATEBOX);
 
     // Create the subwindow that contains the thumbnails and the descriptions
 
@@ -83,81 +111,39 @@ Viewer::createBox(QStringList names, QMap<QString,QString> *locationmap)
     settings->setValue("directory", currentDirectory);
     QVBoxLayout *layout = new QVBoxLayout();
 
-    QFrame *f = new QFrame(groupbox);
-    f->show();
-    QGridLayout *frame_layout = new QGridLayout();
-    f->setLayout(frame_layout);
-
-    row = -1;
-    col = 0;
-    for (QStringList::iterator name = names.begin(); name != names.end(); name++)
-    {
-	QString location(locationmap->value(*name));
-	Exif exif(*name);
-
-	// qDebug() << *name << ": location=" << location << " - current=" << currentLocation;
-	if (location != currentLocation)
-	{
-	    QFrame *descrFrame = new QFrame();
-	    QHBoxLayout *descrLayout = new QHBoxLayout();
-	    descrFrame->setLayout(descrLayout);
-
-	    row++;
-	    // qDebug() << "New label row=" << row;
-	    QLabel *loc = new QLabel(QString("<b>") + locationmap->value(*name) + QString("</b>"), f);
-	    loc->setTextInteractionFlags(Qt::TextSelectableByMouse);
-	    descrLayout->addWidget(loc, 1, Qt::AlignLeft);
-
-	    QLabel *date = new QLabel(exif.Date(), f);
-	    descrLayout->addWidget(date, 0, Qt::AlignRight);
-
-	    frame_layout->addWidget(descrFrame, row, 0, 1, -1);
-	    descrFrame->show();
-	    row++;
-	    col = 0;
-	}
-	else
-	{
-	    // qDebug() << "Same label";
-	}
+    view = new PhotoView(thumbnails, packs, groupbox);
+    model = new PhotoModel(names, locationmap, view);
+    view->setModel(model);
+    connect(view, SIGNAL(imageClicked(QString)), this, SLOT(showImage(QString)));
+    layout->addWidget(view);
 
-	QPixmap *image = new QPixmap(".thumbnails/" + *name);
-	QPixmap rotated;
-	if (exif.Orientation() != "Top-left")
-	{
-	    QMatrix rm;
-
-	    if (exif.Orientation() == "Right-top")
-		rm.rotate(90);
-	    else if (exif.Orientation() == "Left-bottom")
-	        rm.rotate(-90);
-	    else
-	        rm.rotate(0);
-	    rotated = image->transformed(rm);
-	    image = &rotated;
-	}
-	ClickableLabel *imageLabel = new ClickableLabel(f);
-	imageLabel->setImageName(*name);
-	imageLabel->setToolTip(*name);
-	imageLabel->setPixmap(*image);
-	// qDebug() << "row=" << row << "col=" << col;
-	frame_layout->addWidget(imageLabel, row, col);
-	imageLabel->show();
-	col++;
-	if (col >= 4)
-	{
-	    row++;
-	    col = 0;
-	}
+    groupbox->setLayout(layout);
+}
 
-        currentLocation = location;
+/*
+ * NAME: showImage
+ * PURPOSE: To show an image
+ * ARGUMENTS: name: pathname of the image relative to the current directory
+ * RETURNS: Nothing
+ * NOTE: The image is shown by the built-in viewer, which can flip
+ *	through the others in the order they are shown here. If an
+ *	external viewer has been given, it is started instead; we
+ *	do not wait for it.
+ */
+void
+Viewer::showImage(QString name)
+{
+    if (external_viewer.length() != 0)
+    {
+	if (!QProcess::startDetached(external_viewer, QStringList() << name, QDir::currentPath()))
+	    QMessageBox::warning(this, tr("fpv"), tr("Cannot start %1").arg(external_viewer));
+	return;
     }
 
-    QScrollArea *scroll = new QScrollArea(groupbox);
-    scroll->setWidget(f);
-    layout->addWidget(scroll);
-
-    groupbox->setLayout(layout);
+    if (imageViewer == NULL)
+	imageViewer = new ImageViewer(this);
+    QStringList names(model->Names());
+    imageViewer->Show(QDir::currentPath(), names, qMax(0, names.indexOf(name)));
 }
 
 /*
@@ -181,20 +167,189 @@ Viewer::openDir()
 
     // qDebug() << "Selected" << dirname;
     if (dirname.length() && chdir(dirname.toStdString().c_str()) != -1)
+	load();
+}
+
+/*
+ * NAME: load
+ * PURPOSE: To show the photos of the current directory and start indexing it
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: What is in the .location.csv and .fpv-index files is shown
+ *	at once. Those of the directories below, if recursive, are
+ *	shown as the indexer reads them.
+ *	The indexer of the previous directory, if any, is cancelled and
+ *	left to save what it has done so far. The new one does not start
+ *	before that, so no two indexers ever write the same files.
+ */
+void
+Viewer::load()
+{
+    QString currentDirectory(QDir().canonicalPath());
+
+    // Nothing queued for the old directory is of interest any more
+    thumbnails->CancelAll();
+    refreshTimer.stop();
+    if (imageViewer != NULL)
+	imageViewer->hide();
+    if (indexer != NULL)
     {
-        mainLayout->removeWidget(groupbox);
+	disconnect(indexer, 0, this, 0);
+	indexer->Cancel();
+	retired.append(indexer);
+    }
+    retired.removeAll(QPointer<Indexer>());
+    if (groupbox != NULL)
+    {
+	mainLayout->removeWidget(groupbox);
 	delete groupbox;
 	groupbox = NULL;
+    }
+
+    // First step: load the location map and the index as they are
+    indexer = new Indexer(currentDirectory, recursive, resolver_delay, MAX_REQUESTS, scan_jobs);
+    connect(indexer, SIGNAL(progress(QString,int,int)), this, SLOT(progress(QString,int,int)));
+    connect(indexer, SIGNAL(located(QString,QString)), this, SLOT(located(QString,QString)));
+    connect(indexer, SIGNAL(indexed(QString,QSharedPointer<ThumbPack>)), this, SLOT(indexed(QString,QSharedPointer<ThumbPack>)));
+    connect(indexer, SIGNAL(finished()), this, SLOT(indexerFinished()));
+    // After the above, so they are still delivered
+    connect(indexer, SIGNAL(finished()), indexer, SLOT(deleteLater()));
+
+    PackMap packs;
+    {
+	StatTimer timer(PHASE_LOAD);
 
-	// First step: load and update the location map
 	delete locationmap;
-	locationmap = NULL;
-	update_index(resolver_delay, 100);
+	locationmap = new QMap<QString,QString>(indexer->Load());
+	qDeleteAll(metaindexes);
+	metaindexes.clear();
+	QStringList folders(indexer->Folders());
+	for (QStringList::iterator folder = folders.begin(); folder != folders.end(); folder++)
+	{
+	    QString path(QDir::cleanPath(currentDirectory + "/" + *folder));
+	    MetaIndex *metaindex = new MetaIndex(path + "/.fpv-index");
 
-	QStringList filenames(locationmap->keys());
-	filenames.sort(Qt::CaseInsensitive);
+	    metaindexes.insert(*folder, metaindex);
+	    packs.insert(*folder, Indexer::Thumbnails(path, *metaindex));
+	}
+    }
 
-	createBox(filenames, locationmap);
-	mainLayout->addWidget(groupbox);
+    createBox(names(), locationmap, packs);
+    mainLayout->insertWidget(0, groupbox);
+
+    // Next step: bring it up to date in the background
+    progressBar->setValue(0);
+    progressBar->show();
+    indexer->start();
+}
+
+/*
+ * NAME: names
+ * PURPOSE: To get the file names of the photos to show
+ * ARGUMENTS: None
+ * RETURNS: the names of the photos with a location, sorted
+ */
+QStringList
+Viewer::names() const
+{
+    QStringList filenames(locationmap->keys());
+
+    filenames.sort(Qt::CaseInsensitive);
+    return filenames;
+}
+
+/*
+ * NAME: progress
+ * PURPOSE: To show how far the indexer has got
+ * ARGUMENTS: phase: what it is doing
+ *	done: how many of
+ *	total: items
+ * RETURNS: Nothing
+ */
+void
+Viewer::progress(QString phase, int done, int total)
+{
+    if (sender() != indexer)
+	return;		// still on its way from a previous directory
+
+    progressBar->setMaximum(total);
+    progressBar->setValue(done);
+    progressBar->setFormat(phase + " %v/%m");
+}
+
+/*
+ * NAME: located
+ * PURPOSE: To add a photo whose location has been found
+ * ARGUMENTS: name: pathname of the photo relative to the current directory
+ *	location: its location
+ * RETURNS: Nothing
+ * NOTE: The view is updated a little later, together with the others
+ *	found meanwhile.
+ */
+void
+Viewer::located(QString name, QString location)
+{
+    if (sender() != indexer)
+	return;
+
+    locationmap->insert(name, location);
+    if (!refreshTimer.isActive())
+	refreshTimer.start();
+}
+
+/*
+ * NAME: indexed
+ * PURPOSE: To show the thumbnails of a directory once the indexer has made them
+ * ARGUMENTS: folder: the directory, relative to the current directory
+ *	pack: its thumbnails
+ * RETURNS: Nothing
+ * NOTE: The dates of new photos are in the index now, the view is
+ *	updated together with the other directories indexed meanwhile.
+ */
+void
+Viewer::indexed(QString folder, QSharedPointer<ThumbPack> pack)
+{
+    if (sender() != indexer)
+	return;
+
+    delete metaindexes.value(folder, NULL);
+    metaindexes.insert(folder, new MetaIndex(QDir::cleanPath(indexer->Directory() + "/" + folder) + "/.fpv-index"));
+    view->SetPack(folder, pack);
+    if (!refreshTimer.isActive())
+	refreshTimer.start();
+}
+
+/*
+ * NAME: indexerFinished
+ * PURPOSE: To take down the progress indicator
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+Viewer::indexerFinished()
+{
+    if (sender() != indexer)
+	return;
+
+    progressBar->hide();
+    if (refreshTimer.isActive())
+    {
+	refreshTimer.stop();
+	refresh();
     }
 }
+
+/*
+ * NAME: refresh
+ * PURPOSE: To show the photos located so far
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ */
+void
+Viewer::refresh()
+{
+    StatTimer timer(PHASE_REFRESH);
+
+    view->KeepPosition();
+    model->Update(names());
+}
@@ -4,6 +4,14 @@
 # include	<QDialog>
 # include       <QtWidgets>
 # include	<QStringList>
+# include	<QPointer>
+# include	<QSharedPointer>
+# include	"ThumbnailCache.h"
+# include	"Indexer.h"
+# include	"PhotoView.h"
+
+class PhotoModel;
+class ImageViewer;
 
 using namespace std;
 
@@ -11,12 +19,21 @@ class Viewer : public QDialog {
     Q_OBJECT
 public slots:
     void openDir();
+    void showImage(QString);
+private slots:
+    void progress(QString, int, int);
+    void located(QString, QString);
+    void indexed(QString, QSharedPointer<ThumbPack>);
+    void indexerFinished();
+    void refresh();
 public:
-    Viewer(QStringList, QMap<QString,QString> *, QSettings *);
+    Viewer(QSettings *, ThumbnailCache *);
     ~Viewer();
 private:
     void createMenu();
-    void createBox(QStringList, QMap<QString,QString> *);
+    void createBox(QStringList, QMap<QString,QString> *, const PackMap &);
+    void load();
+    QStringList names() const;
     QMenuBar *menuBar;
     QVBoxLayout *mainLayout;
     QMenu *fileMenu;
@@ -24,5 +41,13 @@ private:
     	*openAction;
     QGroupBox *groupbox;
     QSettings *settings;
+    ThumbnailCache *thumbnails;
+    QPointer<Indexer> indexer;	// of the current directory, while it runs
+    QList<QPointer<Indexer> > retired;	// cancelled, still saving
+    PhotoView *view;
+    PhotoModel *model;
+    QProgressBar *progressBar;
+    ImageViewer *imageViewer;	// created when it is first needed
+    QTimer refreshTimer;	// merges the locations found into one model update
 };
 # endif // VIEWER_H
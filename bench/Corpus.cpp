@@ -0,0 +1,294 @@
+# include	<stdio.h>
+# include	<stdlib.h>
+# include	<string.h>
+# include	<jpeglib.h>
+# include	"Corpus.h"
+
+/*
+ * Builds a TIFF structure in either byte order
+ */
+struct TiffWriter {
+    std::vector<unsigned char> data;
+    bool motorola;
+
+    void put16(size_t at, unsigned int v)
+    {
+	data[at + (motorola ? 0 : 1)] = v >> 8;
+	data[at + (motorola ? 1 : 0)] = v;
+    }
+    void put32(size_t at, unsigned long v)
+    {
+	for (int i = 0; i < 4; i++)
+	    data[at + (motorola ? i : 3 - i)] = v >> (24 - 8 * i);
+    }
+    size_t grow(size_t n)
+    {
+	size_t at = data.size();
+
+	data.resize(at + n, 0);
+	return at;
+    }
+    // Starts an IFD of n entries, returns its offset
+    size_t ifd(int n)
+    {
+	size_t at = grow(2 + 12 * n + 4);
+
+	put16(at, n);
+	return at;
+    }
+    // Fills in entry i of the IFD at ifd, values over 4 bytes are appended
+    void entry(size_t ifd, int i, unsigned int tag, unsigned int type, unsigned long count, const unsigned char *value, size_t length)
+    {
+	size_t e = ifd + 2 + 12 * i;
+
+	put16(e, tag);
+	put16(e + 2, type);
+	put32(e + 4, count);
+	if (length <= 4)
+	    memcpy(&data[e + 8], value, length);
+	else
+	{
+	    size_t at = grow(length + (length & 1));
+
+	    memcpy(&data[at], value, length);
+	    put32(e + 8, at);
+	}
+    }
+    void entry16(size_t ifd, int i, unsigned int tag, unsigned int v)
+    {
+	entry(ifd, i, tag, 3, 1, (const unsigned char *) "\0\0", 2);
+	put16(ifd + 2 + 12 * i + 8, v);
+    }
+    void entry32(size_t ifd, int i, unsigned int tag, unsigned long v)
+    {
+	entry(ifd, i, tag, 4, 1, (const unsigned char *) "\0\0\0\0", 4);
+	put32(ifd + 2 + 12 * i + 8, v);
+    }
+    // degrees, minutes, seconds as three RATIONALs
+    void entryDegrees(size_t ifd, int i, unsigned int tag, double v)
+    {
+	unsigned long rationals[6] = { (unsigned long) v, 1,
+	    (unsigned long) ((v - (int) v) * 60), 1,
+	    (unsigned long) ((v * 60 - (int) (v * 60)) * 60 * 1000), 1000 };
+	unsigned char bytes[24];
+	TiffWriter w;
+
+	w.motorola = motorola;
+	w.data.assign(24, 0);
+	for (int r = 0; r < 6; r++)
+	    w.put32(4 * r, rationals[r]);
+	memcpy(bytes, &w.data[0], 24);
+	entry(ifd, i, tag, 5, 3, bytes, 24);
+    }
+};
+
+/*
+ * NAME: Corpus
+ * PURPOSE: Constructor of the Corpus class
+ * ARGUMENTS: seed: the same seed makes the same photos
+ *	width, height: size of the images
+ * RETURNS: Nothing
+ * NOTE: The pool of images and thumbnails is encoded here
+ */
+Corpus::Corpus(unsigned int seed, int width, int height)
+    : random(seed)
+{
+    images.resize(CORPUS_POOL);
+    thumbnails.resize(CORPUS_POOL);
+    for (int i = 0; i < CORPUS_POOL; i++)
+    {
+	encode(random, width, height, 90, &images[i]);
+	encode(random, 160, 120, 75, &thumbnails[i]);
+	// Without its SOI, the Exif segment goes in front
+	images[i].erase(images[i].begin(), images[i].begin() + 2);
+    }
+    memset(&truth, 0, sizeof(truth));
+}
+
+/*
+ * NAME: Last
+ * PURPOSE: Access method of what is in the last photo
+ * ARGUMENTS: None
+ * RETURNS: the fields that were put into its Exif segment
+ */
+const Corpus::Truth &
+Corpus::Last() const
+{
+    return truth;
+}
+
+/*
+ * NAME: Next
+ * PURPOSE: To make up a photo
+ * ARGUMENTS: None
+ * RETURNS: the JPEG file, valid until the next call
+ * NOTE: 5% have no Exif data, 15% no GPS coordinates, 15% no
+ *	thumbnail and 20% are turned (orientation 3, 6 or 8).
+ */
+const std::vector<unsigned char> &
+Corpus::Next()
+{
+    std::uniform_int_distribution<int> percent(0, 99), pool(0, CORPUS_POOL - 1);
+    std::vector<unsigned char> app1;
+    const std::vector<unsigned char> &image = images[pool(random)];
+
+    memset(&truth, 0, sizeof(truth));
+    truth.exif = percent(random) >= 5;
+    if (truth.exif)
+	exif(&app1);
+
+    photo.clear();
+    photo.push_back(0xFF);
+    photo.push_back(0xD8);
+    photo.insert(photo.end(), app1.begin(), app1.end());
+    photo.insert(photo.end(), image.begin(), image.end());
+    return photo;
+}
+
+/*
+ * NAME: Write
+ * PURPOSE: To make up a photo and write it to a file
+ * ARGUMENTS: pathname: where to write it
+ * RETURNS: true on success
+ */
+bool
+Corpus::Write(const char *pathname)
+{
+    const std::vector<unsigned char> &jpeg = Next();
+    FILE *f;
+    bool ok;
+
+    if ((f = fopen(pathname, "wb")) == NULL)
+	return false;
+    ok = fwrite(&jpeg[0], 1, jpeg.size(), f) == jpeg.size();
+    return fclose(f) == 0 && ok;
+}
+
+/*
+ * NAME: exif
+ * PURPOSE: To make up the Exif segment of a photo
+ * ARGUMENTS: app1: where to store the APP1 segment
+ * RETURNS: Nothing
+ * NOTE: Fills in truth
+ */
+void
+Corpus::exif(std::vector<unsigned char> *app1)
+{
+    std::uniform_int_distribution<int> percent(0, 99), pool(0, CORPUS_POOL - 1);
+    std::uniform_real_distribution<double> lat(36.0, 60.0), lon(-9.0, 30.0);
+    static const int turned[] = { 3, 6, 8 };
+    TiffWriter t;
+    size_t ifd0, exifIfd, gpsIfd, ifd1;
+    int n0;
+
+    t.motorola = percent(random) < 50;
+    truth.gps = percent(random) >= 15;
+    truth.thumbnail = percent(random) >= 15;
+    truth.orientation = percent(random) < 20 ? turned[percent(random) % 3] : 1;
+    truth.latitude = truth.gps ? lat(random) * (percent(random) < 10 ? -1 : 1) : 0.0;
+    truth.longitude = truth.gps ? lon(random) : 0.0;
+    snprintf(truth.date, sizeof(truth.date), "%04u:%02u:%02u %02u:%02u:%02u",
+	2005 + (unsigned) percent(random) % 20, 1 + (unsigned) percent(random) % 12, 1 + (unsigned) percent(random) % 28,
+	(unsigned) percent(random) % 24, (unsigned) percent(random) % 60, (unsigned) percent(random) % 60);
+
+    // TIFF header
+    t.grow(8);
+    t.data[0] = t.data[1] = t.motorola ? 'M' : 'I';
+    t.put16(2, 42);
+    t.put32(4, 8);
+
+    n0 = truth.gps ? 3 : 2;
+    ifd0 = t.ifd(n0);
+    t.entry16(ifd0, 0, 0x0112, truth.orientation);
+    t.entry32(ifd0, 1, 0x8769, 0);
+    if (truth.gps)
+	t.entry32(ifd0, 2, 0x8825, 0);
+
+    exifIfd = t.ifd(1);
+    t.put32(ifd0 + 2 + 12 * 1 + 8, exifIfd);
+    t.entry(exifIfd, 0, 0x9003, 2, 20, (const unsigned char *) truth.date, 20);
+
+    if (truth.gps)
+    {
+	gpsIfd = t.ifd(4);
+	t.put32(ifd0 + 2 + 12 * 2 + 8, gpsIfd);
+	t.entry(gpsIfd, 0, 0x0001, 2, 2, (const unsigned char *) (truth.latitude < 0 ? "S" : "N"), 2);
+	t.entryDegrees(gpsIfd, 1, 0x0002, truth.latitude < 0 ? -truth.latitude : truth.latitude);
+	t.entry(gpsIfd, 2, 0x0003, 2, 2, (const unsigned char *) (truth.longitude < 0 ? "W" : "E"), 2);
+	t.entryDegrees(gpsIfd, 3, 0x0004, truth.longitude < 0 ? -truth.longitude : truth.longitude);
+    }
+
+    if (truth.thumbnail)
+    {
+	const std::vector<unsigned char> &thumbnail = thumbnails[pool(random)];
+	size_t at;
+
+	ifd1 = t.ifd(3);
+	t.put32(ifd0 + 2 + 12 * n0, ifd1);
+	t.entry16(ifd1, 0, 0x0103, 6);
+	t.entry32(ifd1, 1, 0x0201, 0);
+	t.entry32(ifd1, 2, 0x0202, thumbnail.size());
+	at = t.grow(thumbnail.size());
+	memcpy(&t.data[at], &thumbnail[0], thumbnail.size());
+	t.put32(ifd1 + 2 + 12 * 1 + 8, at);
+    }
+
+    // APP1: marker, length, "Exif\0\0", TIFF
+    size_t length = 2 + 6 + t.data.size();
+    app1->clear();
+    app1->push_back(0xFF);
+    app1->push_back(0xE1);
+    app1->push_back(length >> 8);
+    app1->push_back(length);
+    app1->insert(app1->end(), (const unsigned char *) "Exif\0\0", (const unsigned char *) "Exif\0\0" + 6);
+    app1->insert(app1->end(), t.data.begin(), t.data.end());
+}
+
+/*
+ * NAME: encode
+ * PURPOSE: To make up an image
+ * ARGUMENTS: random: where the noise comes from
+ *	width, height: its size
+ *	quality: JPEG quality
+ *	jpeg: where to store the JPEG file
+ * RETURNS: true on success
+ * NOTE: A gradient with some noise on it, so it compresses about
+ *	as well as a photo.
+ */
+bool
+Corpus::encode(std::mt19937 &random, int width, int height, int quality, std::vector<unsigned char> *jpeg)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr err;
+    std::vector<unsigned char> row(width * 3);
+    std::uniform_int_distribution<int> noise(0, 31), hue(0, 255);
+    unsigned char *out = NULL;
+    unsigned long outLength = 0;
+    int base[3] = { hue(random), hue(random), hue(random) };
+
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &outLength);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+	JSAMPROW r = &row[0];
+
+	for (int x = 0; x < width; x++)
+	    for (int c = 0; c < 3; c++)
+		row[x * 3 + c] = (base[c] + x * 255 / width * (c + 1) / 3 + cinfo.next_scanline * 255 / height * (3 - c) / 3 + noise(random)) & 0xFF;
+	jpeg_write_scanlines(&cinfo, &r, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    jpeg->assign(out, out + outLength);
+    free(out);
+    return outLength != 0;
+}
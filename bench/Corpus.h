@@ -0,0 +1,44 @@
+# ifndef	CORPUS_H
+# define	CORPUS_H
+
+# include	<stddef.h>
+# include	<random>
+# include	<vector>
+
+/*
+ * Makes up photos for the benchmarks: JPEG images with an Exif segment
+ * that varies the way real ones do. Most have GPS coordinates, a date
+ * and an embedded thumbnail, some lack one or the other, some are
+ * turned, and a few have no Exif data at all. Both byte orders are used.
+ * The images themselves are taken from a small pool, so making up
+ * 100000 photos costs little more than writing them.
+ * The same seed makes the same photos.
+ */
+class Corpus {
+public:
+    Corpus(unsigned int seed, int width = 640, int height = 480);
+    bool Write(const char *pathname);
+    const std::vector<unsigned char> &Next();
+    struct Truth {
+	bool exif;
+	bool gps;
+	double latitude;
+	double longitude;
+	bool thumbnail;
+	int orientation;
+	char date[20];
+    };
+    const Truth &Last() const;
+private:
+    void exif(std::vector<unsigned char> *app1);
+    static bool encode(std::mt19937 &random, int width, int height, int quality, std::vector<unsigned char> *jpeg);
+    std::mt19937 random;
+    std::vector<std::vector<unsigned char> > images;	// the pool, without SOI
+    std::vector<std::vector<unsigned char> > thumbnails;
+    std::vector<unsigned char> photo;	// the last one made up
+    Truth truth;			// and what is in it
+};
+
+// Number of different images and thumbnails in the pool
+# define	CORPUS_POOL	8
+# endif // CORPUS_H
@@ -0,0 +1,211 @@
+# include	<QFile>
+# include	<QTimer>
+# include	<QHostAddress>
+# include	"GeoServer.h"
+
+/*
+ * NAME: GeoServer
+ * PURPOSE: Constructor of the GeoServer class
+ * ARGUMENTS: parent: parent object
+ * RETURNS: Nothing
+ * NOTE: By default, every request is answered at once and successfully.
+ *	The random numbers are seeded with a constant, so runs can be
+ *	compared with each other.
+ */
+GeoServer::GeoServer(QObject *parent)
+    : QTcpServer(parent), random(4711)
+{
+    latency = 0;
+    jitter = 0;
+    tooMany = 0.0;
+    unavailable = 0.0;
+}
+
+/*
+ * NAME: Load
+ * PURPOSE: To read the recorded responses
+ * ARGUMENTS: filenames: files, each holding one "reverse?format=xml" response
+ * RETURNS: true if all files could be read
+ */
+bool
+GeoServer::Load(QStringList filenames)
+{
+    for (QStringList::iterator filename = filenames.begin(); filename != filenames.end(); filename++)
+    {
+	QFile file(*filename);
+
+	if (!file.open(QIODevice::ReadOnly))
+	    return false;
+	responses.append(file.readAll());
+    }
+
+    return responses.length() != 0;
+}
+
+/*
+ * NAME: SetLatency
+ * PURPOSE: To set the time it takes to answer a request
+ * ARGUMENTS: new_latency: minimum time in milliseconds
+ *	new_jitter: max random time in milliseconds on top of that
+ * RETURNS: Nothing
+ */
+void
+GeoServer::SetLatency(int new_latency, int new_jitter)
+{
+    latency = new_latency < 0 ? 0 : new_latency;
+    jitter = new_jitter < 0 ? 0 : new_jitter;
+}
+
+/*
+ * NAME: SetErrorRates
+ * PURPOSE: To set the fraction of requests that fail
+ * ARGUMENTS: new_tooMany: fraction answered with 429 Too Many Requests
+ *	new_unavailable: fraction answered with 503 Service Unavailable
+ * RETURNS: Nothing
+ */
+void
+GeoServer::SetErrorRates(double new_tooMany, double new_unavailable)
+{
+    tooMany = new_tooMany;
+    unavailable = new_unavailable;
+}
+
+/*
+ * NAME: BaseUrl
+ * PURPOSE: To tell the Resolver where to find us
+ * ARGUMENTS: None
+ * RETURNS: the base URL, eg "http://127.0.0.1:34567"
+ * NOTE: Only valid after listen()
+ */
+QByteArray
+GeoServer::BaseUrl() const
+{
+    return "http://" + serverAddress().toString().toUtf8() + ":" + QByteArray::number(serverPort());
+}
+
+/*
+ * NAME: Served
+ * PURPOSE: Access method of the response counters
+ * ARGUMENTS: None
+ * RETURNS: the number of responses sent, by HTTP status
+ */
+QMap<int,unsigned long>
+GeoServer::Served() const
+{
+    return served;
+}
+
+/*
+ * NAME: incomingConnection
+ * PURPOSE: To accept a connection
+ * ARGUMENTS: descriptor: the socket
+ * RETURNS: Nothing
+ * NOTE: The connection is kept open for further requests until the
+ *	client closes it.
+ */
+void
+GeoServer::incomingConnection(qintptr descriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+
+    socket->setSocketDescriptor(descriptor);
+    input.insert(socket, QByteArray());
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(dropConnection()));
+}
+
+/*
+ * NAME: dropConnection
+ * PURPOSE: To clean up after the client closed a connection
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: A reply still waiting for its latency to pass is dropped
+ *	along with the socket.
+ */
+void
+GeoServer::dropConnection()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    input.remove(socket);
+    socket->deleteLater();
+}
+
+/*
+ * NAME: readRequest
+ * PURPOSE: To read the requests that arrived on a connection
+ * ARGUMENTS: None
+ * RETURNS: Nothing
+ * NOTE: The requests are GETs without a body, a request is complete
+ *	once the empty line has been received. Only the target is taken
+ *	from the request, the header fields are ignored.
+ */
+void
+GeoServer::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = input[socket];
+    int end;
+
+    buffer += socket->readAll();
+    while ((end = buffer.indexOf("\r\n\r\n")) != -1)
+    {
+	QList<QByteArray> requestLine(buffer.left(buffer.indexOf("\r\n")).split(' '));
+	QByteArray target(requestLine.length() == 3 ? requestLine[1] : QByteArray());
+	int delay = latency + (jitter > 0 ? (int) (random() % (jitter + 1)) : 0);
+
+	buffer.remove(0, end + 4);
+	// The socket is the context: no reply if it has gone meanwhile
+	QTimer::singleShot(delay, socket, [this, socket, target] { reply(socket, target); });
+    }
+}
+
+/*
+ * NAME: reply
+ * PURPOSE: To answer a request
+ * ARGUMENTS: socket: the connection
+ *	target: the target of the request, eg "/reverse?format=xml&lat=..."
+ * RETURNS: Nothing
+ * NOTE: The response is chosen by the coordinates, so a pair of
+ *	coordinates always gets the same answer.
+ */
+void
+GeoServer::reply(QTcpSocket *socket, QByteArray target)
+{
+    std::uniform_real_distribution<double> dice(0.0, 1.0);
+    double roll = dice(random);
+    QByteArray status, body;
+    int code;
+
+    if (!target.startsWith("/reverse?"))
+    {
+	code = 404;
+	status = "404 Not Found";
+	body = "<error>Unknown request</error>\n";
+    }
+    else if (roll < tooMany)
+    {
+	code = 429;
+	status = "429 Too Many Requests";
+	body = "<error>Too many requests</error>\n";
+    }
+    else if (roll < tooMany + unavailable)
+    {
+	code = 503;
+	status = "503 Service Unavailable";
+	body = "<error>Service unavailable</error>\n";
+    }
+    else
+    {
+	code = 200;
+	status = "200 OK";
+	body = responses[qHash(target) % responses.length()];
+    }
+    served[code]++;
+
+    socket->write("HTTP/1.1 " + status + "\r\n"
+	"Content-Type: text/xml; charset=UTF-8\r\n"
+	"Content-Length: " + QByteArray::number(body.length()) + "\r\n"
+	+ (code == 429 ? "Retry-After: 1\r\n" : "")
+	+ "\r\n" + body);
+}
@@ -0,0 +1,44 @@
+# ifndef	GEOSERVER_H
+# define	GEOSERVER_H
+
+# include	<random>
+# include	<QTcpServer>
+# include	<QTcpSocket>
+# include	<QByteArray>
+# include	<QList>
+# include	<QHash>
+# include	<QMap>
+# include	<QStringList>
+
+/*
+ * A stand-in for the reverse geocoder: it answers "/reverse" requests
+ * by replaying recorded responses after a configurable latency,
+ * failing a configurable fraction of them with 429 or 503.
+ * It only speaks as much HTTP/1.1 as curl needs.
+ */
+class GeoServer : public QTcpServer {
+    Q_OBJECT
+public:
+    GeoServer(QObject *parent = 0);
+    bool Load(QStringList filenames);
+    void SetLatency(int new_latency, int new_jitter);
+    void SetErrorRates(double new_tooMany, double new_unavailable);
+    QByteArray BaseUrl() const;
+    QMap<int,unsigned long> Served() const;
+protected:
+    void incomingConnection(qintptr descriptor);
+private slots:
+    void readRequest();
+    void dropConnection();
+private:
+    void reply(QTcpSocket *socket, QByteArray target);
+    QHash<QTcpSocket *,QByteArray> input;	// partial requests by connection
+    QList<QByteArray> responses;
+    int latency;		// milliseconds
+    int jitter;			// milliseconds, added at random
+    double tooMany;		// fraction answered with 429
+    double unavailable;		// fraction answered with 503
+    std::mt19937 random;
+    QMap<int,unsigned long> served;	// number of responses by status
+};
+# endif // GEOSERVER_H
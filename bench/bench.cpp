@@ -0,0 +1,51 @@
+# include	<iostream>
+# include	<QApplication>
+# include	<QByteArray>
+# include	<QStringList>
+# include	"bench.h"
+
+using namespace std;
+
+/*
+ * The list of benchmarks, selected by the first argument
+ */
+static struct {
+    const char *name;
+    int (*func)(QStringList);
+    const char *usage;
+} benchmarks[] = {
+    { "exif", bench_exif, "exif [-n iterations] file.jpg ..." },
+    { "resolver", bench_resolver, "resolver [-n iterations] response.xml ..." },
+    { "serve", bench_serve, "serve [-p port] [-l ms] [-J ms] [-t fraction] [-e fraction] response.xml ..." },
+    { "geocoder", bench_geocoder, "geocoder [-n lookups] [-j inflight] [-r rate] [-u url] [-l ms] [-J ms] [-t fraction] [-e fraction] response.xml ..." },
+    { "thumbnail", bench_thumbnail, "thumbnail [-n iterations] file.jpg ..." },
+    { "locations", bench_locations, "locations [-n rows] [-i iterations]" },
+    { "corpus", bench_corpus, "corpus [-n photos] [-s seed] directory" },
+    { "suite", bench_suite, "suite [-n photos,...] [-s seed] [-r responses] [-j]" },
+    { NULL, NULL, NULL }
+};
+
+int
+main(int argc, char *argv[])
+{
+    // The suite paints the thumbnail view, which needs no screen
+    if (qgetenv("DISPLAY").isEmpty() && qgetenv("WAYLAND_DISPLAY").isEmpty() && qgetenv("QT_QPA_PLATFORM").isEmpty())
+	qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    QStringList args(app.arguments());
+
+    args.removeFirst();		// program name
+    if (args.length() > 0)
+    {
+	QString name(args.takeFirst());
+
+	for (int i = 0; benchmarks[i].name != NULL; i++)
+	    if (name == benchmarks[i].name)
+		return benchmarks[i].func(args);
+    }
+
+    cerr << "usage:" << endl;
+    for (int i = 0; benchmarks[i].name != NULL; i++)
+	cerr << "    " << argv[0] << " " << benchmarks[i].usage << endl;
+    return 255;
+}
@@ -0,0 +1,14 @@
+# ifndef	BENCH_H
+# define	BENCH_H
+
+# include	<QStringList>
+
+int bench_exif(QStringList args);
+int bench_resolver(QStringList args);
+int bench_serve(QStringList args);
+int bench_geocoder(QStringList args);
+int bench_thumbnail(QStringList args);
+int bench_locations(QStringList args);
+int bench_corpus(QStringList args);
+int bench_suite(QStringList args);
+# endif // BENCH_H
@@ -0,0 +1,19 @@
+######################################################################
+# Micro-benchmarks for fpv, built separately from the application:
+#	cd bench && qmake && make && ./fpv-bench
+######################################################################
+
+TEMPLATE = app
+TARGET = fpv-bench
+INCLUDEPATH += . ..
+QT += core network widgets concurrent
+CONFIG += c++11 console
+LIBS += -lcurl -lexif -ljpeg -lsqlite3
+
+# Input
+HEADERS += bench.h GeoServer.h Corpus.h ../Exif.h ../ExifParser.h ../Thumbnailer.h ../AsyncResolver.h ../Resolver.h ../GeoCache.h ../GeoDB.h ../Cluster.h ../LocationStore.h \
+	../MetaIndex.h ../ThumbPack.h ../Indexer.h ../Scheduler.h ../ThumbnailCache.h ../PhotoModel.h ../PhotoView.h ../Stats.h ../Catalog.h
+SOURCES += bench.cpp bench_exif.cpp bench_resolver.cpp bench_geocoder.cpp bench_thumbnail.cpp bench_locations.cpp bench_corpus.cpp bench_suite.cpp \
+	GeoServer.cpp Corpus.cpp \
+	../Exif.cpp ../ExifParser.cpp ../Thumbnailer.cpp ../AsyncResolver.cpp ../Resolver.cpp ../GeoCache.cpp ../GeoDB.cpp ../Cluster.cpp ../LocationStore.cpp \
+	../MetaIndex.cpp ../ThumbPack.cpp ../Indexer.cpp ../Scheduler.cpp ../ThumbnailCache.cpp ../PhotoModel.cpp ../PhotoView.cpp ../Stats.cpp ../Catalog.cpp
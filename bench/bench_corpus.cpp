@@ -0,0 +1,64 @@
+# include	<iostream>
+# include	<QDir>
+# include	<QFile>
+# include	<QElapsedTimer>
+# include	<QStringList>
+# include	"Corpus.h"
+# include	"bench.h"
+
+using namespace std;
+
+/*
+ * NAME: bench_corpus
+ * PURPOSE: To make up photos to try fpv or the other benchmarks on
+ * ARGUMENTS: args: [-n photos] [-s seed] directory
+ * RETURNS: exit code
+ * NOTE: The photos are named IMG_000000.jpg, IMG_000001.jpg, ...
+ *	The directory is created if need be.
+ */
+int
+bench_corpus(QStringList args)
+{
+    int photos = 1000;
+    unsigned int seed = 1;
+    QElapsedTimer timer;
+
+    while (args.length() >= 2)
+    {
+	if (args[0] == "-n")
+	    photos = args[1].toInt();
+	else if (args[0] == "-s")
+	    seed = args[1].toUInt();
+	else
+	    break;
+	args.removeFirst();
+	args.removeFirst();
+    }
+    if (args.length() != 1 || photos < 1)
+    {
+	cerr << "corpus: no directory given" << endl;
+	return 255;
+    }
+    if (!QDir().mkpath(args[0]))
+    {
+	cerr << "corpus: cannot create " << args[0].toStdString() << endl;
+	return 255;
+    }
+
+    Corpus corpus(seed);
+    timer.start();
+    for (int i = 0; i < photos; i++)
+    {
+	QString pathname(QString("%1/IMG_%2.jpg").arg(args[0]).arg(i, 6, 10, QChar('0')));
+
+	if (!corpus.Write(QFile::encodeName(pathname).constData()))
+	{
+	    cerr << "corpus: cannot write " << pathname.toStdString() << endl;
+	    return 1;
+	}
+    }
+
+    cout << "photos:     " << photos << endl;
+    cout << "written in: " << timer.elapsed() << " ms" << endl;
+    return 0;
+}
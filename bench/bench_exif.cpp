@@ -0,0 +1,135 @@
+# include	<stdlib.h>
+# include	<iostream>
+# include	<libexif/exif-loader.h>
+# include	<QElapsedTimer>
+# include	<QFile>
+# include	<QList>
+# include	<QByteArray>
+# include	"ExifParser.h"
+# include	"bench.h"
+
+using namespace std;
+
+// Keeps the compiler from optimizing the work away
+static volatile double sink;
+
+/*
+ * NAME: with_libexif
+ * PURPOSE: To extract the fields fpv needs the way Exif did before
+ *	the fast parser: full decode by libexif
+ * ARGUMENTS: pathname: image file
+ * RETURNS: Nothing
+ */
+static void
+with_libexif(const char *pathname)
+{
+    ExifLoader *el;
+    ExifData *ed;
+    char buffer[128];
+    double v = 0.0;
+
+    if ((el = exif_loader_new()) == NULL)
+	return;
+    exif_loader_write_file(el, pathname);
+    ed = exif_loader_get_data(el);
+    exif_loader_unref(el);
+    if (ed == NULL)
+	return;
+
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LATITUDE, buffer, sizeof(buffer)) != NULL)
+	v += strtod(buffer, NULL);
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LATITUDE_REF, buffer, sizeof(buffer)) != NULL)
+	v += buffer[0];
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LONGITUDE, buffer, sizeof(buffer)) != NULL)
+	v += strtod(buffer, NULL);
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_GPS], (ExifTag) EXIF_TAG_GPS_LONGITUDE_REF, buffer, sizeof(buffer)) != NULL)
+	v += buffer[0];
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_EXIF], EXIF_TAG_DATE_TIME_ORIGINAL, buffer, sizeof(buffer)) != NULL)
+	v += buffer[0];
+    if (exif_content_get_value(ed->ifd[EXIF_IFD_0], EXIF_TAG_ORIENTATION, buffer, sizeof(buffer)) != NULL)
+	v += buffer[0];
+    if (ed->data != NULL)
+	v += ed->data[ed->size / 2];
+
+    exif_data_free(ed);
+    sink = v;
+}
+
+/*
+ * NAME: with_parser
+ * PURPOSE: To extract the same fields with the fast parser
+ * ARGUMENTS: pathname: image file
+ * RETURNS: Nothing
+ */
+static void
+with_parser(const char *pathname)
+{
+    ExifParser parser;
+    const unsigned char *thumbnail;
+    size_t length;
+    double v = 0.0;
+
+    if (parser.Parse(pathname) != ExifParser::Ok)
+	return;
+
+    const ExifFields &f = parser.Fields();
+    v = f.latitude + f.longitude + f.date[0] + f.orientation;
+    if ((thumbnail = parser.Thumbnail(&length)) != NULL)
+	v += thumbnail[length / 2];
+    sink = v;
+}
+
+/*
+ * NAME: bench_exif
+ * PURPOSE: To compare libexif with the fast parser
+ * ARGUMENTS: args: [-n iterations] file.jpg ...
+ * RETURNS: exit code
+ * NOTE: The files should be in the page cache, so the first round is
+ *	not timed.
+ */
+int
+bench_exif(QStringList args)
+{
+    int iterations = 10;
+    QList<QByteArray> files;
+    QElapsedTimer timer;
+    qint64 slow, fast;
+
+    if (args.length() >= 2 && args[0] == "-n")
+    {
+	iterations = args[1].toInt();
+	args.removeFirst();
+	args.removeFirst();
+    }
+    for (QStringList::iterator arg = args.begin(); arg != args.end(); arg++)
+	files.append(QFile::encodeName(*arg));
+    if (files.length() == 0 || iterations < 1)
+    {
+	cerr << "exif: no files given" << endl;
+	return 255;
+    }
+
+    // warm up the page cache
+    for (QList<QByteArray>::iterator f = files.begin(); f != files.end(); f++)
+	with_libexif(f->constData());
+
+    timer.start();
+    for (int i = 0; i < iterations; i++)
+	for (QList<QByteArray>::iterator f = files.begin(); f != files.end(); f++)
+	    with_libexif(f->constData());
+    slow = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i = 0; i < iterations; i++)
+	for (QList<QByteArray>::iterator f = files.begin(); f != files.end(); f++)
+	    with_parser(f->constData());
+    fast = timer.nsecsElapsed();
+
+    qint64 n = (qint64) iterations * files.length();
+    cout << "files:      " << files.length() << " x " << iterations << endl;
+    cout << "libexif:    " << slow / n << " ns/file" << endl;
+    cout << "ExifParser: " << fast / n << " ns/file" << endl;
+    cout << "speedup:    " << (fast > 0 ? (double) slow / fast : 0.0) << endl;
+
+    return 0;
+}
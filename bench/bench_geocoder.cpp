@@ -0,0 +1,214 @@
+# include	<iostream>
+# include	<algorithm>
+# include	<curl/curl.h>
+# include	<QCoreApplication>
+# include	<QElapsedTimer>
+# include	<QEventLoop>
+# include	<QHostAddress>
+# include	<QVector>
+# include	"GeoServer.h"
+# include	"AsyncResolver.h"
+# include	"Resolver.h"
+# include	"bench.h"
+
+using namespace std;
+
+/*
+ * Options of the stand-in, shared by "serve" and "geocoder"
+ */
+struct ServerOptions {
+    int port;
+    int latency;
+    int jitter;
+    double tooMany;
+    double unavailable;
+};
+
+/*
+ * NAME: server_option
+ * PURPOSE: To take an option of the stand-in off the argument list
+ * ARGUMENTS: args: the arguments, the option and its value are removed
+ *	options: where to store the value
+ * RETURNS: true if args[0] was such an option
+ */
+static bool
+server_option(QStringList &args, ServerOptions *options)
+{
+    if (args.length() < 2)
+	return false;
+
+    if (args[0] == "-p")
+	options->port = args[1].toInt();
+    else if (args[0] == "-l")
+	options->latency = args[1].toInt();
+    else if (args[0] == "-J")
+	options->jitter = args[1].toInt();
+    else if (args[0] == "-t")
+	options->tooMany = args[1].toDouble();
+    else if (args[0] == "-e")
+	options->unavailable = args[1].toDouble();
+    else
+	return false;
+
+    args.removeFirst();
+    args.removeFirst();
+    return true;
+}
+
+/*
+ * NAME: start_server
+ * PURPOSE: To set up the stand-in and have it listen on the loopback interface
+ * ARGUMENTS: server: the stand-in
+ *	options: its options
+ *	responses: files with recorded responses
+ * RETURNS: true if the stand-in is listening
+ */
+static bool
+start_server(GeoServer *server, const ServerOptions &options, QStringList responses)
+{
+    if (!server->Load(responses))
+    {
+	cerr << "geoserver: cannot read the responses" << endl;
+	return false;
+    }
+    server->SetLatency(options.latency, options.jitter);
+    server->SetErrorRates(options.tooMany, options.unavailable);
+    if (!server->listen(QHostAddress::LocalHost, options.port))
+    {
+	cerr << "geoserver: " << server->errorString().toStdString() << endl;
+	return false;
+    }
+
+    return true;
+}
+
+/*
+ * NAME: bench_serve
+ * PURPOSE: To run the stand-in for the reverse geocoder until interrupted
+ * ARGUMENTS: args: [-p port] [-l ms] [-J ms] [-t fraction] [-e fraction] response.xml ...
+ * RETURNS: exit code
+ * NOTE: Point fpv at it with --geocoder
+ */
+int
+bench_serve(QStringList args)
+{
+    ServerOptions options = { 8080, 0, 0, 0.0, 0.0 };
+    GeoServer server;
+
+    while (server_option(args, &options))
+	;
+    if (!start_server(&server, options, args))
+	return 255;
+
+    cout << "listening on " << server.BaseUrl().constData() << endl;
+    return QCoreApplication::exec();
+}
+
+/*
+ * NAME: bench_geocoder
+ * PURPOSE: To measure the throughput of the AsyncResolver
+ * ARGUMENTS: args: [-n lookups] [-j inflight] [-r rate] [-u url]
+ *	[-l ms] [-J ms] [-t fraction] [-e fraction] response.xml ...
+ * RETURNS: exit code
+ * NOTE: Unless a URL is given, the stand-in runs in this process on
+ *	a free port. The benchmark keeps "inflight" lookups going, each
+ *	for different coordinates, so neither clustering nor caching
+ *	get in the way. The latency is measured from Lookup() to
+ *	resolved() and includes the wait for the token bucket.
+ */
+int
+bench_geocoder(QStringList args)
+{
+    ServerOptions options = { 0, 0, 0, 0.0, 0.0 };
+    int lookups = 1000, inflight = 2;
+    double rate = 0.0;
+    QString url;
+    GeoServer server;
+
+    while (args.length() >= 2)
+    {
+	if (server_option(args, &options))
+	    continue;
+	if (args[0] == "-n")
+	    lookups = args[1].toInt();
+	else if (args[0] == "-j")
+	    inflight = args[1].toInt();
+	else if (args[0] == "-r")
+	    rate = args[1].toDouble();
+	else if (args[0] == "-u")
+	    url = args[1];
+	else
+	    break;
+	args.removeFirst();
+	args.removeFirst();
+    }
+    if (lookups < 1 || inflight < 1)
+    {
+	cerr << "geocoder: need at least one lookup in flight" << endl;
+	return 255;
+    }
+    if (url.length() == 0)
+    {
+	if (!start_server(&server, options, args))
+	    return 255;
+	url = server.BaseUrl();
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    Resolver::SetBaseUrl(url);
+
+    QVector<qint64> started(lookups), latency;
+    QElapsedTimer clock;
+    QEventLoop loop;
+    int next = 0, done = 0, failed = 0;
+    AsyncResolver resolver(inflight, rate);
+
+    latency.reserve(lookups);
+    // Coordinates on a grid around Paderborn, about 100m apart
+    auto lookup = [&](int i) {
+	started[i] = clock.nsecsElapsed();
+	resolver.Lookup(i, 8.7 + (i % 100) * 0.0014, 51.7 + (i / 100) * 0.0009);
+    };
+    QObject::connect(&resolver, &AsyncResolver::resolved, &loop, [&](int id, QString location) {
+	latency.append(clock.nsecsElapsed() - started[id]);
+	if (location.length() == 0)
+	    failed++;
+	if (++done == lookups)
+	    loop.quit();
+	else if (next < lookups)
+	    lookup(next++);
+    });
+
+    clock.start();
+    while (next < lookups && next < inflight)
+	lookup(next++);
+    loop.exec();
+    double seconds = clock.nsecsElapsed() / 1e9;
+
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&](double p) -> double {
+	return latency[qMin(latency.size() - 1, (int) (p / 100.0 * latency.size()))] / 1e6;
+    };
+
+    cout << "url:        " << url.toStdString() << endl;
+    cout << "lookups:    " << lookups << " (" << inflight << " in flight";
+    if (rate > 0.0)
+	cout << ", " << rate << "/s";
+    cout << ")" << endl;
+    cout << "failed:     " << failed << endl;
+    cout << "requests:   " << resolver.Requests() << endl;
+    cout << "lookups/s:  " << lookups / seconds << endl;
+    cout << "latency ms: p50 " << percentile(50) << "  p90 " << percentile(90)
+	 << "  p99 " << percentile(99) << "  max " << latency.last() / 1e6 << endl;
+    if (server.isListening())
+    {
+	QMap<int,unsigned long> served(server.Served());
+
+	cout << "served:    ";
+	for (QMap<int,unsigned long>::iterator s = served.begin(); s != served.end(); s++)
+	    cout << " " << s.key() << " x" << s.value();
+	cout << endl;
+    }
+
+    return 0;
+}
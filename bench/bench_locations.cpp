@@ -0,0 +1,170 @@
+# include	<sys/types.h>
+# include	<dirent.h>
+# include	<unistd.h>
+# include	<iostream>
+# include	<QElapsedTimer>
+# include	<QTemporaryDir>
+# include	<QFile>
+# include	<QTextStream>
+# include	<QStringList>
+# include	<QMap>
+# include	<QSet>
+# include	"LocationStore.h"
+# include	"bench.h"
+
+using namespace std;
+
+// Keeps the compiler from optimizing the work away
+static volatile int sink;
+
+/*
+ * NAME: with_textstream
+ * PURPOSE: To load a location map the way Indexer did before the
+ *	store was mapped: QTextStream, three replaceInStrings() passes
+ *	and an access() per row
+ * ARGUMENTS: directory: where .location.csv is
+ * RETURNS: Nothing
+ */
+static void
+with_textstream(const QString &directory)
+{
+    QFile inputFile(directory + "/.location.csv");
+    QMap<QString,QString> locations;
+
+    if (inputFile.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+	QTextStream in(&inputFile);
+	while (!in.atEnd())
+	{
+	    QString line = in.readLine();
+
+	    while (1)
+	        if (line.endsWith('\r') || line.endsWith('\n'))
+		    line.remove(line.length()-1, 1);
+		else
+		    break;
+
+	    QStringList fields = line.split(',');
+	    fields.replaceInStrings("%2c", ",");
+	    fields.replaceInStrings("%22", "\"");
+	    fields.replaceInStrings("%25", "%");
+	    for (QStringList::iterator e = fields.begin(); e != fields.end(); e++)
+	    {
+	        if (e->startsWith('"') && e->endsWith('"'))
+		{
+		    e->remove(0, 1);
+		    e->remove(e->size()-1, 1);
+		}
+	    }
+
+	    if (access(QFile::encodeName(directory + "/" + fields[0]).constData(), F_OK) == -1)
+	        continue;
+	    locations.insert(fields[0], fields[1]);
+	}
+	inputFile.close();
+    }
+    sink = locations.size();
+}
+
+/*
+ * NAME: with_store
+ * PURPOSE: To load a location map the way Indexer does now:
+ *	LocationStore and a single pass over the directory
+ * ARGUMENTS: directory: where .location.csv is
+ * RETURNS: Nothing
+ */
+static void
+with_store(const QString &directory)
+{
+    LocationStore store(directory);
+    QMap<QString,QString> locations;
+    QSet<QString> files;
+    DIR *dir;
+    struct dirent *entry;
+    int found = 0;
+
+    store.Load(&locations);
+    if ((dir = opendir(QFile::encodeName(directory).constData())) != NULL)
+    {
+	while ((entry = readdir(dir)) != NULL)
+	    if (entry->d_type != DT_DIR)
+		files.insert(QFile::decodeName(entry->d_name));
+	closedir(dir);
+    }
+    for (QMap<QString,QString>::iterator l = locations.begin(); l != locations.end(); l++)
+	if (files.contains(l.key()))
+	    found++;
+    sink = found;
+}
+
+/*
+ * NAME: bench_locations
+ * PURPOSE: To compare the old and the new way of loading .location.csv
+ * ARGUMENTS: args: [-n rows] [-i iterations]
+ * RETURNS: exit code
+ * NOTE: A directory with that many (empty) photos and a location map
+ *	with a row for each of them is made up in /tmp. Every 16th
+ *	location has a "," in it, so it has to be decoded.
+ */
+int
+bench_locations(QStringList args)
+{
+    int rows = 100000, iterations = 5;
+    QTemporaryDir directory;
+    QElapsedTimer timer;
+    qint64 slow, fast;
+
+    while (args.length() >= 2)
+    {
+	if (args[0] == "-n")
+	    rows = args[1].toInt();
+	else if (args[0] == "-i")
+	    iterations = args[1].toInt();
+	else
+	    break;
+	args.removeFirst();
+	args.removeFirst();
+    }
+    if (!directory.isValid() || rows < 1 || iterations < 1)
+    {
+	cerr << "locations: cannot make up a directory" << endl;
+	return 255;
+    }
+
+    QFile csv(directory.path() + "/.location.csv");
+    if (!csv.open(QIODevice::WriteOnly))
+    {
+	cerr << "locations: cannot write " << csv.fileName().toStdString() << endl;
+	return 255;
+    }
+    for (int i = 0; i < rows; i++)
+    {
+	QString name(QString("IMG_%1.jpg").arg(i, 6, 10, QChar('0')));
+	QFile photo(directory.path() + "/" + name);
+
+	photo.open(QIODevice::WriteOnly);
+	csv.write(QString("\"%1\",\"%2 %3%4 Musterstadt\"\n")
+		  .arg(name).arg("Hauptstraße").arg(i % 100).arg(i % 16 == 0 ? "%2c" : "").toUtf8());
+    }
+    csv.close();
+
+    // warm up the page and dentry caches
+    with_textstream(directory.path());
+
+    timer.start();
+    for (int i = 0; i < iterations; i++)
+	with_textstream(directory.path());
+    slow = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i = 0; i < iterations; i++)
+	with_store(directory.path());
+    fast = timer.nsecsElapsed();
+
+    cout << "rows:          " << rows << " x " << iterations << endl;
+    cout << "QTextStream:   " << slow / iterations / 1000000 << " ms/load, " << slow / iterations / rows << " ns/row" << endl;
+    cout << "LocationStore: " << fast / iterations / 1000000 << " ms/load, " << fast / iterations / rows << " ns/row" << endl;
+    cout << "speedup:       " << (fast > 0 ? (double) slow / fast : 0.0) << endl;
+
+    return 0;
+}
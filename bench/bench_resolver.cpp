@@ -0,0 +1,178 @@
+# include	<iostream>
+# include	<QElapsedTimer>
+# include	<QFile>
+# include	<QList>
+# include	<QRegExp>
+# include	<QRegularExpression>
+# include	"Resolver.h"
+# include	"bench.h"
+
+using namespace std;
+
+/*
+ * The pattern matching as it was before Resolver compiled its patterns,
+ * kept here to compare against.
+ */
+static QString legacyPattern[] = {
+    "<road> <house_number?>, <postcode?> <city|town|village|city_district>, <country>",
+    "<pedestrian>, <postcode?> <city|town|village|city_district>, <country>",
+    "<footway|path|locality|cycleway|suburb>, <postcode?> <city|town|village|city_district>, <country>",
+    "<city|town|village|city_district>, <country>",
+    ""
+};
+
+/*
+ * NAME: legacy_resolve_pattern
+ * PURPOSE: To resolve a given pattern using data from an XML structure
+ *	(one regular expression per alternative, the old way)
+ * ARGUMENTS: pat: pattern, eg "<pedestrian>, <postcode?> <city>, <country>"
+ *	xml: XML string to use
+ * RETURNS: resolved string if ALL fields in the pattern can be resolved
+ *	else returns empty string
+ */
+static QString
+legacy_resolve_pattern(QString pat, QString xml)
+{
+    int len = pat.length(), i = 0;
+    QString result;
+
+    while (i < len)
+    {
+        QString c, tag;
+	QRegularExpression re;
+	int end;
+	bool match, optional;
+
+        c = pat[i];
+	if (c != "<") {
+	    result += c;
+	    i++;
+	    continue;
+	}
+	end = pat.indexOf('>', i);
+	if (end == -1)
+	    break;
+
+	tag = pat.mid(i+1, end-i-1);
+	if ((optional = tag.endsWith('?')))
+	    tag.chop(1);
+
+	QStringList alternatives(tag.split('|'));
+	match = false;
+	for (QStringList::iterator alternative = alternatives.begin(); alternative != alternatives.end(); alternative++)
+	{
+	    re = QRegularExpression("<" + *alternative + ">([^>]+)</" + *alternative + ">");
+	    if ((match = re.match(xml).hasMatch()))
+		break;
+	}
+	if (!optional && !match)
+	    break;
+
+	if (match)
+	    result += re.match(xml).captured(1);
+
+	i = end + 1;
+    }
+
+    return (i >= len) ? result : QString("");
+}
+
+/*
+ * NAME: legacy_compose
+ * PURPOSE: To compose a location the old way
+ * ARGUMENTS: s: the XML response
+ * RETURNS: the location or an empty string
+ */
+static QString
+legacy_compose(QString s)
+{
+    QString location;
+
+    for (int i = 0; legacyPattern[i].length() != 0; i++)
+    {
+	location = legacy_resolve_pattern(legacyPattern[i], s);
+
+	if (location.length())
+	{
+	    location.replace(QRegExp("\\s+"), " ");
+	    location.replace(QRegExp("\\s+,"), ",");
+	    break;
+	}
+    }
+
+    return location;
+}
+
+/*
+ * NAME: bench_resolver
+ * PURPOSE: To compare the old and the new way of turning
+ *	responses of the reverse geocoder into locations
+ * ARGUMENTS: args: [-n iterations] response.xml ...
+ * RETURNS: exit code, 1 if the results differ
+ * NOTE: bench/responses holds a few sample responses
+ */
+int
+bench_resolver(QStringList args)
+{
+    int iterations = 1000, mismatches = 0;
+    QList<QString> corpus;
+    QElapsedTimer timer;
+    qint64 slow, fast;
+    volatile int sink = 0;
+
+    if (args.length() >= 2 && args[0] == "-n")
+    {
+	iterations = args[1].toInt();
+	args.removeFirst();
+	args.removeFirst();
+    }
+    for (QStringList::iterator arg = args.begin(); arg != args.end(); arg++)
+    {
+	QFile file(*arg);
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+	    cerr << "resolver: cannot read " << arg->toStdString() << endl;
+	    return 255;
+	}
+	corpus.append(QString::fromUtf8(file.readAll()));
+    }
+    if (corpus.length() == 0 || iterations < 1)
+    {
+	cerr << "resolver: no responses given" << endl;
+	return 255;
+    }
+
+    // Both ways must give the same answer
+    for (int i = 0; i < corpus.length(); i++)
+    {
+	QString before(legacy_compose(corpus[i])), after(Resolver::Compose(corpus[i]));
+
+	if (before != after)
+	{
+	    cerr << args[i].toStdString() << ": \"" << before.toStdString()
+		 << "\" != \"" << after.toStdString() << "\"" << endl;
+	    mismatches++;
+	}
+    }
+
+    timer.start();
+    for (int i = 0; i < iterations; i++)
+	for (QList<QString>::iterator response = corpus.begin(); response != corpus.end(); response++)
+	    sink += legacy_compose(*response).length();
+    slow = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i = 0; i < iterations; i++)
+	for (QList<QString>::iterator response = corpus.begin(); response != corpus.end(); response++)
+	    sink += Resolver::Compose(*response).length();
+    fast = timer.nsecsElapsed();
+
+    qint64 n = (qint64) iterations * corpus.length();
+    cout << "responses:  " << corpus.length() << " x " << iterations << endl;
+    cout << "regex:      " << slow / n << " ns/response" << endl;
+    cout << "compiled:   " << fast / n << " ns/response" << endl;
+    cout << "speedup:    " << (fast > 0 ? (double) slow / fast : 0.0) << endl;
+
+    return mismatches ? 1 : 0;
+}
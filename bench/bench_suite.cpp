@@ -0,0 +1,348 @@
+# include	<stdio.h>
+# include	<string.h>
+# include	<math.h>
+# include	<iostream>
+# include	<iomanip>
+# include	<QApplication>
+# include	<QElapsedTimer>
+# include	<QTemporaryDir>
+# include	<QDir>
+# include	<QFile>
+# include	<QPixmap>
+# include	<QStringList>
+# include	<QVector>
+# include	<QList>
+# include	<QHash>
+# include	<QMap>
+# include	"Corpus.h"
+# include	"Exif.h"
+# include	"MetaIndex.h"
+# include	"ThumbPack.h"
+# include	"LocationStore.h"
+# include	"Resolver.h"
+# include	"Indexer.h"
+# include	"ThumbnailCache.h"
+# include	"PhotoModel.h"
+# include	"PhotoView.h"
+# include	"Catalog.h"
+# include	"bench.h"
+
+using namespace std;
+
+// What Indexer and PhotoModel expect fpv.cpp to define
+int debug = 0;
+double cluster_radius = 25.0;
+int resolver_inflight = 2;
+Catalog *catalog = NULL;		// not measured
+QHash<QString,MetaIndex *> metaindexes;
+
+// Keeps the compiler from optimizing the work away
+static volatile double sink;
+
+// Print the results as JSON lines rather than as a table
+static bool json = false;
+
+/*
+ * NAME: report
+ * PURPOSE: To print the result of one measurement
+ * ARGUMENTS: benchmark: what was measured, eg "exif"
+ *	photos: size of the corpus
+ *	metric: eg "extract"
+ *	value: the result
+ *	unit: eg "ns/photo"
+ * RETURNS: Nothing
+ * NOTE: One JSON object per line, eg
+ *	{"benchmark":"exif","photos":1000,"metric":"extract","value":8312,"unit":"ns/photo"}
+ *	so the results of two releases can be compared by a script.
+ */
+static void
+report(const char *benchmark, int photos, const char *metric, double value, const char *unit)
+{
+    if (json)
+	cout << "{\"benchmark\":\"" << benchmark << "\",\"photos\":" << photos
+	     << ",\"metric\":\"" << metric << "\",\"value\":" << fixed << setprecision(1) << value
+	     << ",\"unit\":\"" << unit << "\"}" << endl;
+    else
+	cout << left << setw(10) << benchmark << right << setw(7) << photos << "  "
+	     << left << setw(12) << metric << right << setw(12) << fixed << setprecision(1) << value
+	     << " " << unit << endl;
+}
+
+/*
+ * NAME: per
+ * PURPOSE: To turn a time into a time per item
+ * ARGUMENTS: nsecs: the time
+ *	n: number of items
+ * RETURNS: nanoseconds per item
+ */
+static double
+per(qint64 nsecs, int n)
+{
+    return n > 0 ? (double) nsecs / n : 0.0;
+}
+
+/*
+ * NAME: run
+ * PURPOSE: To measure the pipeline on a corpus of a given size
+ * ARGUMENTS: photos: number of photos
+ *	seed: for the corpus
+ *	responses: recorded geocoder responses
+ * RETURNS: number of photos whose Exif data was not read back as written
+ * NOTE: The steps are the ones fpv goes through: the Exif data is
+ *	read, the thumbnails are stored, the locations are saved and
+ *	loaded, the geocoder responses are turned into locations and
+ *	finally the thumbnail view is built and painted once.
+ */
+static int
+run(int photos, unsigned int seed, const QList<QString> &responses)
+{
+    QTemporaryDir temporary;
+    QString directory(temporary.path());
+    QElapsedTimer timer;
+    QStringList names;
+    QVector<Corpus::Truth> truths;
+    QMap<QByteArray,MetaRecord> records;
+    QMap<QString,QString> locations;
+    int mismatches = 0;
+
+    if (!temporary.isValid())
+    {
+	cerr << "suite: cannot make up a directory" << endl;
+	return photos;
+    }
+
+    // The photos
+    Corpus corpus(seed);
+    timer.start();
+    for (int i = 0; i < photos; i++)
+    {
+	QString name(QString("IMG_%1.jpg").arg(i, 6, 10, QChar('0')));
+
+	corpus.Write(QFile::encodeName(directory + "/" + name).constData());
+	names.append(name);
+	truths.append(corpus.Last());
+    }
+    report("corpus", photos, "write", per(timer.nsecsElapsed(), photos), "ns/photo");
+
+    // The fields the indexer reads
+    timer.restart();
+    for (int i = 0; i < photos; i++)
+    {
+	Exif exif(directory + "/" + names[i]);
+	MetaRecord record;
+	unsigned long position, length;
+
+	memset(&record, 0, sizeof(record));
+	record.latitude = exif.Latitude();
+	record.longitude = exif.Longitude();
+	record.timestamp = exif.Timestamp();
+	record.orientation = exif.OrientationCode();
+	if (exif.ThumbnailPosition(&position, &length))
+	    sink = position + length;
+	records.insert(names[i].toUtf8(), record);
+    }
+    report("exif", photos, "extract", per(timer.nsecsElapsed(), photos), "ns/photo");
+
+    for (int i = 0; i < photos; i++)
+    {
+	const MetaRecord &record = records[names[i].toUtf8()];
+
+	if (truths[i].gps && (fabs(record.latitude - truths[i].latitude) > 1e-4
+			   || fabs(record.longitude - truths[i].longitude) > 1e-4))
+	    mismatches++;
+    }
+    report("exif", photos, "mismatches", mismatches, "photos");
+
+    // Coordinates as libexif formats them
+    QVector<QByteArray> coordinates;
+    for (int i = 0; i < photos; i++)
+	if (truths[i].gps)
+	{
+	    double degrees = fabs(truths[i].latitude), minutes = (degrees - (int) degrees) * 60;
+	    char buffer[64];
+
+	    snprintf(buffer, sizeof(buffer), "%d, %d, %.4f", (int) degrees, (int) minutes, (minutes - (int) minutes) * 60);
+	    coordinates.append(buffer);
+	}
+    timer.restart();
+    for (QVector<QByteArray>::iterator c = coordinates.begin(); c != coordinates.end(); c++)
+	sink = Exif::ConvertLatLon(c->constData());
+    report("latlon", photos, "convert", per(timer.nsecsElapsed(), coordinates.size()), "ns/call");
+
+    // The thumbnails, as single files and into the pack
+    timer.restart();
+    for (int i = 0; i < photos; i++)
+    {
+	Exif exif(directory + "/" + names[i]);
+
+	sink = exif.SaveThumbnail(directory + "/.thumbnails", names[i]);
+    }
+    report("thumbnail", photos, "save", per(timer.nsecsElapsed(), photos), "ns/photo");
+
+    {
+	ThumbPack pack(directory + "/.fpv-thumbs", true);
+
+	timer.restart();
+	for (int i = 0; i < photos; i++)
+	{
+	    Exif exif(directory + "/" + names[i]);
+	    QByteArray name(names[i].toUtf8());
+	    MetaRecord &record = records[name];
+	    const unsigned char *data;
+	    size_t length;
+	    quint32 offset;
+
+	    if ((data = exif.Thumbnail(&length)) != NULL && length != 0
+	     && pack.Append(name, data, length, &offset))
+	    {
+		record.thumbnailKind = THUMB_PACK;
+		record.thumbnailOffset = offset;
+		record.thumbnailLength = length;
+	    }
+	}
+	report("thumbnail", photos, "pack", per(timer.nsecsElapsed(), photos), "ns/photo");
+    }
+
+    // The locations: all of them saved, loaded, and 1% of them changed
+    for (int i = 0; i < photos; i++)
+	if (truths[i].gps)
+	    locations.insert(names[i], QString("Hauptstraße %1%2, %3 Musterstadt, Deutschland")
+			     .arg(i % 100).arg(i % 16 == 0 ? "," : "").arg(10000 + i % 90000));
+    {
+	LocationStore store(directory);
+
+	timer.restart();
+	store.Save(locations, locations, QStringList());
+	report("locations", photos, "save", per(timer.nsecsElapsed(), locations.size()), "ns/row");
+    }
+    {
+	LocationStore store(directory);
+	QMap<QString,QString> loaded, changed;
+	int row = 0;
+
+	timer.restart();
+	store.Load(&loaded);
+	report("locations", photos, "load", per(timer.nsecsElapsed(), loaded.size()), "ns/row");
+
+	for (QMap<QString,QString>::iterator l = loaded.begin(); l != loaded.end(); l++)
+	    if (row++ % 100 == 0)
+	    {
+		l.value() += " (2)";
+		changed.insert(l.key(), l.value());
+	    }
+	timer.restart();
+	store.Save(loaded, changed, QStringList());
+	report("locations", photos, "update", timer.nsecsElapsed() / 1000.0, "us");
+    }
+
+    // The geocoder responses, one per photo
+    if (responses.length() > 0)
+    {
+	timer.restart();
+	for (int i = 0; i < photos; i++)
+	    sink = Resolver::Compose(responses[i % responses.length()]).length();
+	report("resolver", photos, "compose", per(timer.nsecsElapsed(), photos), "ns/photo");
+    }
+
+    // The thumbnail view, as Viewer::createBox() builds it
+    MetaIndex::Save(directory + "/.fpv-index", records);
+    MetaIndex *index = new MetaIndex(directory + "/.fpv-index");
+    ThumbnailCache cache((qint64) 64 * 1024 * 1024, THUMB_SIZE);
+    PackMap packs;
+    QStringList shown(locations.keys());
+
+    metaindexes.insert("", index);
+    packs.insert("", Indexer::Thumbnails(directory, *index));
+    shown.sort(Qt::CaseInsensitive);
+
+    timer.restart();
+    PhotoView *view = new PhotoView(&cache, packs);
+    PhotoModel *model = new PhotoModel(shown, &locations, view);
+    view->setModel(model);
+    report("display", photos, "create", timer.nsecsElapsed() / 1000.0, "us");
+
+    view->resize(1024, 768);
+    timer.restart();
+    QPixmap painted(view->grab());
+    report("display", photos, "paint", timer.nsecsElapsed() / 1000.0, "us");
+    sink = painted.width() + model->rowCount();
+
+    delete view;
+    cache.CancelAll();
+    metaindexes.remove("");
+    delete index;
+
+    return mismatches;
+}
+
+/*
+ * NAME: bench_suite
+ * PURPOSE: To measure the whole pipeline on made up photos
+ * ARGUMENTS: args: [-n photos,...] [-s seed] [-r responses] [-j]
+ * RETURNS: exit code
+ * NOTE: By default the corpus has 1000, 10000 and 100000 photos.
+ *	The geocoder responses are the *.xml files in the responses
+ *	directory, "responses" if none is given. -j prints JSON lines.
+ */
+int
+bench_suite(QStringList args)
+{
+    QStringList sizes(QString("1000,10000,100000").split(','));
+    QString responseDirectory("responses");
+    QList<QString> responses;
+    unsigned int seed = 1;
+    int mismatches = 0;
+
+    while (args.length() >= 1)
+    {
+	if (args[0] == "-j")
+	{
+	    json = true;
+	    args.removeFirst();
+	    continue;
+	}
+	if (args.length() < 2)
+	    break;
+	if (args[0] == "-n")
+	    sizes = args[1].split(',');
+	else if (args[0] == "-s")
+	    seed = args[1].toUInt();
+	else if (args[0] == "-r")
+	    responseDirectory = args[1];
+	else
+	    break;
+	args.removeFirst();
+	args.removeFirst();
+    }
+    if (args.length() != 0)
+    {
+	cerr << "suite: unknown argument " << args[0].toStdString() << endl;
+	return 255;
+    }
+
+    QDir dir(responseDirectory);
+    QStringList xml(dir.entryList(QStringList() << "*.xml", QDir::Files, QDir::Name));
+    for (QStringList::iterator name = xml.begin(); name != xml.end(); name++)
+    {
+	QFile file(dir.filePath(*name));
+
+	if (file.open(QIODevice::ReadOnly))
+	    responses.append(QString::fromUtf8(file.readAll()));
+    }
+    if (responses.length() == 0)
+	cerr << "suite: no responses in " << responseDirectory.toStdString() << ", resolver left out" << endl;
+
+    for (QStringList::iterator size = sizes.begin(); size != sizes.end(); size++)
+    {
+	int photos = size->toInt();
+
+	if (photos < 1)
+	{
+	    cerr << "suite: bad size " << size->toStdString() << endl;
+	    return 255;
+	}
+	mismatches += run(photos, seed, responses);
+    }
+
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+# include	<stdio.h>
+# include	<iostream>
+# include	<vector>
+# include	<jpeglib.h>
+# include	<QElapsedTimer>
+# include	<QFile>
+# include	<QList>
+# include	<QByteArray>
+# include	"Thumbnailer.h"
+# include	"bench.h"
+
+using namespace std;
+
+// Keeps the compiler from optimizing the work away
+static volatile int sink;
+
+/*
+ * NAME: full_decode
+ * PURPOSE: To decode an image at full resolution, which is what
+ *	making a thumbnail would cost without DCT scaling
+ * ARGUMENTS: pathname: image file
+ * RETURNS: true on success
+ * NOTE: libjpeg's default error handler exits on damaged files,
+ *	so only feed it good ones.
+ */
+static bool
+full_decode(const char *pathname)
+{
+    struct jpeg_decompress_struct dinfo;
+    struct jpeg_error_mgr err;
+    std::vector<unsigned char> row;
+    FILE *in;
+
+    if ((in = fopen(pathname, "rb")) == NULL)
+	return false;
+    dinfo.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&dinfo);
+    jpeg_stdio_src(&dinfo, in);
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&dinfo);
+    row.resize(dinfo.output_width * dinfo.output_components);
+    while (dinfo.output_scanline < dinfo.output_height)
+    {
+	JSAMPROW r = &row[0];
+
+	jpeg_read_scanlines(&dinfo, &r, 1);
+    }
+    sink = row[row.size() / 2];
+    jpeg_finish_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+    fclose(in);
+
+    return true;
+}
+
+/*
+ * NAME: bench_thumbnail
+ * PURPOSE: To compare generating a thumbnail with decoding the full image
+ * ARGUMENTS: args: [-n iterations] file.jpg ...
+ * RETURNS: exit code
+ * NOTE: The times are printed per image, then summed up.
+ */
+int
+bench_thumbnail(QStringList args)
+{
+    int iterations = 3;
+    QList<QByteArray> files;
+    std::vector<unsigned char> jpeg;
+    QElapsedTimer timer;
+    qint64 fullTotal = 0, thumbTotal = 0;
+
+    if (args.length() >= 2 && args[0] == "-n")
+    {
+	iterations = args[1].toInt();
+	args.removeFirst();
+	args.removeFirst();
+    }
+    for (QStringList::iterator arg = args.begin(); arg != args.end(); arg++)
+	files.append(QFile::encodeName(*arg));
+    if (files.length() == 0 || iterations < 1)
+    {
+	cerr << "thumbnail: no files given" << endl;
+	return 255;
+    }
+
+    for (QList<QByteArray>::iterator f = files.begin(); f != files.end(); f++)
+    {
+	Thumbnailer thumbnailer(160);
+	qint64 full, thumb;
+
+	// warm up the page cache, and skip what we cannot read
+	if (!thumbnailer.Generate(f->constData(), &jpeg))
+	{
+	    cerr << f->constData() << ": not a JPEG image we can read" << endl;
+	    continue;
+	}
+
+	timer.start();
+	for (int i = 0; i < iterations; i++)
+	    full_decode(f->constData());
+	full = timer.nsecsElapsed() / iterations;
+
+	timer.restart();
+	for (int i = 0; i < iterations; i++)
+	    thumbnailer.Generate(f->constData(), &jpeg);
+	thumb = timer.nsecsElapsed() / iterations;
+
+	cout << f->constData() << ": " << thumbnailer.Width() << "x" << thumbnailer.Height()
+	     << " full " << full / 1000 << " us, thumbnail at 1/" << thumbnailer.Denominator()
+	     << " " << thumb / 1000 << " us" << endl;
+	fullTotal += full;
+	thumbTotal += thumb;
+    }
+
+    cout << "full decode: " << fullTotal / 1000 << " us" << endl;
+    cout << "thumbnails:  " << thumbTotal / 1000 << " us" << endl;
+    cout << "speedup:     " << (thumbTotal > 0 ? (double) fullTotal / thumbTotal : 0.0) << endl;
+
+    return 0;
+}
@@ -1,28 +0,0 @@
-#ifndef CLICKABLELABEL_H
-#define CLICKABLELABEL_H
-
-#include <QLabel>
-#include <QWidget>
-#include <Qt>
-
-// https://wiki.qt.io/Clickable_QLabel
-
-class ClickableLabel : public QLabel { 
-    Q_OBJECT 
-
-public:
-    explicit ClickableLabel(QWidget* parent = Q_NULLPTR, Qt::WindowFlags f = Qt::WindowFlags());
-    ~ClickableLabel();
-    void setImageName(QString);
-    QString ImageName();
-private:
-    QString imgname;
-signals:
-    void clicked();
-
-protected:
-    void mousePressEvent(QMouseEvent* event);
-
-};
-
-#endif // CLICKABLELABEL_H
@@ -3,34 +3,172 @@
 # include	<iostream>
 # include	<fstream>
 # include	<QApplication>
+# include	<QCoreApplication>
+# include	<QScopedPointer>
 # include	<QCommandLineParser>
 # include	<QDebug>
-# include	<QDirIterator>
 # include	<QFile>
+# include	<QFileInfo>
 # include	<QDataStream>
+# include	<QThread>
+# include	<QHash>
+# include	<QDateTime>
+# include	<curl/curl.h>
 # include	<unistd.h>
 # include	<errno.h>
 # include	<string.h>
 # include	<stdlib.h>
 
-# include	"Exif.h"
 # include	"Viewer.h"
+# include	"PhotoView.h"
 # include	"Resolver.h"
+# include	"MetaIndex.h"
+# include	"GeoCache.h"
+# include	"GeoDB.h"
+# include	"Stats.h"
+# include	"BatchIndexer.h"
+# include	"Catalog.h"
 
 using namespace std;
 
-void update_index(float resolver_delay, unsigned int maxrequests);
-static void saveMap(QMap<QString,QString> *map, QString filename);
-
 int debug;
 QMap<QString,QString> *locationmap;
+QHash<QString,MetaIndex *> metaindexes;	// by directory, relative to the current directory
 float resolver_delay = 0.0;
+unsigned int scan_jobs = 1;
+bool recursive = false;
+QString external_viewer;	// shows the images instead of the built-in viewer if set
+double cluster_radius = 25.0;
+int resolver_inflight = 2;
+Catalog *catalog = NULL;	// all photos indexed so far, NULL if there is none
+
+/*
+ * NAME: headless
+ * PURPOSE: To find out if we are to run without a window
+ * ARGUMENTS: argc, argv: the command line
+ * RETURNS: true if --index-only or a catalog query was given
+ * NOTE: This has to be known before the application object is made,
+ *	which is before the command line is parsed.
+ */
+static bool
+headless(int argc, char *argv[])
+{
+    static const char *options[] = { "--index-only", "--near", "--box", "--taken" };
+
+    for (int i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+	for (size_t o = 0; o < sizeof(options) / sizeof(options[0]); o++)
+	    if (strncmp(argv[i], options[o], strlen(options[o])) == 0
+	     && (argv[i][strlen(options[o])] == '\0' || argv[i][strlen(options[o])] == '='))
+		return true;
+    return false;
+}
+
+/*
+ * NAME: parse_numbers
+ * PURPOSE: To split an option value into numbers
+ * ARGUMENTS: value: the numbers, separated by commas
+ *	count: how many there must be
+ *	numbers: where to put them
+ * RETURNS: true if there were that many valid numbers
+ */
+static bool
+parse_numbers(QString value, int count, double *numbers)
+{
+    QStringList fields(value.split(','));
+    bool ok = fields.length() == count;
+
+    for (int i = 0; ok && i < count; i++)
+	numbers[i] = fields[i].trimmed().toDouble(&ok);
+    return ok;
+}
+
+/*
+ * NAME: query_catalog
+ * PURPOSE: To print the photos of the catalog that match a query
+ * ARGUMENTS: parser: the command line
+ *	near, box, taken: the query options, one of them is set
+ *	pname: program name for error messages
+ * RETURNS: exit code: 0 on success, 255 on a malformed query
+ * NOTE: One photo per line, its pathname and its location separated
+ *	by a tab, oldest first. The dates of --taken are days, the
+ *	second one is included; like the Exif timestamps they are
+ *	taken as UTC.
+ */
+static int
+query_catalog(const QCommandLineParser &parser, const QCommandLineOption &near, const QCommandLineOption &box, const QCommandLineOption &taken, const char *pname)
+{
+    QList<CatalogEntry> entries;
+    double n[4];
+
+    if (parser.isSet(near))
+    {
+	if (!parse_numbers(parser.value(near), 3, n))
+	{
+	    cerr << "usage: " << pname << " --near lat,lon,meters" << endl;
+	    return 255;
+	}
+	entries = catalog->Radius(n[1], n[0], n[2]);
+    }
+    else if (parser.isSet(box))
+    {
+	if (!parse_numbers(parser.value(box), 4, n))
+	{
+	    cerr << "usage: " << pname << " --box minlat,minlon,maxlat,maxlon" << endl;
+	    return 255;
+	}
+	entries = catalog->Box(n[1], n[0], n[3], n[2]);
+    }
+    else
+    {
+	QStringList dates(parser.value(taken).split(','));
+	QDate from, to;
+
+	if (dates.length() == 2)
+	{
+	    from = QDate::fromString(dates[0].trimmed(), Qt::ISODate);
+	    to = QDate::fromString(dates[1].trimmed(), Qt::ISODate);
+	}
+	if (!from.isValid() || !to.isValid())
+	{
+	    cerr << "usage: " << pname << " --taken YYYY-MM-DD,YYYY-MM-DD" << endl;
+	    return 255;
+	}
+	entries = catalog->Between(QDateTime(from, QTime(0, 0), Qt::UTC).toMSecsSinceEpoch() / 1000,
+				   QDateTime(to.addDays(1), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch() / 1000);
+    }
+
+    for (QList<CatalogEntry>::iterator entry = entries.begin(); entry != entries.end(); entry++)
+	cout << entry->path.toStdString() << "\t" << entry->location.toStdString() << endl;
+    return 0;
+}
+
+/*
+ * NAME: write_stats
+ * PURPOSE: To write the timers and counters where the command line says
+ * ARGUMENTS: parser: the command line
+ *	stats, json, trace: the options that say where
+ *	pname: program name for error messages
+ * RETURNS: Nothing
+ */
+static void
+write_stats(const QCommandLineParser &parser, const QCommandLineOption &stats, const QCommandLineOption &json, const QCommandLineOption &trace, const char *pname)
+{
+    if (parser.isSet(stats))
+	Stats::Report(cerr);
+    if (parser.isSet(json) && !Stats::WriteJson(parser.value(json)))
+	cerr << pname << ": Cannot write " << parser.value(json).toStdString() << endl;
+    if (parser.isSet(trace) && !Stats::WriteTrace(parser.value(trace)))
+	cerr << pname << ": Cannot write " << parser.value(trace).toStdString() << endl;
+}
 
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
+    // Indexing or querying without a window needs no display either
+    QScopedPointer<QCoreApplication> app(headless(argc, argv) ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
     QCommandLineParser commandline_parser;
-    QString delay_s;
+    QString delay_s, jobs_s, precision_s, radius_s, inflight_s, geodb_s, thumbcache_s;
+    int geocache_precision = 8;
+    int thumbnail_cache_mb = 64;
     char *pname;
 
     if ((pname = strrchr(argv[0], '/')) != NULL)
@@ -39,22 +177,160 @@ int main(int argc, char *argv[])
         pname = argv[0];
 
     QSettings settings("Josef Möllers", pname);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
 
     setlocale(LC_ALL, "en_US.UTF-8");
     QCommandLineOption debugOption("D", QCoreApplication::translate("main", "Show debug output"));
     commandline_parser.addOption(debugOption);
-    QCommandLineOption delayOption("delay", QCoreApplication::translate("main", "Specify delay between reverse geocoding"));
+    QCommandLineOption delayOption("delay", QCoreApplication::translate("main", "Specify delay between reverse geocoding (default: 0, " QT_STRINGIFY(BATCH_DEFAULT_DELAY) " with --index-only)"), "seconds");
     commandline_parser.addOption(delayOption);
-    commandline_parser.process(app);
+    QCommandLineOption recursiveOption("recursive", QCoreApplication::translate("main", "Show and index all directories below the directory as well"));
+    commandline_parser.addOption(recursiveOption);
+    QCommandLineOption viewerOption("viewer", QCoreApplication::translate("main", "Show images with this program (eg gwenview) instead of the built-in viewer"), "program");
+    commandline_parser.addOption(viewerOption);
+    QCommandLineOption jobsOption("jobs", QCoreApplication::translate("main", "Number of files to scan in parallel (default: number of cores)"), "N");
+    commandline_parser.addOption(jobsOption);
+    QCommandLineOption precisionOption("geocache-precision", QCoreApplication::translate("main", "Geohash length of a reverse geocoding cache cell (default: 8)"), "N");
+    commandline_parser.addOption(precisionOption);
+    QCommandLineOption radiusOption("cluster-radius", QCoreApplication::translate("main", "Photos closer than this share one reverse geocoding request (default: 25, 0 to disable)"), "meters");
+    commandline_parser.addOption(radiusOption);
+    QCommandLineOption inflightOption("inflight", QCoreApplication::translate("main", "Max number of reverse geocoding requests running at the same time (default: 2)"), "N");
+    commandline_parser.addOption(inflightOption);
+    QCommandLineOption geodbOption("geodb", QCoreApplication::translate("main", "Reverse geocode offline from this database"), "file");
+    commandline_parser.addOption(geodbOption);
+    QCommandLineOption geocoderOption("geocoder", QCoreApplication::translate("main", "Base URL of a Nominatim compatible reverse geocoder (default: " DEFAULT_GEOCODER ")"), "URL");
+    commandline_parser.addOption(geocoderOption);
+    QCommandLineOption thumbcacheOption("thumbnail-cache", QCoreApplication::translate("main", "Memory for decoded thumbnails (default: 64)"), "MB");
+    commandline_parser.addOption(thumbcacheOption);
+    QCommandLineOption buildGeodbOption("build-geodb", QCoreApplication::translate("main", "Compile the GeoNames TSV files given as arguments into an offline database and exit"), "file");
+    commandline_parser.addOption(buildGeodbOption);
+    QCommandLineOption statsOption("stats", QCoreApplication::translate("main", "Show where the time went when done"));
+    commandline_parser.addOption(statsOption);
+    QCommandLineOption statsJsonOption("stats-json", QCoreApplication::translate("main", "Write the timers and counters to this file as JSON when done"), "file");
+    commandline_parser.addOption(statsJsonOption);
+    QCommandLineOption traceOption("trace", QCoreApplication::translate("main", "Write a Chrome trace event file (see chrome://tracing) when done"), "file");
+    commandline_parser.addOption(traceOption);
+    QCommandLineOption indexOnlyOption("index-only", QCoreApplication::translate("main", "Index the directories given as arguments without a window, with no limit on the number of lookups, and exit"));
+    commandline_parser.addOption(indexOnlyOption);
+    QCommandLineOption catalogOption("catalog", QCoreApplication::translate("main", "Keep all photos indexed in this database (default: next to the settings, \"\" for none)"), "file");
+    commandline_parser.addOption(catalogOption);
+    QCommandLineOption nearOption("near", QCoreApplication::translate("main", "Show the photos of the catalog taken within this distance of a place and exit"), "lat,lon,meters");
+    commandline_parser.addOption(nearOption);
+    QCommandLineOption boxOption("box", QCoreApplication::translate("main", "Show the photos of the catalog taken within this box and exit"), "minlat,minlon,maxlat,maxlon");
+    commandline_parser.addOption(boxOption);
+    QCommandLineOption takenOption("taken", QCoreApplication::translate("main", "Show the photos of the catalog taken on these days and exit"), "from,to");
+    commandline_parser.addOption(takenOption);
+    commandline_parser.process(*app);
+
+    // Before any thread is started
+    if (commandline_parser.isSet(statsOption) || commandline_parser.isSet(statsJsonOption) || commandline_parser.isSet(traceOption))
+	Stats::Enable(commandline_parser.isSet(traceOption));
 
     debug = commandline_parser.isSet(debugOption);
+    recursive = commandline_parser.isSet(recursiveOption);
+    external_viewer = commandline_parser.value(viewerOption);
     delay_s = commandline_parser.value(delayOption);
     if (delay_s.length() > 0)
         resolver_delay = delay_s.toFloat();
+    Resolver::SetDelay(resolver_delay);
+    jobs_s = commandline_parser.value(jobsOption);
+    if (jobs_s.length() > 0)
+        scan_jobs = jobs_s.toUInt();
+    else
+        scan_jobs = QThread::idealThreadCount();
+    if (scan_jobs < 1)
+        scan_jobs = 1;
+    precision_s = commandline_parser.value(precisionOption);
+    if (precision_s.length() > 0)
+        geocache_precision = precision_s.toInt();
+    radius_s = commandline_parser.value(radiusOption);
+    if (radius_s.length() > 0)
+        cluster_radius = radius_s.toDouble();
+    inflight_s = commandline_parser.value(inflightOption);
+    if (inflight_s.length() > 0)
+        resolver_inflight = inflight_s.toInt();
+    thumbcache_s = commandline_parser.value(thumbcacheOption);
+    if (thumbcache_s.length() > 0)
+        thumbnail_cache_mb = thumbcache_s.toInt();
+    if (commandline_parser.isSet(geocoderOption))
+        Resolver::SetBaseUrl(commandline_parser.value(geocoderOption));
+
+    if (commandline_parser.isSet(buildGeodbOption))
+    {
+	if (!GeoDB::Build(commandline_parser.positionalArguments(), commandline_parser.value(buildGeodbOption)))
+	{
+	    cerr << argv[0] << ": Cannot build " << commandline_parser.value(buildGeodbOption).toStdString() << endl;
+	    exit(1);
+	}
+	exit(0);
+    }
+
+    GeoDB *geodb = NULL;
+    geodb_s = commandline_parser.value(geodbOption);
+    if (geodb_s.length() > 0)
+    {
+	geodb = new GeoDB(geodb_s);
+	if (!geodb->IsValid())
+	{
+	    cerr << argv[0] << ": " << geodb_s.toStdString() << " is not a geocoding database" << endl;
+	    exit(1);
+	}
+	Resolver::SetOfflineDB(geodb);
+    }
+
+    // The reverse geocoding cache lives next to our settings
+    GeoCache geocache(QFileInfo(settings.fileName()).absolutePath() + "/" + pname + "-geocache", geocache_precision);
+    Resolver::SetCache(&geocache);
+
+    // So is the catalog, unless another one is asked for
+    QString catalog_s(QFileInfo(settings.fileName()).absolutePath() + "/" + pname + "-catalog.db");
+    if (commandline_parser.isSet(catalogOption))
+	catalog_s = commandline_parser.value(catalogOption);
+    if (catalog_s.length() > 0)
+    {
+	catalog = new Catalog(catalog_s);
+	if (!catalog->IsValid())
+	{
+	    cerr << argv[0] << ": Cannot open the catalog " << catalog_s.toStdString() << endl;
+	    delete catalog;
+	    catalog = NULL;
+	}
+    }
+
+    if (commandline_parser.isSet(nearOption) || commandline_parser.isSet(boxOption) || commandline_parser.isSet(takenOption))
+    {
+	if (catalog == NULL)
+	    exit(1);
+	int status = query_catalog(commandline_parser, nearOption, boxOption, takenOption, argv[0]);
+	write_stats(commandline_parser, statsOption, statsJsonOption, traceOption, argv[0]);
+	return status;
+    }
 
     const QStringList args = commandline_parser.positionalArguments();
     QString savedDir(settings.value("directory", ".").toString());
 
+    if (commandline_parser.isSet(indexOnlyOption))
+    {
+	if (args.length() == 0)
+	{
+	    cerr << "usage: " << argv[0] << " --index-only [--recursive] directory ..." << endl;
+	    exit(255);
+	}
+
+	// Without a cap on the lookups, the public geocoder must not be flooded
+	if (!commandline_parser.isSet(delayOption))
+	{
+	    resolver_delay = BATCH_DEFAULT_DELAY;
+	    Resolver::SetDelay(resolver_delay);
+	}
+
+	BatchIndexer batch(args, recursive, resolver_delay, scan_jobs);
+	int status = batch.Run();
+	delete catalog;
+	write_stats(commandline_parser, statsOption, statsJsonOption, traceOption, argv[0]);
+	return status;
+    }
+
     switch (args.length())
     {
     case 1:
@@ -77,176 +353,25 @@ int main(int argc, char *argv[])
 	exit(255);
     }
 
-    // First step: load and update the location map
-    update_index(resolver_delay, 100);
-
-    QStringList filenames(locationmap->keys());
-    filenames.sort(Qt::CaseInsensitive);
-
-    /*
-     * We now have:
-     * - a list of locations for some of the images
-     * - a directory with thumbnails for some (all?) of the images
-     */
-
-    // Next step: build viewer
-    Viewer *v = new Viewer(filenames, locationmap, &settings);
+    // The viewer shows what is known about the directory and indexes it in the background
+    ThumbnailCache thumbnails((qint64) thumbnail_cache_mb * 1024 * 1024, THUMB_SIZE);
+    Viewer *v = new Viewer(&settings, &thumbnails);
     v->show();
-    app.connect(&app, SIGNAL(lastWindowClosed()), &app, SLOT(quit()));
-
-    app.exec();
-    return 0;
-}
-
-/*
- * NAME: update_index
- * PURPOSE: To update the location database of the current directory
- *	and create thumbnails
- * ARGUMENTS: resolver_delay: delay between requests to reverse geocoder
- *	max_requests: max number of requests this time
- * RETURNS: Nothing
- */
-void
-update_index(float resolver_delay, unsigned int max_requests)
-{
-    QFile inputFile(".location.csv");
-    bool isModified = false;
-    unsigned int count;
-    locationmap = new QMap<QString,QString>;
-
-    // Read current contents of location file
-    if (inputFile.open(QIODevice::ReadOnly | QIODevice::Text))
-    {
-	QTextStream in(&inputFile);
-	while (!in.atEnd())
-	{
-	    QString line = in.readLine();
-
-	    while (1)
-	        if (line.endsWith('\r') || line.endsWith('\n'))
-		    line.remove(line.length()-1, 1);
-		else
-		    break;
-
-	    QStringList fields = line.split(',');
-	    fields.replaceInStrings("%2c", ",");
-	    fields.replaceInStrings("%22", "\"");
-	    fields.replaceInStrings("%25", "%");
-	    for (QStringList::iterator e = fields.begin(); e != fields.end(); e++)
-	    {
-	        if (e->startsWith('"') && e->endsWith('"'))
-		{
-		    e->remove(0, 1);
-		    e->remove(e->size()-1, 1);
-		}
-	        // qDebug() << "After replacement: \"" << e->toStdString().c_str() << "\"";
-	    }
-
-	    // Check if file still exists
-	    if (access(fields[0].toStdString().c_str(), F_OK) == -1)
-	    {
-		isModified = 1;
-	        continue;
-	    }
-	    locationmap->insert(fields[0], fields[1]);
-	}
-	inputFile.close();
-    }
-
-    // Now work through the list of files and augment the map
-    QStringList wantedFiles;
-    wantedFiles << "*.jpg";
-    wantedFiles << "*.mov";
+    app->connect(app.data(), SIGNAL(lastWindowClosed()), app.data(), SLOT(quit()));
 
-    QDirIterator it(".", wantedFiles, QDir::Files, 0);	// don't descend! QDirIterator::Subdirectories);
-
-    count = 0;
-    while (it.hasNext())
+    app->exec();
+    // Lets a running indexer save its work, it may still use the catalog
+    delete v;
+    delete catalog;
+    if (debug)
     {
-	QString filename = it.next();
-	// qDebug() << "File                 : " << filename;
-	Exif exif(filename);
-	// qDebug() << "Orientation          : " << exif.Orientation();
-
-	// We deal with JPEG files only
-	if (!filename.endsWith(".jpg", Qt::CaseInsensitive) && !filename.endsWith(".jpeg", Qt::CaseInsensitive))
-	    continue;
-
-	// Strip any leading "./"
-	if (filename.startsWith("./"))
-	    filename.remove(0, 2);
-
-	exif.SaveThumbnail(QString(".thumbnails"), filename);
-
-	// No need to go further if we already have a location
-	if (locationmap->value(filename, QString()).length() != 0)
-	    continue;
-	    
-	// Use "Unbekannt" as the location if we do not have any coodinates
-	if (exif.Latitude() == 0.0 && exif.Longitude() == 0.0)
-	{
-	    locationmap->insert(filename, "Unbekannt");
-	    isModified = true;
-	}
-	else	// Resolve coordinates into a location
-	{
-	    Resolver res;
-
-	    // qDebug() << "Latitude             : " << exif.Latitude();
-	    // qDebug() << "Longitude            : " << exif.Longitude();
-	    // qDebug() << "Date/Time Original   : " << exif.Date();
-
-	    if (count > 0 && resolver_delay > 0.0)
-	        usleep(resolver_delay * (useconds_t) 1000000);
-	        
-	    QString location(res.Location(exif.Longitude(), exif.Latitude()));
-	    if (location.length() != 0)
-	    {
-		isModified = true;
-		locationmap->insert(filename, location);
-	    }
-	    if (count++ > max_requests)
-	        break;
-	}
-    }
-    if (isModified)
-    {
-        // qDebug() << "Map was modified, saving";
-        saveMap(locationmap, ".location.csv");
-    }
-
-    return;
-}
-
-static QString
-encode(QString s)
-{
-    QString result(s);
-
-    result.replace("%", "%25");
-    result.replace("\"", "%22");
-    result.replace(",", "%2c");
-
-    return result;
-}
-
-static void
-saveMap(QMap<QString,QString> *map, QString filename)
-{
-    QFile outputFile(filename);
-
-    if (outputFile.exists())
-    {
-        // qDebug() << "Location file exists, backing up";
-	outputFile.rename(filename + "~");
-    }
-
-    if (outputFile.open(QIODevice::WriteOnly | QIODevice::Text))
-    {
-	QTextStream stream(&outputFile);
-        // qDebug() << "Location database opened for writing";
-
-	for (QMap<QString,QString>::iterator elem = map->begin(); elem != map->end(); elem++)
-	    stream << '"' << encode(elem.key()) << "\",\"" << encode(elem.value()) << '"' << endl;
+	cerr << "geocache: " << geocache.Hits() << " hits, " << geocache.Misses() << " misses" << endl;
+	cerr << "thumbnails: " << thumbnails.Hits() << " hits, " << thumbnails.Misses() << " misses ("
+	     << (thumbnails.Hits() + thumbnails.Misses() ? 100.0 * thumbnails.Hits() / (thumbnails.Hits() + thumbnails.Misses()) : 0.0)
+	     << "% hit rate), " << thumbnails.Evictions() << " evictions, "
+	     << thumbnails.Decoded() << " decoded in " << thumbnails.DecodeTime() / 1000000 << " ms, "
+	     << thumbnails.Cancelled() << " cancelled" << endl;
     }
+    write_stats(commandline_parser, statsOption, statsJsonOption, traceOption, argv[0]);
+    return 0;
 }
@@ -5,10 +5,10 @@
 TEMPLATE = app
 TARGET = fpv
 INCLUDEPATH += .
-QT += core widgets
+QT += core widgets concurrent
 CONFIG += c++11
-LIBS += -lcurl -lexif
+LIBS += -lcurl -lexif -ljpeg -lsqlite3
 
 # Input
-HEADERS += Exif.h Viewer.h Resolver.h clickablelabel.h
-SOURCES += fpv.cpp Exif.cpp Viewer.cpp Resolver.cpp clickablelabel.cpp
+HEADERS += Exif.h ExifParser.h MetaIndex.h Viewer.h Resolver.h AsyncResolver.h GeoCache.h GeoDB.h Cluster.h PhotoModel.h PhotoView.h ThumbnailCache.h Scheduler.h Thumbnailer.h ThumbPack.h Indexer.h LocationStore.h ImageViewer.h Stats.h BatchIndexer.h Catalog.h
+SOURCES += fpv.cpp Exif.cpp ExifParser.cpp MetaIndex.cpp Viewer.cpp Resolver.cpp AsyncResolver.cpp GeoCache.cpp GeoDB.cpp Cluster.cpp PhotoModel.cpp PhotoView.cpp ThumbnailCache.cpp Scheduler.cpp Thumbnailer.cpp ThumbPack.cpp Indexer.cpp LocationStore.cpp ImageViewer.cpp Stats.cpp BatchIndexer.cpp Catalog.cpp